@@ -4,13 +4,21 @@
 */
 
 #include "Engine.h"
-#ifdef USE_SDL_FRAMEWORK
-#include <SDL_syswm.h>
-#else
-#include <SDL2/SDL_syswm.h>
+#ifdef _WIN32
+#include <SDL2/SDL_syswm.h>	//For isMaximized()
 #endif
 #include "opengl-api.h"
-ofstream errlog;
+#include <algorithm>
+#include <climits>
+
+#define FRAME_SPIN_MS			2		//How long before a frame is due we stop sleeping and start spinning
+#define FRAME_STAT_SMOOTHING	0.05	//How quickly frame time/jitter stats follow the actual values
+#define MAX_CATCHUP_STEPS		3		//Most simulation steps we'll run back-to-back to catch up before dropping time
+#define RENDER_SCALE_STEP		0.1f		//How much render resolution changes at once
+#define RENDER_SCALE_SLOW		1.2		//Frame time (relative to target) above which we drop render resolution
+#define RENDER_SCALE_FAST		1.05	//Frame time (relative to target) below which we raise render resolution
+#define RENDER_SCALE_DOWN_FRAMES	20	//Frames to let frame time settle after dropping resolution
+#define RENDER_SCALE_UP_FRAMES	120		//Frames to wait after raising resolution
 
 void PrintEvent(const SDL_Event * event)
 {
@@ -70,51 +78,69 @@ void PrintEvent(const SDL_Event * event)
 	}
 }
 
+bool Engine::_handleEvent(SDL_Event event)
+{
+	//PrintEvent(&event);
+	//Update internal cursor position if cursor has moved
+	if(event.type == SDL_MOUSEMOTION)
+	{
+		m_ptCursorPos.x = event.motion.x;
+		m_ptCursorPos.y = event.motion.y;
+	}
+	else if(event.type == SDL_WINDOWEVENT)
+	{
+		if(event.window.event == SDL_WINDOWEVENT_FOCUS_LOST && m_bPauseOnKeyboardFocus)
+		{
+			m_bPaused = true;
+			pause();
+		}
+		else if(event.window.event == SDL_WINDOWEVENT_FOCUS_GAINED && m_bPauseOnKeyboardFocus)
+		{
+			m_bPaused = false;
+			resume();
+		}
+		else if(event.window.event == SDL_WINDOWEVENT_RESIZED)
+		{
+			if(m_bResizable)
+				changeScreenResolution(event.window.data1, event.window.data2);
+			else
+				errlog(LOG_ERROR) << "Error! Resize event generated, but resizable flag not set." << endl;
+		}
+		else if(event.window.event == SDL_WINDOWEVENT_ENTER)
+			m_bCursorOutOfWindow = false;
+		else if(event.window.event == SDL_WINDOWEVENT_LEAVE)
+			m_bCursorOutOfWindow = true;
+	}
+	else if(event.type == SDL_QUIT)
+		return true;
+#ifdef USE_PROFILER
+	else if(event.type == SDL_KEYDOWN && event.key.keysym.scancode == PROFILE_DUMP_KEY)
+		PROFILE_DUMP(getSaveLocation() + "trace.json");
+#endif
+		
+	//Let final game engine handle it, whatever the case
+	if(!m_bPaused)
+	{
+		g_replay.recordEvent(event);
+		handleEvent(event);
+	}
+	return false;
+}
+
 bool Engine::_frame()
 {
+	if(g_replay.playing())
+		return _replayFrame();
+	
+	PROFILE_ZONE("Engine::_frame");
 	updateSound();
 	
 	//Handle input events from SDL
 	SDL_Event event;
 	while(SDL_PollEvent(&event))
 	{
-		//PrintEvent(&event);
-		//Update internal cursor position if cursor has moved
-		if(event.type == SDL_MOUSEMOTION)
-		{
-			m_ptCursorPos.x = event.motion.x;
-			m_ptCursorPos.y = event.motion.y;
-		}
-		else if(event.type == SDL_WINDOWEVENT)
-		{
-			if(event.window.event == SDL_WINDOWEVENT_FOCUS_LOST && m_bPauseOnKeyboardFocus)
-			{
-				m_bPaused = true;
-				pause();
-			}
-			else if(event.window.event == SDL_WINDOWEVENT_FOCUS_GAINED && m_bPauseOnKeyboardFocus)
-			{
-				m_bPaused = false;
-				resume();
-			}
-			else if(event.window.event == SDL_WINDOWEVENT_RESIZED)
-			{
-				if(m_bResizable)
-					changeScreenResolution(event.window.data1, event.window.data2);
-				else
-					errlog << "Error! Resize event generated, but resizable flag not set." << endl;
-			}
-			else if(event.window.event == SDL_WINDOWEVENT_ENTER)
-				m_bCursorOutOfWindow = false;
-			else if(event.window.event == SDL_WINDOWEVENT_LEAVE)
-				m_bCursorOutOfWindow = true;
-		}
-		else if(event.type == SDL_QUIT)
+		if(_handleEvent(event))
 			return true;
-			
-		//Let final game engine handle it, whatever the case
-		if(!m_bPaused)
-			handleEvent(event);
 	}
 	if(m_bPaused)
 	{
@@ -122,22 +148,106 @@ bool Engine::_frame()
 		return m_bQuitting;	//Break out here
 	}
 
-	float32 fCurTime = ((float32)SDL_GetTicks())/1000.0;
-	if(m_fAccumulatedTime <= fCurTime)
+	Uint64 iCurTime = SDL_GetPerformanceCounter();
+	if(m_iNextFrame <= iCurTime)
 	{
-		m_fAccumulatedTime += m_fTargetTime;
+		//Keep track of how close to our target framerate we're actually getting
+		if(m_iLastFrame)
+		{
+			float32 fElapsed = (float32)(iCurTime - m_iLastFrame) / (float32)SDL_GetPerformanceFrequency();
+			m_fFrameTime += (fElapsed - m_fFrameTime) * FRAME_STAT_SMOOTHING;
+			m_fFrameJitter += (fabs(fElapsed - m_fTargetTime) - m_fFrameJitter) * FRAME_STAT_SMOOTHING;
+		}
+		m_iLastFrame = iCurTime;
+		
+		if(m_iNextFrame + m_iTicksPerFrame * MAX_CATCHUP_STEPS < iCurTime)	//We've gotten far too behind; we could have a huge FPS jump if the load lessens
+			m_iNextFrame = iCurTime - m_iTicksPerFrame * (MAX_CATCHUP_STEPS - 1);	 //Drop any frames past this
+		
+		//Run every simulation step that's due before drawing, so a slow step doesn't also cost us extra renders
 		m_iKeystates = SDL_GetKeyboardState(NULL);	//Get current key state
-		frame(m_fTargetTime);	//Box2D wants fixed timestep, so we use target framerate here instead of actual elapsed time
+		while(m_iNextFrame <= iCurTime)
+		{
+			frame(m_fTargetTime);	//Box2D wants fixed timestep, so we use target framerate here instead of actual elapsed time
+			stepAudio(m_fTargetTime);
+			g_replay.step();
+			m_iNextFrame += m_iTicksPerFrame;
+		}
+		
 		_render();
+#ifdef USE_MEMTRACK
+		memFrame();
+#endif
 	}
-
-	if(m_fAccumulatedTime + m_fTargetTime * 3.0 < fCurTime)	//We've gotten far too behind; we could have a huge FPS jump if the load lessens
-		m_fAccumulatedTime = fCurTime;	 //Drop any frames past this
+	else
+		_waitForFrame();
+	
 	return m_bQuitting;
 }
 
+bool Engine::_replayFrame()
+{
+	PROFILE_ZONE("Engine::_replayFrame");
+	Uint64 iStart = SDL_GetPerformanceCounter();
+	OpenGLAPI::ResetCallCount();
+	updateSound();
+	
+	//Throw away real input; only the recording gets a say
+	SDL_Event event;
+	while(SDL_PollEvent(&event))
+	{
+		if(event.type == SDL_QUIT)
+			return true;
+	}
+	while(g_replay.nextEvent(&event))
+	{
+		if(_handleEvent(event))
+			return true;
+	}
+	
+	//One simulation step per frame, as fast as we can go
+	m_iKeystates = g_replay.getKeys();
+	frame(m_fTargetTime);
+	stepAudio(m_fTargetTime);
+	g_replay.step();
+	_render();
+	
+	int iAllocs = -1;
+#ifdef USE_MEMTRACK
+	memFrame();
+	iAllocs = memGetTotal().frameAllocs;
+#endif
+	float32 fMs = (float32)(SDL_GetPerformanceCounter() - iStart) * 1000.0f / (float32)SDL_GetPerformanceFrequency();
+	g_replay.addFrame(fMs, iAllocs, OpenGLAPI::GetCallCount());
+	
+	return m_bQuitting || g_replay.done();
+}
+
+void Engine::_waitForFrame()
+{
+	PROFILE_ZONE("Engine::_waitForFrame");
+	Uint64 iCurTime = SDL_GetPerformanceCounter();
+	if(iCurTime >= m_iNextFrame) return;
+	
+	//Sleep for most of the remaining time, since SDL_Delay() can overshoot by a ms or so
+	Uint64 iFreq = SDL_GetPerformanceFrequency();
+	Uint32 iMsLeft = (Uint32)((m_iNextFrame - iCurTime) * 1000 / iFreq);
+	if(iMsLeft > FRAME_SPIN_MS)
+		SDL_Delay(iMsLeft - FRAME_SPIN_MS);
+	
+	//Spin for whatever's left so we hit the deadline precisely
+	while(SDL_GetPerformanceCounter() < m_iNextFrame);
+}
+
 void Engine::_render()
 {
+	//Draw offscreen if we're at lower resolution or need to adjust brightness
+	bool bOffscreen = m_iSceneFBO && (m_fRenderScale < 1.0f || m_fGamma != 1.0f);
+	if(bOffscreen)
+	{
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, m_iSceneFBO);
+		glViewport(0, 0, max((int)(m_iWidth * m_fRenderScale), 1), max((int)(m_iHeight * m_fRenderScale), 1));
+	}
+	
 	// Begin rendering by clearing the screen
 	glClear(GL_DEPTH_BUFFER_BIT);
 
@@ -149,27 +259,204 @@ void Engine::_render()
 	if(m_cursor && m_bCursorShow && !m_bCursorOutOfWindow)
 		m_cursor->draw();
 	
-	//Draw gamma/brightness overlay on top of everything else
+	if(bOffscreen)
+	{
+		//Scale what we drew up to the window, with gamma/brightness applied
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+		glViewport(0, 0, m_iWidth, m_iHeight);
+		_drawScene();
+	}
+	else if(m_fGamma != 1.0f)
+	{
+		//No offscreen target; draw gamma/brightness overlay on top of everything else
+		glClear(GL_DEPTH_BUFFER_BIT);
+		glEnable(GL_BLEND);
+		Color fillCol;
+		if(m_fGamma > 1.0f)
+		{
+			glBlendFunc(GL_DST_COLOR, GL_ONE);
+			fillCol.set(m_fGamma - 1.0, m_fGamma - 1.0, m_fGamma - 1.0, 1);
+		}
+		else
+		{
+			glBlendFunc( GL_ZERO, GL_SRC_COLOR );
+			fillCol.set(m_fGamma, m_fGamma, m_fGamma, 1);
+		}
+		fillScreen(fillCol);
+		
+		//Reset blend func
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+	
+	//End rendering and update the screen
+	{
+		PROFILE_ZONE("SDL_GL_SwapWindow");
+		SDL_GL_SwapWindow(m_Window);
+	}
+	
+	_updateRenderScale();
+}
+
+void Engine::_drawScene()
+{
+	//Only part of the render target was drawn to, if we're at lower resolution
+	float32 u = (float32)max((int)(m_iWidth * m_fRenderScale), 1) / (float32)m_iWidth;
+	float32 v = (float32)max((int)(m_iHeight * m_fRenderScale), 1) / (float32)m_iHeight;
+	
 	glClear(GL_DEPTH_BUFFER_BIT);
+	glBindTexture(GL_TEXTURE_2D, m_iSceneTex);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	
+	//Darkening is just tinting the scene
+	glDisable(GL_BLEND);
+	if(m_fGamma < 1.0f)
+		glColor4f(m_fGamma, m_fGamma, m_fGamma, 1.0);
+	else
+		glColor4f(1.0, 1.0, 1.0, 1.0);
+	glBegin(GL_QUADS);
+	glTexCoord2f(0.0, 0.0);
+	glVertex3i(-1, -1, -1);
+	glTexCoord2f(u, 0.0);
+	glVertex3i(1, -1, -1);
+	glTexCoord2f(u, v);
+	glVertex3i(1, 1, -1);
+	glTexCoord2f(0.0, v);
+	glVertex3i(-1, 1, -1);
+	glEnd();
 	glEnable(GL_BLEND);
-	Color fillCol;
+	
+	//Brightening adds the scene on top of itself again
 	if(m_fGamma > 1.0f)
 	{
-		glBlendFunc(GL_DST_COLOR, GL_ONE);
-		fillCol.set(m_fGamma - 1.0, m_fGamma - 1.0, m_fGamma - 1.0, 1);
+		glBlendFunc(GL_ONE, GL_ONE);
+		glColor4f(m_fGamma - 1.0, m_fGamma - 1.0, m_fGamma - 1.0, 1.0);
+		glBegin(GL_QUADS);
+		glTexCoord2f(0.0, 0.0);
+		glVertex3i(-1, -1, -1);
+		glTexCoord2f(u, 0.0);
+		glVertex3i(1, -1, -1);
+		glTexCoord2f(u, v);
+		glVertex3i(1, 1, -1);
+		glTexCoord2f(0.0, v);
+		glVertex3i(-1, 1, -1);
+		glEnd();
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	}
-	else
+	
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+	glColor4f(1.0, 1.0, 1.0, 1.0);
+}
+
+void Engine::_updateRenderScale()
+{
+	if(!m_iSceneFBO || m_fMinRenderScale >= 1.0f)
 	{
-		glBlendFunc( GL_ZERO, GL_SRC_COLOR );
-		fillCol.set(m_fGamma, m_fGamma, m_fGamma, 1);
+		m_fRenderScale = 1.0f;
+		return;
+	}
+	if(m_iRenderScaleCooldown > 0)
+	{
+		m_iRenderScaleCooldown--;
+		return;
 	}
-	fillScreen(fillCol);
 	
-	//Reset blend func
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	//Drop resolution quickly if we're falling behind, and raise it back slowly once we're comfortably keeping up
+	if(m_fFrameTime > m_fTargetTime * RENDER_SCALE_SLOW && m_fRenderScale > m_fMinRenderScale)
+	{
+		m_fRenderScale = max(m_fRenderScale - RENDER_SCALE_STEP, m_fMinRenderScale);
+		m_iRenderScaleCooldown = RENDER_SCALE_DOWN_FRAMES;
+	}
+	else if(m_fFrameTime < m_fTargetTime * RENDER_SCALE_FAST && m_fRenderScale < 1.0f)
+	{
+		m_fRenderScale = min(m_fRenderScale + RENDER_SCALE_STEP / 2.0f, 1.0f);
+		m_iRenderScaleCooldown = RENDER_SCALE_UP_FRAMES;
+	}
+}
+
+void Engine::setMinRenderScale(float32 fScale)
+{
+	if(fScale > 1.0f)
+		fScale = 1.0f;
+	if(fScale < 0.1f)
+		fScale = 0.1f;	//Any lower and you can't see anything anyway
+	m_fMinRenderScale = fScale;
+	if(m_fRenderScale < m_fMinRenderScale)
+		m_fRenderScale = m_fMinRenderScale;
+}
+
+void Engine::_setupRenderTarget()
+{
+	_destroyRenderTarget();
+	if(!OpenGLAPI::HasFramebuffers())
+		return;
 	
-	//End rendering and update the screen
-	SDL_GL_SwapWindow(m_Window);
+	//Color texture, at full window size so changing render scale doesn't mean reallocating
+	glGenTextures(1, &m_iSceneTex);
+	glBindTexture(GL_TEXTURE_2D, m_iSceneTex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_iWidth, m_iHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	
+	//Depth buffer
+	glGenRenderbuffersEXT(1, &m_iSceneDepth);
+	glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, m_iSceneDepth);
+	glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT24, m_iWidth, m_iHeight);
+	glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, 0);
+	
+	glGenFramebuffersEXT(1, &m_iSceneFBO);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, m_iSceneFBO);
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, m_iSceneTex, 0);
+	glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, m_iSceneDepth);
+	GLenum status = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+	
+	if(status != GL_FRAMEBUFFER_COMPLETE_EXT)
+	{
+		errlog(LOG_WARN) << "Offscreen render target incomplete (status " << status << "). Drawing straight to window." << endl;
+		_destroyRenderTarget();
+	}
+}
+
+void Engine::_destroyRenderTarget()
+{
+	if(m_iSceneFBO)
+		glDeleteFramebuffersEXT(1, &m_iSceneFBO);
+	if(m_iSceneDepth)
+		glDeleteRenderbuffersEXT(1, &m_iSceneDepth);
+	if(m_iSceneTex)
+		glDeleteTextures(1, &m_iSceneTex);
+	m_iSceneFBO = m_iSceneDepth = m_iSceneTex = 0;
+}
+
+audioOutput Engine::s_audioOutput = AUDIO_OUTPUT_DEFAULT;
+string Engine::s_sWavFile;
+
+void Engine::setAudioOutput(audioOutput output, string sWavFile)
+{
+	s_audioOutput = output;
+	s_sWavFile = sWavFile;
+}
+
+void Engine::audioCommandline(int argc, char** argv)
+{
+	for(int i = 1; i < argc; i++)
+	{
+		string sSwitch = argv[i];
+		if(sSwitch == "-nrtaudio" || sSwitch == "--nrtaudio")
+			setAudioOutput(AUDIO_OUTPUT_NRT);
+		else if((sSwitch == "-wavout" || sSwitch == "--wavout") && i < argc - 1)
+			setAudioOutput(AUDIO_OUTPUT_WAVWRITER_NRT, argv[++i]);
+	}
 }
 
 Engine::Engine(uint16_t iWidth, uint16_t iHeight, string sTitle, string sAppName, string sIcon, bool bResizable)
@@ -188,6 +475,10 @@ Engine::Engine(uint16_t iWidth, uint16_t iHeight, string sTitle, string sAppName
 	m_iWidth = iWidth;
 	m_iHeight = iHeight;
 	m_iMSAA = 0;	//Default: MSAA off
+	m_iSceneFBO = m_iSceneTex = m_iSceneDepth = 0;
+	m_fRenderScale = 1.0f;
+	m_fMinRenderScale = 0.5f;
+	m_iRenderScaleCooldown = 0;
 	m_iKeystates = NULL;
 	m_bShowCursor = true;
 	m_fFramerate = 60.0f;
@@ -203,21 +494,74 @@ Engine::Engine(uint16_t iWidth, uint16_t iHeight, string sTitle, string sAppName
 	m_bCursorOutOfWindow = false;
 
 	//Initialize engine stuff
-	m_fAccumulatedTime = 0.0;
+	m_iNextFrame = m_iLastFrame = 0;
+	m_fFrameTime = m_fTargetTime;
+	m_fFrameJitter = 0;
 	//m_bFirstMusic = true;
 	m_bQuitting = false;
-	srand(SDL_GetTicks());	//Not as random as it could be... narf
+	if(g_replay.active())
+		srand(g_replay.getSeed());	//Same seed for recording and playback
+	else
+		srand(SDL_GetTicks());	//Not as random as it could be... narf
 	m_fTimeScale = 1.0f;
 
 	errlog << "Initializing FMOD..." << endl;
-	if(FMOD_System_Create(&m_audioSystem) != FMOD_OK || FMOD_System_Init(m_audioSystem, 128, FMOD_INIT_NORMAL, 0) != FMOD_OK)
+	for(int i = 0; i < VOICE_COUNT; i++)
+		m_voices[i].channel = NULL;
+	m_iVoicesStarted = 0;
+	m_iSoundsLoading = 0;
+	m_iSoundLoadStart = 0;
+	m_musicSound = NULL;
+	m_musicChannel = NULL;
+	m_fMusicTime = -1.0f;
+	m_fOutputLatency = 0.0f;
+	m_fAudioOwed = 0.0;
+	m_iAudioBlock = AUDIO_NRT_BLOCK;
+	m_iAudioRate = (int)soundFreqDefault;
+	
+	//Playing back a recording is silent, and goes as fast as it can; the mixer has to keep step with it
+	audioOutput output = s_audioOutput;
+	if(output == AUDIO_OUTPUT_DEFAULT && g_replay.playing())
+		output = AUDIO_OUTPUT_NRT;
+	m_bAudioNRT = (output != AUDIO_OUTPUT_DEFAULT);
+	FMOD_OUTPUTTYPE outputType = (output == AUDIO_OUTPUT_WAVWRITER_NRT) ? FMOD_OUTPUTTYPE_WAVWRITER_NRT : FMOD_OUTPUTTYPE_NOSOUND_NRT;
+	void* driverData = (output == AUDIO_OUTPUT_WAVWRITER_NRT) ? (void*)s_sWavFile.c_str() : NULL;
+	
+#ifdef USE_MEMTRACK
+	if(!memInitFMOD())
+		errlog(LOG_WARN) << "Unable to hook FMOD memory allocation" << endl;
+#endif
+	if(FMOD_System_Create(&m_audioSystem) != FMOD_OK
+	   || (m_bAudioNRT && FMOD_System_SetOutput(m_audioSystem, outputType) != FMOD_OK)
+	   || (m_bAudioNRT && FMOD_System_SetDSPBufferSize(m_audioSystem, AUDIO_NRT_BLOCK, 4) != FMOD_OK)
+	   || FMOD_System_Init(m_audioSystem, 128, m_bAudioNRT ? (FMOD_INIT_NORMAL | FMOD_INIT_STREAM_FROM_UPDATE) : FMOD_INIT_NORMAL, driverData) != FMOD_OK)
 	{
-		errlog << "Failed to init FMOD." << std::endl;
+		errlog(LOG_ERROR) << "Failed to init FMOD." << std::endl;
 		m_bSoundDied = true;
 	}
 	else
 	{
 		m_bSoundDied = false;
+		
+		//Anything we analyze gets mixed this far ahead of being heard
+		unsigned int iBufferLen = 0;
+		int iNumBuffers = 0;
+		int iRate = 0;
+		if(FMOD_System_GetDSPBufferSize(m_audioSystem, &iBufferLen, &iNumBuffers) == FMOD_OK
+		   && FMOD_System_GetSoftwareFormat(m_audioSystem, &iRate, NULL, NULL, NULL, NULL, NULL) == FMOD_OK
+		   && iRate > 0)
+		{
+			m_iAudioBlock = iBufferLen;
+			m_iAudioRate = iRate;
+			if(m_bAudioNRT)	//Nothing's heard, so there's nothing to wait for
+				errlog << "Non-realtime audio output" << (driverData ? " to " + s_sWavFile : string()) << "; " << iBufferLen << " samples per step at " << iRate << "Hz" << endl;
+			else
+			{
+				m_fOutputLatency = (float32)(iBufferLen * iNumBuffers) / (float32)iRate;
+				errlog << "Audio output latency " << m_fOutputLatency * 1000.0f << "ms (" << iNumBuffers << " buffers of " << iBufferLen << " samples at " << iRate << "Hz)" << endl;
+			}
+		}
+		
 		//Figure out what sound drivers for input we have here
 		int numDrivers = 0;
 		FMOD_System_GetRecordNumDrivers(m_audioSystem, &numDrivers);
@@ -234,6 +578,7 @@ Engine::Engine(uint16_t iWidth, uint16_t iHeight, string sTitle, string sAppName
 
 Engine::~Engine()
 {
+	_destroyRenderTarget();
 	SDL_DestroyWindow(m_Window);
 
 	//Clean up our image map
@@ -243,8 +588,10 @@ Engine::~Engine()
 	//Clean up our sound effects
 	if(!m_bSoundDied)
 	{
-		for(map<string, FMOD_SOUND*>::iterator i = m_sounds.begin(); i != m_sounds.end(); i++)
-			FMOD_Sound_Release(i->second);
+		for(vector<FMOD_SOUND*>::iterator i = m_soundBank.begin(); i != m_soundBank.end(); i++)
+			FMOD_Sound_Release(*i);
+		if(m_musicSound != NULL)
+			FMOD_Sound_Release(m_musicSound);
 	}
 	
 	//Clean up FMOD
@@ -254,6 +601,9 @@ Engine::~Engine()
 		FMOD_System_Release(m_audioSystem);
 	}
 
+	PROFILE_DUMP(getSaveLocation() + "trace.json");
+	errlog << "Average frame time: " << m_fFrameTime * 1000.0 << "ms (target " << m_fTargetTime * 1000.0 << "ms), jitter: " << m_fFrameJitter * 1000.0 << "ms" << endl;
+	
 	// Clean up and shutdown
 	errlog << "Deleting phys world" << endl;
 	delete m_physicsWorld;
@@ -313,115 +663,341 @@ bool Engine::hasMic()
 	return numDrivers;
 }
 
-void Engine::createSound(string sPath, string sName)
+//Loudest sample in [iFrom, iFrom+iCount) of a 16-bit mono recording iLen samples long (wrapping at the end), and where the first one at or over iThreshold is
+static uint32_t scanRecording(FMOD_SOUND* rec, uint32_t iLen, uint32_t iFrom, uint32_t iCount, int iThreshold, int* iPeak)
+{
+	*iPeak = 0;
+	if(!iCount) return 0;
+	void* ptr[2] = {NULL, NULL};
+	unsigned int len[2] = {0, 0};
+	if(FMOD_Sound_Lock(rec, (iFrom % iLen) * sizeof(int16_t), iCount * sizeof(int16_t), &ptr[0], &ptr[1], &len[0], &len[1]) != FMOD_OK)
+		return iCount;
+	uint32_t iFirst = iCount;
+	uint32_t iOffset = 0;
+	for(int part = 0; part < 2; part++)
+	{
+		const int16_t* samples = (const int16_t*)ptr[part];
+		for(uint32_t i = 0; samples != NULL && i < len[part] / sizeof(int16_t); i++, iOffset++)
+		{
+			int iAmp = abs((int)samples[i]);
+			*iPeak = max(*iPeak, iAmp);
+			if(iAmp >= iThreshold && iFirst == iCount)
+				iFirst = iOffset;
+		}
+	}
+	FMOD_Sound_Unlock(rec, ptr[0], ptr[1], len[0], len[1]);
+	return iFirst;
+}
+
+float32 Engine::measureLatency(int iDriver)
+{
+	if(m_bSoundDied || m_bAudioNRT || !hasMic()) return -1.0f;
+	int iRate = 0;
+	if(FMOD_System_GetSoftwareFormat(m_audioSystem, &iRate, NULL, NULL, NULL, NULL, NULL) != FMOD_OK || iRate <= 0)
+		return -1.0f;
+	
+	//Something to record into, and a click to listen for
+	FMOD_CREATESOUNDEXINFO exinfo;
+	memset(&exinfo, 0, sizeof(exinfo));
+	exinfo.cbsize = sizeof(exinfo);
+	exinfo.numchannels = 1;
+	exinfo.format = FMOD_SOUND_FORMAT_PCM16;
+	exinfo.defaultfrequency = iRate;
+	uint32_t iRecLen = iRate * LATENCY_RECORD_SEC;
+	exinfo.length = iRecLen * sizeof(int16_t);
+	FMOD_SOUND* rec = NULL;
+	if(FMOD_System_CreateSound(m_audioSystem, NULL, FMOD_2D | FMOD_SOFTWARE | FMOD_OPENUSER | FMOD_LOOP_NORMAL, &exinfo, &rec) != FMOD_OK)
+		return -1.0f;
+	
+	uint32_t iClickLen = iRate * LATENCY_CLICK_MS / 1000;
+	exinfo.length = iClickLen * sizeof(int16_t);
+	FMOD_SOUND* click = NULL;
+	void* ptr1;
+	void* ptr2;
+	unsigned int len1, len2;
+	if(FMOD_System_CreateSound(m_audioSystem, NULL, FMOD_2D | FMOD_SOFTWARE | FMOD_OPENUSER, &exinfo, &click) != FMOD_OK
+	   || FMOD_Sound_Lock(click, 0, exinfo.length, &ptr1, &ptr2, &len1, &len2) != FMOD_OK)
+	{
+		if(click != NULL)
+			FMOD_Sound_Release(click);
+		FMOD_Sound_Release(rec);
+		return -1.0f;
+	}
+	int16_t* clickData = (int16_t*)ptr1;
+	for(uint32_t i = 0; i < len1 / sizeof(int16_t); i++)
+		clickData[i] = ((i * 2000 / iRate) & 1) ? 32000 : -32000;	//1kHz square wave; about as loud and easy to pick out as it gets
+	FMOD_Sound_Unlock(click, ptr1, ptr2, len1, len2);
+	
+	errlog << "Measuring audio latency through recording driver " << iDriver << "..." << endl;
+	vector<float32> lResults;
+	if(FMOD_System_RecordStart(m_audioSystem, iDriver, rec, true) == FMOD_OK)
+	{
+		for(int iTry = 0; iTry < LATENCY_TRIES; iTry++)
+		{
+			//Let the last click die out, and see how loud the room is without one
+			for(int i = 0; i < 30; i++)
+			{
+				FMOD_System_Update(m_audioSystem);
+				SDL_Delay(10);
+			}
+			unsigned int iPos = 0;
+			FMOD_System_GetRecordPosition(m_audioSystem, iDriver, &iPos);
+			int iNoise = 0;
+			uint32_t iWindow = iRate / 10;
+			scanRecording(rec, iRecLen, iPos + iRecLen - iWindow, iWindow, INT_MAX, &iNoise);
+			int iThreshold = max(iNoise * 4, 4000);
+			
+			unsigned int iStart = 0;
+			FMOD_System_GetRecordPosition(m_audioSystem, iDriver, &iStart);
+			FMOD_CHANNEL* channel = NULL;
+			if(FMOD_System_PlaySound(m_audioSystem, FMOD_CHANNEL_FREE, click, false, &channel) != FMOD_OK)
+				break;
+			
+			//Listen until we hear it (or give up)
+			uint32_t iScanned = 0;
+			bool bHeard = false;
+			Uint32 iStartTicks = SDL_GetTicks();
+			while(!bHeard && SDL_GetTicks() - iStartTicks < LATENCY_TIMEOUT)
+			{
+				FMOD_System_Update(m_audioSystem);
+				SDL_Delay(1);
+				FMOD_System_GetRecordPosition(m_audioSystem, iDriver, &iPos);
+				uint32_t iAvailable = (iPos + iRecLen - iStart) % iRecLen;
+				if(iAvailable <= iScanned)
+					continue;
+				int iPeak;
+				uint32_t iFound = scanRecording(rec, iRecLen, iStart + iScanned, iAvailable - iScanned, iThreshold, &iPeak);
+				if(iFound < iAvailable - iScanned)
+				{
+					bHeard = true;
+					iScanned += iFound;
+				}
+				else
+					iScanned = iAvailable;
+			}
+			if(bHeard)
+				lResults.push_back((float32)iScanned / (float32)iRate);
+			else
+				errlog(LOG_WARN) << "Didn't hear latency test click " << iTry + 1 << endl;
+		}
+		FMOD_System_RecordStop(m_audioSystem, iDriver);
+	}
+	FMOD_Sound_Release(click);
+	FMOD_Sound_Release(rec);
+	if(lResults.empty())
+		return -1.0f;
+	
+	//That's the whole round trip. The recording side only holds on to about one DSP buffer, so take that back off
+	sort(lResults.begin(), lResults.end());
+	float32 fRoundTrip = lResults[lResults.size() / 2];
+	unsigned int iBufferLen = 0;
+	FMOD_System_GetDSPBufferSize(m_audioSystem, &iBufferLen, NULL);
+	float32 fLatency = max(fRoundTrip - (float32)iBufferLen / (float32)iRate, 0.0f);
+	errlog << "Measured round trip " << fRoundTrip * 1000.0f << "ms; output latency " << fLatency * 1000.0f << "ms (FMOD's buffers alone account for " << m_fOutputLatency * 1000.0f << "ms)" << endl;
+	return fLatency;
+}
+
+soundHandle Engine::createSound(string sPath, string sName)
 {
-	if(m_bSoundDied || m_sounds.count(sName)) return;	//Don't duplicate sounds or attempt to play sounds if we can't
+	if(m_bSoundDied) return SOUND_NONE;	//Don't attempt to load sounds if we can't play them
+	map<string, soundHandle>::iterator i = m_soundNames.find(sName);
+	if(i != m_soundNames.end()) return i->second;	//Don't duplicate sounds
+	i = m_soundPaths.find(sPath);
+	if(i != m_soundPaths.end())
+	{
+		m_soundNames[sName] = i->second;	//Same file under another name
+		return i->second;
+	}
+	
+	//Sounds as samples, so they can play multiple times at once. Decoding happens on FMOD's loader thread, unless
+	//we're non-realtime; then whether a sound's ready in time to play would be up to the loader thread, not the simulation
 	errlog << "Load sound " << sPath << endl;
 	FMOD_SOUND* handle;
-	FMOD_MODE open_mode = FMOD_CREATESAMPLE;
-#ifndef DEBUG_REVSOUND
-	if(sName == "music")
-		open_mode = FMOD_CREATESTREAM;	//Open music as a stream, sounds as samples (so the sounds can play multiple times at once)
-#endif
-	if(FMOD_System_CreateSound(m_audioSystem, sPath.c_str(), open_mode, 0, &handle) == FMOD_OK)
-		m_sounds[sName] = handle;
+	FMOD_MODE mode = FMOD_CREATESAMPLE;
+	if(!m_bAudioNRT)
+		mode |= FMOD_NONBLOCKING;
+	if(FMOD_System_CreateSound(m_audioSystem, sPath.c_str(), mode, 0, &handle) != FMOD_OK)
+	{
+		errlog(LOG_ERROR) << "Unable to load sound " << sPath << endl;
+		return SOUND_NONE;
+	}
+	if(!m_bAudioNRT)
+	{
+		if(!m_iSoundsLoading)
+			m_iSoundLoadStart = SDL_GetTicks();
+		m_iSoundsLoading++;
+	}
+	soundHandle sound = m_soundBank.size();
+	m_soundBank.push_back(handle);
+	m_soundStates.push_back(m_bAudioNRT ? SOUND_READY : SOUND_LOADING);
+	m_soundPaths[sPath] = sound;
+	m_soundNames[sName] = sound;
+	return sound;
 }
 
-void Engine::playSound(string sName, float32 volume, float32 pan, float32 pitch)
+soundHandle Engine::getSound(string sName)
 {
-	if(m_bSoundDied || !m_sounds.count(sName)) return;
+	map<string, soundHandle>::iterator i = m_soundNames.find(sName);
+	if(i != m_soundNames.end())
+		return i->second;
+	return SOUND_NONE;
+}
+
+void Engine::playSound(soundHandle sound, float32 volume, float32 pan, float32 pitch, soundPriority priority)
+{
+	if(m_bSoundDied || !soundReady(sound)) return;	//Never wait on a sound that's still loading; just skip it
+	
+	//Find a free voice, or else the lowest-priority, oldest one we're allowed to steal
+	voice* v = NULL;
+	for(int i = 0; i < VOICE_COUNT; i++)
+	{
+		voice* cur = &m_voices[i];
+		if(cur->channel == NULL)
+		{
+			v = cur;
+			break;
+		}
+		if(cur->priority <= priority && (v == NULL || cur->priority < v->priority || (cur->priority == v->priority && cur->iStarted < v->iStarted)))
+			v = cur;
+	}
+	if(v == NULL) return;	//Everything playing is more important than this
+	if(v->channel != NULL)
+		FMOD_Channel_Stop(v->channel);
+	
 	FMOD_CHANNEL* channel;
-	FMOD_System_PlaySound(m_audioSystem, FMOD_CHANNEL_FREE, m_sounds[sName], false, &channel);
-	pair<string, FMOD_CHANNEL*> chan;
-	chan.first = sName;
-	chan.second = channel;
+	if(FMOD_System_PlaySound(m_audioSystem, FMOD_CHANNEL_FREE, m_soundBank[sound], true, &channel) != FMOD_OK)
+	{
+		v->channel = NULL;
+		return;
+	}
 	FMOD_Channel_SetVolume(channel, volume);
 	FMOD_Channel_SetPan(channel, pan);
 	FMOD_Channel_SetFrequency(channel, pitch * soundFreqDefault);
-	m_channels.insert(chan);
-}
-
-FMOD_CHANNEL* Engine::getChannel(string sSoundName)
-{
-	multimap<string, FMOD_CHANNEL*>::iterator i = m_channels.find(sSoundName);
-	if(i != m_channels.end())
-		return i->second;
-	return NULL;
+	FMOD_Channel_SetPaused(channel, false);
+	v->channel = channel;
+	v->priority = priority;
+	v->iStarted = m_iVoicesStarted++;
 }
 
 void Engine::pauseMusic()
 {
 	if(m_bSoundDied) return;
-	if(!m_channels.count("music")) return;
-	FMOD_Channel_SetPaused(getChannel("music"), true);
+	if(m_musicChannel == NULL) return;
+	FMOD_Channel_SetPaused(m_musicChannel, true);
 }
 
 void Engine::stopMusic()
 {
 	if(m_bSoundDied) return;
-	if(!m_channels.count("music")) return;
-	FMOD_Channel_SetPaused(getChannel("music"), true);
+	if(m_musicChannel == NULL) return;
+	FMOD_Channel_SetPaused(m_musicChannel, true);
 }
 
 void Engine::restartMusic()
 {
 	if(m_bSoundDied) return;
-	if(!m_channels.count("music")) return;
-	FMOD_Channel_SetPosition(getChannel("music"), 0, FMOD_TIMEUNIT_MS);
+	if(m_musicChannel == NULL) return;
+	FMOD_Channel_SetPosition(m_musicChannel, 0, FMOD_TIMEUNIT_MS);
+	_updateMusicTime();
 }
 
 void Engine::resumeMusic()
 {
 	if(m_bSoundDied) return;
-	if(!m_channels.count("music")) return;
-	FMOD_Channel_SetPaused(getChannel("music"), false);
+	if(m_musicChannel == NULL) return;
+	FMOD_Channel_SetPaused(m_musicChannel, false);
 }
 
 void Engine::seekMusic(float32 fTime)
 {
 	if(m_bSoundDied) return;
-	if(!m_channels.count("music")) return;
-	FMOD_Channel_SetPosition(getChannel("music"), fTime * 1000.0, FMOD_TIMEUNIT_MS);
+	if(m_musicChannel == NULL) return;
+	FMOD_Channel_SetPosition(m_musicChannel, fTime * 1000.0, FMOD_TIMEUNIT_MS);
+	_updateMusicTime();
 }
 
-float32 Engine::getMusicPos()
+void Engine::stepAudio(float32 dt)
 {
-	if(m_channels.count("music"))
+	if(m_bSoundDied || !m_bAudioNRT) return;
+	
+	//Each update mixes one DSP buffer. Carry the remainder over, so the music doesn't drift from the simulation
+	m_fAudioOwed += (double)dt * m_iAudioRate;
+	while(m_fAudioOwed >= m_iAudioBlock)
 	{
-		FMOD_CHANNEL* mus = getChannel("music");
-		unsigned int ms;
-		FMOD_Channel_GetPosition(mus, &ms, FMOD_TIMEUNIT_MS);
-		return (float32)ms / 1000.0f;
+		FMOD_System_Update(m_audioSystem);
+		m_fAudioOwed -= m_iAudioBlock;
 	}
-	return -1;
+	_updateMusicTime();
+}
+
+float32 Engine::getMusicLength()
+{
+	unsigned int ms;
+	if(m_bSoundDied || m_musicSound == NULL || FMOD_Sound_GetLength(m_musicSound, &ms, FMOD_TIMEUNIT_MS) != FMOD_OK)
+		return -1.0f;
+	return (float32)ms / 1000.0f;
+}
+
+void Engine::_updateMusicTime()
+{
+	unsigned int ms;
+	if(m_musicChannel != NULL && FMOD_Channel_GetPosition(m_musicChannel, &ms, FMOD_TIMEUNIT_MS) == FMOD_OK)
+		m_fMusicTime = (float32)ms / 1000.0f;
+	else
+		m_fMusicTime = -1.0f;
 }
 
 void Engine::playMusic(string sName, float32 volume, float32 pan, float32 pitch)
 {
 	if(m_bSoundDied) return;
-	if(m_sounds.count("music"))
+	errlog << "Load music " << sName << endl;
+	FMOD_SOUND* stream;
+	if(FMOD_System_CreateSound(m_audioSystem, sName.c_str(), MUSIC_OPEN_MODE, 0, &stream) != FMOD_OK)
+		stream = NULL;
+	playMusic(stream, volume, pan, pitch);
+}
+
+void Engine::playMusic(FMOD_SOUND* stream, float32 volume, float32 pan, float32 pitch)
+{
+	if(m_bSoundDied) return;
+	if(m_musicSound != NULL)
 	{
-		stopMusic();
-		m_sounds.erase("music");
-		m_channels.erase("music");
+		if(m_musicChannel != NULL)
+			FMOD_Channel_Stop(m_musicChannel);
+		FMOD_Sound_Release(m_musicSound);
+		m_musicSound = NULL;
+		m_musicChannel = NULL;
+		m_fMusicTime = -1.0f;
 	}
-	createSound(sName, "music");
-	playSound("music", volume, pan, pitch);
-	if(m_channels.count("music"))
+	if(stream == NULL) return;
+	m_musicSound = stream;
+	
+	//If it was opened in the background and isn't quite there yet, it's not worth skipping the song over
+	FMOD_OPENSTATE state;
+	while(FMOD_Sound_GetOpenState(m_musicSound, &state, NULL, NULL, NULL) == FMOD_OK && state != FMOD_OPENSTATE_READY && state != FMOD_OPENSTATE_ERROR)
+		SDL_Delay(1);
+	if(FMOD_System_PlaySound(m_audioSystem, FMOD_CHANNEL_FREE, m_musicSound, true, &m_musicChannel) != FMOD_OK)
 	{
-		FMOD_CHANNEL* mus = getChannel("music");
-		FMOD_Channel_SetLoopCount(mus, -1);
-		FMOD_Channel_SetMode(mus, FMOD_LOOP_NORMAL);
-		FMOD_Channel_SetPosition(mus, 0, FMOD_TIMEUNIT_MS);
+		m_musicChannel = NULL;
+		return;
 	}
+	FMOD_Channel_SetPriority(m_musicChannel, 0);	//Never let FMOD virtualize the music to make room for sound effects
+	FMOD_Channel_SetVolume(m_musicChannel, volume);
+	FMOD_Channel_SetPan(m_musicChannel, pan);
+	FMOD_Channel_SetFrequency(m_musicChannel, pitch * soundFreqDefault);
+	FMOD_Channel_SetLoopCount(m_musicChannel, -1);
+	FMOD_Channel_SetMode(m_musicChannel, FMOD_LOOP_NORMAL);
+	FMOD_Channel_SetPosition(m_musicChannel, 0, FMOD_TIMEUNIT_MS);
+	FMOD_Channel_SetPaused(m_musicChannel, false);
+	_updateMusicTime();
 }
 
 void Engine::musicLoop(float32 startSec, float32 endSec)
 {
 	if(m_bSoundDied) return;
-	if(m_channels.count("music"))
+	if(m_musicChannel != NULL)
 	{
-		FMOD_CHANNEL* mus = getChannel("music");
+		FMOD_CHANNEL* mus = m_musicChannel;
 		FMOD_Channel_SetLoopPoints(mus, startSec * 1000, FMOD_TIMEUNIT_MS, endSec * 1000, FMOD_TIMEUNIT_MS);
 		//Flush music stream
 		FMOD_Channel_SetMode(mus, FMOD_LOOP_NORMAL);
@@ -433,19 +1009,16 @@ void Engine::musicLoop(float32 startSec, float32 endSec)
 
 void Engine::volumeMusic(float32 fVol)
 {
-	if(m_channels.count("music"))
-	{
-		FMOD_CHANNEL* mus = getChannel("music");
-		FMOD_Channel_SetVolume(mus, fVol);
-	}
+	if(m_musicChannel != NULL)
+		FMOD_Channel_SetVolume(m_musicChannel, fVol);
 }
 
 float32 Engine::getMusicFrequency()
 {
-	if(m_channels.count("music"))
+	if(m_musicChannel != NULL)
 	{
 		float freq;
-		FMOD_Channel_GetFrequency(getChannel("music"), &freq);
+		FMOD_Channel_GetFrequency(m_musicChannel, &freq);
 		return freq;
 	}
 	return -1;
@@ -453,8 +1026,8 @@ float32 Engine::getMusicFrequency()
 
 void Engine::setMusicFrequency(float32 freq)
 {
-	if(m_channels.count("music"))
-		FMOD_Channel_SetFrequency(getChannel("music"), freq);
+	if(m_musicChannel != NULL)
+		FMOD_Channel_SetFrequency(m_musicChannel, freq);
 }
 
 bool Engine::keyDown(int32_t keyCode)
@@ -476,9 +1049,14 @@ void Engine::setFramerate(float32 fFramerate)
 	if(fFramerate < 30.0)
 	fFramerate = 30.0;	//30fps is bare minimum
 	if(m_fFramerate == 0.0)
-		m_fAccumulatedTime = (float32)SDL_GetTicks()/1000.0;	 //If we're stuck at 0fps for a while, this number could be huge, which would cause unlimited fps for a bit
+		m_iNextFrame = SDL_GetPerformanceCounter();	 //If we're stuck at 0fps for a while, this number could be huge, which would cause unlimited fps for a bit
 	m_fFramerate = fFramerate;
+	if(g_replay.playing())
+		m_fFramerate = g_replay.getFramerate();	//Has to step exactly like the recording did
+	else if(g_replay.active())
+		g_replay.setFramerate(m_fFramerate);
 	m_fTargetTime = 1.0 / m_fFramerate;
+	m_iTicksPerFrame = (Uint64)(SDL_GetPerformanceFrequency() / m_fFramerate);
 }
 
 void Engine::setup_sdl()
@@ -491,7 +1069,7 @@ void Engine::setup_sdl()
 	}
 	
 	if(SDL_InitSubSystem(SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER | SDL_INIT_HAPTIC) < 0)
-		errlog << "Unable to init SDL2 gamepad subsystem." << endl;
+		errlog(LOG_ERROR) << "Unable to init SDL2 gamepad subsystem." << endl;
 
 	errlog << "Loading OpenGL..." << std::endl;
 
@@ -519,6 +1097,8 @@ void Engine::setup_sdl()
 	Uint32 flags = SDL_WINDOW_OPENGL;
 	if(m_bResizable)
 		flags |= SDL_WINDOW_RESIZABLE;
+	if(g_replay.playing())
+		flags |= SDL_WINDOW_HIDDEN;	//Still need a GL context to draw to, but nobody's watching
 	
 	m_Window = SDL_CreateWindow(m_sTitle.c_str(),
 							 SDL_WINDOWPOS_UNDEFINED,
@@ -534,7 +1114,9 @@ void Engine::setup_sdl()
 	}
 	SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1); //Share objects between OpenGL contexts
 	SDL_GL_CreateContext(m_Window);
-	if(SDL_GL_SetSwapInterval(-1) == -1) //Apparently Vsync or something
+	if(g_replay.playing())
+		SDL_GL_SetSwapInterval(0);	//Run flat out
+	else if(SDL_GL_SetSwapInterval(-1) == -1) //Apparently Vsync or something
 		SDL_GL_SetSwapInterval(1);
 
 	SDL_DisplayMode mode;
@@ -569,8 +1151,7 @@ void Engine::setup_sdl()
 //Set up OpenGL
 void Engine::setup_opengl()
 {
-	// Make the viewport
-	glViewport(0, 0, m_iWidth, m_iHeight);
+	setup_viewport();
 
 	// set the clear color to black
 	glClearColor(0.0, 0.0, 0.0, 0.0);
@@ -586,12 +1167,6 @@ void Engine::setup_opengl()
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	// Set the camera projection matrix
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-
-	gluPerspective(45.0f, (GLfloat)m_iWidth/(GLfloat)m_iHeight, 0.1f, 500.0f);
-
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
 	glPushMatrix();
@@ -605,6 +1180,23 @@ void Engine::setup_opengl()
 	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 }
 
+//Set up everything that depends on window size
+void Engine::setup_viewport()
+{
+	// Make the viewport
+	glViewport(0, 0, m_iWidth, m_iHeight);
+	
+	// Set the camera projection matrix
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+
+	gluPerspective(45.0f, (GLfloat)m_iWidth/(GLfloat)m_iHeight, 0.1f, 500.0f);
+
+	glMatrixMode(GL_MODELVIEW);
+	
+	_setupRenderTarget();
+}
+
 void Engine::setMSAA(int iMSAA)
 {
 	m_iMSAA = iMSAA;
@@ -650,7 +1242,7 @@ void Engine::_loadicon()	//Load icon into SDL window
 	//if still unkown, return failure
 	if(fif == FIF_UNKNOWN)
 	{
-		errlog << "Unknown image type for file " << m_sIcon << endl;
+		errlog(LOG_WARN) << "Unknown image type for file " << m_sIcon << endl;
 		return;
 	}
 	
@@ -662,7 +1254,7 @@ void Engine::_loadicon()	//Load icon into SDL window
 	//if the image failed to load, return failure
 	if(!dib)
 	{
-		errlog << "Error loading image " << m_sIcon.c_str() << endl;
+		errlog(LOG_ERROR) << "Error loading image " << m_sIcon.c_str() << endl;
 		return;
 	}	
 	//retrieve the image data
@@ -696,38 +1288,6 @@ void Engine::_loadicon()	//Load icon into SDL window
 void Engine::changeScreenResolution(float32 w, float32 h)
 {
 	errlog << "Changing screen resolution to " << w << ", " << h << endl;
-	int vsync = SDL_GL_GetSwapInterval();
-//In Windoze, we copy the graphics memory to our new context, so we don't have to reload all of our images and stuff every time the resolution changes
-#ifdef _WIN32
-	SDL_SysWMinfo info;
- 
-	//Get window handle from SDL
-	SDL_VERSION(&info.version);
-	if(SDL_GetWindowWMInfo(m_Window, &info) == -1) 
-	{
-		errlog << "SDL_GetWMInfo #1 failed" << endl;
-		return;
-	}
-
-	//Get device context handle
-	HDC tempDC = GetDC(info.info.win.window);
-
-	//Create temporary context
-	HGLRC tempRC = wglCreateContext(tempDC);
-	if(tempRC == NULL) 
-	{
-		errlog << "wglCreateContext failed" << endl;
-		return;
-	}
-	
-	//Share resources to temporary context
-	SetLastError(0);
-	if(!wglShareLists(wglGetCurrentContext(), tempRC))
-	{
-		errlog << "wglShareLists #1 failed" << endl;
-		return;
-	}
-#endif
 	
 	m_iWidth = w;
 	m_iHeight = h;
@@ -735,43 +1295,14 @@ void Engine::changeScreenResolution(float32 w, float32 h)
 	if(m_bFullscreen)
 		SDL_SetWindowFullscreen(m_Window, SDL_WINDOW_FULLSCREEN_DESKTOP);
 	
-	SDL_SetWindowSize(m_Window, m_iWidth, m_iHeight);
-
-	SDL_GL_CreateContext(m_Window);
-	if(SDL_GL_SetSwapInterval(vsync) == -1) //old vsync won't work in this new mode; default to vsync on
-		SDL_GL_SetSwapInterval(1);
+	//If we got here from a resize event, the window is already this size
+	int iCurWidth, iCurHeight;
+	SDL_GetWindowSize(m_Window, &iCurWidth, &iCurHeight);
+	if(iCurWidth != m_iWidth || iCurHeight != m_iHeight)
+		SDL_SetWindowSize(m_Window, m_iWidth, m_iHeight);
 	
-	//Set OpenGL back up
-	setup_opengl();
-	
-#ifdef _WIN32
-	//Previously used structure may possibly be invalid, to be sure we get it again
-	SDL_VERSION(&info.version);
-	if(SDL_GetWindowWMInfo(m_Window, &info) == -1) 
-	{
-		errlog << "SDL_GetWMInfo #2 failed" << endl;
-		return;
-	}
- 
-	//Share resources to our new SDL-created context
-	if(!wglShareLists(tempRC, wglGetCurrentContext()))
-	{
-		errlog << "wglShareLists #2 failed" << endl;
-		return;
-	}
- 
-	//We no longer need our temporary context
-	if(!wglDeleteContext(tempRC))
-	{
-		errlog << "wglDeleteContext failed" << endl;
-		return;
-	}
-#else
-	//Reload images & models
-#ifdef IMG_RELOAD
-	reloadImages();
-#endif
-#endif
+	//Keep the same OpenGL context (and all the textures in it); only the viewport and projection depend on window size
+	setup_viewport();
 }
 
 void Engine::toggleFullscreen()
@@ -839,7 +1370,7 @@ void Engine::setCursorPos(int32_t x, int32_t y)
 
 bool Engine::getCursorDown(int iButtonCode)
 {
-	Uint8 ms = SDL_GetMouseState(NULL, NULL);
+	Uint32 ms = g_replay.playing() ? g_replay.getMouseButtons() : SDL_GetMouseState(NULL, NULL);
 	switch(iButtonCode)
 	{
 		case LMB:
@@ -941,20 +1472,45 @@ void Engine::updateSound()
 {
 	if(m_bSoundDied) return;
 	
-	//Update FMOD
-	FMOD_System_Update(m_audioSystem);
+	//Update FMOD. Non-realtime output only mixes when stepAudio() says to
+	if(!m_bAudioNRT)
+		FMOD_System_Update(m_audioSystem);
+	_updateMusicTime();	//Once a frame; everything else asking where the music is gets this
 	
-	//Get rid of sounds that aren't currently playing
-	for(multimap<string, FMOD_CHANNEL*>::iterator i = m_channels.begin(); i != m_channels.end();i++)
+	//Check up on sounds loading in the background
+	if(m_iSoundsLoading)
 	{
-		FMOD_BOOL bPlaying;
-		if(FMOD_Channel_IsPlaying(i->second, &bPlaying) != FMOD_OK) continue;
-		if(!bPlaying && i->first != "music")
+		for(uint32_t i = 0; i < m_soundBank.size(); i++)
 		{
-			m_channels.erase(i);
-			continue;
+			if(m_soundStates[i] != SOUND_LOADING) continue;
+			FMOD_OPENSTATE state;
+			FMOD_RESULT res = FMOD_Sound_GetOpenState(m_soundBank[i], &state, NULL, NULL, NULL);
+			if(res == FMOD_OK && state == FMOD_OPENSTATE_READY)
+				m_soundStates[i] = SOUND_READY;
+			else if(res != FMOD_OK || state == FMOD_OPENSTATE_ERROR)
+			{
+				m_soundStates[i] = SOUND_FAILED;
+				for(map<string, soundHandle>::iterator j = m_soundPaths.begin(); j != m_soundPaths.end(); j++)
+				{
+					if(j->second == (soundHandle)i)
+						errlog(LOG_ERROR) << "Unable to load sound " << j->first << endl;
+				}
+			}
+			else
+				continue;
+			if(!--m_iSoundsLoading)
+				errlog << "Loaded " << m_soundBank.size() << " sounds; last batch took " << SDL_GetTicks() - m_iSoundLoadStart << "ms" << endl;
 		}
 	}
+	
+	//Free up voices that have finished. FMOD reuses channels, so an invalid handle means ours is long gone
+	for(int i = 0; i < VOICE_COUNT; i++)
+	{
+		if(m_voices[i].channel == NULL) continue;
+		FMOD_BOOL bPlaying = false;
+		if(FMOD_Channel_IsPlaying(m_voices[i].channel, &bPlaying) != FMOD_OK || !bPlaying)
+			m_voices[i].channel = NULL;
+	}
 }
 
 void Engine::cleanupParticles()
@@ -972,6 +1528,7 @@ void Engine::drawParticles()
 
 void Engine::updateParticles(float32 dt)
 {
+	PROFILE_ZONE("Engine::updateParticles");
 	for(list<ParticleSystem*>::iterator i = m_particles.begin(); i != m_particles.end(); i++)
 	{
 		(*i)->update(dt);
@@ -13,8 +13,11 @@
 #include "hud.h"
 #include "particles.h"
 #include "cursor.h"
+#include "profiler.h"
+#include "replay.h"
 #include <fmod.h>
 #include <map>
+#include <vector>
 #include <set>
 
 #define LMB	1
@@ -23,6 +26,52 @@
 
 const float soundFreqDefault = 44100.0;
 
+#ifdef DEBUG_REVSOUND
+#define MUSIC_OPEN_MODE	FMOD_CREATESAMPLE
+#else
+#define MUSIC_OPEN_MODE	FMOD_CREATESTREAM	//Open music as a stream, sounds as samples (so the sounds can play multiple times at once)
+#endif
+
+#define VOICE_COUNT		24		//Sound effects that can play at once. Music has its own voice on top of these
+#define SOUND_NONE		-1
+
+#define AUDIO_NRT_BLOCK		256		//Samples FMOD mixes per update with non-realtime output
+
+typedef enum
+{
+	AUDIO_OUTPUT_DEFAULT,			//The sound card, in real time
+	AUDIO_OUTPUT_NRT,				//Nothing audible; the mixer only moves when the simulation steps it
+	AUDIO_OUTPUT_WAVWRITER_NRT		//Same, with the mix written out to a .wav file
+} audioOutput;
+
+#define LATENCY_TRIES		3		//Clicks measureLatency() plays; it goes with the median
+#define LATENCY_CLICK_MS	10		//Length of each click
+#define LATENCY_TIMEOUT		1000	//Milliseconds to wait for each click to come back before giving up on it
+#define LATENCY_RECORD_SEC	2		//Length of the (looping) recording buffer
+
+typedef int32_t soundHandle;	//From createSound()/getSound(); resolve once, play as often as you like
+
+typedef enum
+{
+	SOUND_LOADING,				//FMOD's still decoding it in the background
+	SOUND_READY,
+	SOUND_FAILED
+} soundState;
+
+typedef enum
+{
+	SOUND_PRIORITY_LOW,			//Stolen first when we run out of voices
+	SOUND_PRIORITY_NORMAL,
+	SOUND_PRIORITY_HIGH			//Voice clips and the like. Only ever stolen by other high-priority sounds
+} soundPriority;
+
+typedef struct
+{
+	FMOD_CHANNEL* channel;		//NULL if free
+	soundPriority priority;
+	uint32_t iStarted;			//Order voices were started in, so we steal the oldest
+} voice;
+
 typedef struct
 {
 	string sSwitch, sValue;
@@ -50,8 +99,12 @@ private:
 	Point m_ptCursorPos;
 	bool  m_bShowCursor;
 	float32 m_fFramerate;
-	float32 m_fAccumulatedTime;
 	float32 m_fTargetTime;
+	Uint64 m_iTicksPerFrame;	//Performance counter ticks between frames
+	Uint64 m_iNextFrame;		//Performance counter value when the next frame is due
+	Uint64 m_iLastFrame;		//Performance counter value when the last frame started
+	float32 m_fFrameTime;		//Smoothed actual time between frames, in seconds
+	float32 m_fFrameJitter;		//Smoothed deviation of actual frame time from m_fTargetTime, in seconds
 	list<obj*> m_lObjects;	//Object handler
 	multiset<physSegment*, depthComparator> m_lScenery;
 	bool m_bQuitting;   //Stop the game if this turns true
@@ -66,21 +119,52 @@ private:
 	bool m_bPauseOnKeyboardFocus;	//If the game pauses when keyboard focus is lost
 	bool m_bSoundDied;  //If tyrsound fails to load, don't try to use it
 	int m_iMSAA;		//Antialiasing (0x, 2x, 4x, 8x, etc)
+	GLuint m_iSceneFBO;			//Offscreen render target for drawing at reduced resolution (0 if unsupported)
+	GLuint m_iSceneTex;
+	GLuint m_iSceneDepth;
+	float32 m_fRenderScale;		//Fraction of window resolution we're currently drawing at
+	float32 m_fMinRenderScale;	//Lowest we'll drop m_fRenderScale to when we can't keep framerate; 1.0 turns this off
+	int m_iRenderScaleCooldown;	//Frames left until we can change m_fRenderScale again
 	myCursor* m_cursor;
 	bool m_bCursorShow;
 	bool m_bCursorOutOfWindow;	//If the cursor is outside of the window, don't draw it
 	list<ParticleSystem*> m_particles;
 	
-	multimap<string, FMOD_CHANNEL*> m_channels;
-	map<string, FMOD_SOUND*> m_sounds;
+	vector<FMOD_SOUND*> m_soundBank;		//Indexed by soundHandle
+	vector<soundState> m_soundStates;		//Ditto
+	uint32_t m_iSoundsLoading;				//How many of those are still SOUND_LOADING
+	Uint32 m_iSoundLoadStart;				//When the current batch of loading started
+	map<string, soundHandle> m_soundPaths;	//Only used to resolve files and names to handles
+	map<string, soundHandle> m_soundNames;
+	voice m_voices[VOICE_COUNT];
+	uint32_t m_iVoicesStarted;
+	FMOD_SOUND* m_musicSound;
+	FMOD_CHANNEL* m_musicChannel;
+	float32 m_fMusicTime;					//Music position as of the last updateSound() (or seek), so asking for it is free
+	float32 m_fOutputLatency;				//Seconds between FMOD mixing something and it coming out of the speakers
+	bool m_bAudioNRT;						//Non-realtime output; stepAudio() drives the mixer
+	double m_fAudioOwed;					//Samples the mixer is behind the simulation
+	unsigned int m_iAudioBlock;				//Samples per FMOD_System_Update() when m_bAudioNRT
+	int m_iAudioRate;
+	static audioOutput s_audioOutput;
+	static string s_sWavFile;
 	FMOD_SYSTEM* m_audioSystem;
 
 	//Engine-use function definitions
 	bool _frame();
+	bool _handleEvent(SDL_Event event);	//Returns true if we should quit
+	bool _replayFrame();		//_frame() for playing back a recording
+	void _updateMusicTime();
 	void _render();
+	void _waitForFrame();	//Sleep until the next frame is due
+	void _setupRenderTarget();	//(Re)create offscreen render target to match window size
+	void _destroyRenderTarget();
+	void _drawScene();			//Upscale offscreen render target to window, applying gamma
+	void _updateRenderScale();	//Adjust render resolution to how well we're keeping framerate
 	
 	void setup_sdl();
 	void setup_opengl();
+	void setup_viewport();
 	void _loadicon();					//Load icon and set window to have said icon
 
 	Engine(){}; //Default constructor isn't callable
@@ -102,7 +186,7 @@ protected:
 public:
 	//Constructor/destructor
 	Engine(uint16_t iWidth, uint16_t iHeight, string sTitle, string sAppName, string sIcon, bool bResizable = false);
-	~Engine();
+	virtual ~Engine();
 
 	//Misc. methods
 	void commandline(list<string> argv);	//Pass along commandline arguments for the engine to use
@@ -116,7 +200,7 @@ public:
 	Rect getScreenRect()	{Rect rc(0,0,getWidth(),getHeight()); return rc;};
 	
 	//Window functions
-	void changeScreenResolution(float32 w, float32 h);  //Change resolution mid-game and reload OpenGL textures as needed
+	void changeScreenResolution(float32 w, float32 h);  //Change resolution mid-game, keeping the current OpenGL context
 	void toggleFullscreen();							//Switch between fullscreen/windowed modes
 	void setFullscreen(bool bFullscreen);				//Set fullscreen to true or false as needed
 	void setInitialFullscreen() {SDL_SetWindowFullscreen(m_Window, SDL_WINDOW_FULLSCREEN_DESKTOP);};
@@ -131,21 +215,33 @@ public:
 	uint16_t getHeight() {return m_iHeight;};
 	
 	//Sound functions
-	void createSound(string sPath, string sName);   //Creates a sound from this name and file path
-	virtual void playSound(string sName, float32 volume = 1.0f, float32 pan = 0.0f, float32 pitch = 1.0f);	 //Play a sound
-	FMOD_CHANNEL* getChannel(string sSoundName);	//Return the channel of this sound
+	soundHandle createSound(string sPath, string sName);   //Starts loading a sound in the background and names it. If that file's already loaded or loading, just adds the name
+	soundHandle getSound(string sName);				//Handle for a sound created earlier, or SOUND_NONE
+	bool soundReady(soundHandle sound)				{return sound >= 0 && sound < (soundHandle)m_soundStates.size() && m_soundStates[sound] == SOUND_READY;};
+	uint32_t soundsLoading()						{return m_iSoundsLoading;};
+	void playSound(soundHandle sound, float32 volume = 1.0f, float32 pan = 0.0f, float32 pitch = 1.0f, soundPriority priority = SOUND_PRIORITY_NORMAL);	 //Play a sound
+	FMOD_CHANNEL* getMusicChannel()					{return m_musicChannel;};
 	void playMusic(string sName, float32 volume = 1.0f, float32 pan = 0.0f, float32 pitch = 1.0f);	 //Play looping music, or resume paused music
+	void playMusic(FMOD_SOUND* stream, float32 volume = 1.0f, float32 pan = 0.0f, float32 pitch = 1.0f);	//Same, with a stream opened already (MUSIC_OPEN_MODE). Takes ownership of it
 	void musicLoop(float32 startSec, float32 endSec);	//Set the starting and ending loop points for the currently-playing song
 	void pauseMusic();									//Pause music that's currently playing
 	void resumeMusic();									//Resume music that was paused
 	void restartMusic();
 	void stopMusic();
 	void seekMusic(float32 fTime);
-	float32 getMusicPos();								//Opposite of seekMusic() -- get where we currently are
+	float32 getMusicLength();							//In seconds, or -1 if no music
+	float32 getMusicPos()							{return m_fMusicTime;};	//Opposite of seekMusic() -- get where we currently are (as of the start of this frame), or -1 if no music
 	void volumeMusic(float32 fVol);						//Set the music to a particular volume
 	void setMusicFrequency(float32 freq);
 	float32 getMusicFrequency();
 	bool hasMic();										//If we have some form of mic-like input
+	bool isAudioNRT()								{return m_bAudioNRT;};
+	void stepAudio(float32 dt);							//Mix dt seconds more audio, when non-realtime. The main loop does this every simulation step
+	static void setAudioOutput(audioOutput output, string sWavFile = "");	//Before the engine's created
+	static void audioCommandline(int argc, char** argv);	//"-nrtaudio", or "-wavout file.wav". Same deal
+	float32 getOutputLatency()						{return m_fOutputLatency;};	//From the DSP buffer size FMOD's using
+	float32 measureLatency(int iDriver = 0);			//Play some clicks and time how long they take to come back through a recording driver. Blocks for a couple seconds. Returns output latency in seconds, or < 0 if we couldn't hear them
+	FMOD_SYSTEM* getAudioSystem()						{return m_bSoundDied ? NULL : m_audioSystem;};
 	void updateSound();
 	
 	//Keyboard functions
@@ -171,10 +267,12 @@ public:
 	//Time functions
 	float32 getTimeScale()	{return m_fTimeScale;};
 	void setTimeScale(float32 fScale)	{m_fTimeScale = fScale;};
-	Uint32 getTicks()	{return SDL_GetTicks();};
-	float32 getSeconds()	{return (float32)SDL_GetTicks()/1000.0;};
+	Uint32 getTicks()	{return g_replay.active() ? g_replay.getTicks() : SDL_GetTicks();};	//Fixed clock when recording or playing back
+	float32 getSeconds()	{return (float32)getTicks()/1000.0;};
 	void setFramerate(float32 fFramerate);
 	float32 getFramerate()   {return m_fFramerate;};
+	float32 getFrameTime()	{return m_fFrameTime;};		//Actual time between frames we're achieving
+	float32 getFrameJitter()	{return m_fFrameJitter;};	//How far off from the target frame time we typically are
 	
 	//Object functions
 	void addObject(obj* o);
@@ -194,6 +292,9 @@ public:
 	void setImgBlur(bool b)		{g_imageBlur = b;};
 	void setGamma(float32 fGamma)	{m_fGamma = fGamma;};
 	float32 getGamma()				{return m_fGamma;};
+	void setMinRenderScale(float32 fScale);
+	float32 getMinRenderScale()		{return m_fMinRenderScale;};
+	float32 getRenderScale()		{return m_fRenderScale;};
 	
 	//Particle functions
 	void addParticles(ParticleSystem* sys)	{if(sys)m_particles.push_back(sys);};
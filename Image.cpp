@@ -4,7 +4,6 @@
 */
 
 #include "Image.h"
-#include <set>
 
 bool g_imageBlur = true;
 
@@ -12,7 +11,6 @@ Image::Image(string sFilename)
 {
 	m_sFilename = sFilename;
 	_load(sFilename);
-	_addImgReload(this);
 }
 
 #ifdef __BIG_ENDIAN__
@@ -46,7 +44,7 @@ void Image::_load(string sFilename)
 	//if still unkown, return failure
 	if(fif == FIF_UNKNOWN)
 	{
-		errlog << "Unknown image type for file " << sFilename << endl;
+		errlog(LOG_WARN) << "Unknown image type for file " << sFilename << endl;
 		return;
 	}
   
@@ -58,7 +56,7 @@ void Image::_load(string sFilename)
 	//if the image failed to load, return failure
 	if(!dib)
 	{
-		errlog << "Error loading image " << sFilename.c_str() << endl;
+		errlog(LOG_ERROR) << "Error loading image " << sFilename.c_str() << endl;
 		return;
 	}  
 	//retrieve the image data
@@ -138,7 +136,6 @@ Image::~Image()
 	errlog << "Free " << m_sFilename << endl;
 	if(m_hTex)
 		glDeleteTextures(1, &m_hTex);	//Free OpenGL graphics memory
-	_removeImgReload(this);
 }
 
 /* TODO: Intelligent drawing
@@ -205,19 +202,25 @@ void Image::render(Point size, Point shear)
   
 }
 
-void Image::render(Point size, Rect rcImg)
+Rect Image::texCoords(Rect rcImg)
 {
 #ifdef __BIG_ENDIAN__
 	rcImg.left = rcImg.left / (float)m_iRealWidth;
 	rcImg.right = rcImg.right / (float)m_iRealWidth;
-	rcImg.top = rcImg.top / (float)m_iRealHeight;
-	rcImg.bottom = rcImg.bottom / (float)m_iRealHeight;
+	rcImg.top = 1.0 - rcImg.top / (float)m_iRealHeight;
+	rcImg.bottom = 1.0 - rcImg.bottom / (float)m_iRealHeight;
 #else
 	rcImg.left = rcImg.left / (float)m_iWidth;
 	rcImg.right = rcImg.right / (float)m_iWidth;
 	rcImg.top = 1.0 - rcImg.top / (float)m_iHeight;
 	rcImg.bottom = 1.0 - rcImg.bottom / (float)m_iHeight;
 #endif
+	return rcImg;
+}
+
+void Image::render(Point size, Rect rcImg)
+{
+	rcImg = texCoords(rcImg);
 	
 	// tell opengl to use the generated texture
 	glBindTexture(GL_TEXTURE_2D, m_hTex);
@@ -231,17 +234,10 @@ void Image::render(Point size, Rect rcImg)
     };
     const GLfloat texCoords[] =
     {
-#ifdef __BIG_ENDIAN__
-      rcImg.left, 1.0-rcImg.top, // upper left
-      rcImg.right, 1.0-rcImg.top, // upper right
-      rcImg.left, 1.0-rcImg.bottom, // lower left
-      rcImg.right, 1.0-rcImg.bottom, // lower right
-#else
         rcImg.left, rcImg.top, // upper left
         rcImg.right, rcImg.top, // upper right
         rcImg.left, rcImg.bottom, // lower left
         rcImg.right, rcImg.bottom, // lower right
-#endif
     };
     glVertexPointer(2, GL_FLOAT, 0, &vertexData);
     glTexCoordPointer(2, GL_FLOAT, 0, &texCoords);
@@ -297,29 +293,6 @@ void Image::render4V(Point ul, Point ur, Point bl, Point br)
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 }
 
-void Image::_reload()
-{
-	_load(m_sFilename);
-}
-
-static set<Image*> sg_images;
-
-void reloadImages()
-{
-	for(set<Image*>::iterator i = sg_images.begin(); i != sg_images.end(); i++)
-		(*i)->_reload();
-}
-
-void _addImgReload(Image* img)
-{
-	sg_images.insert(img);
-}
-
-void _removeImgReload(Image* img)
-{
-	sg_images.erase(img);
-}
-
 static map<string, Image*> g_mImages;  //Image handler
 Image* getImage(string sFilename)
 {
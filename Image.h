@@ -28,7 +28,6 @@ public:
 	~Image();
     
 	//Engine use functions
-	void _reload();  //Reload memory associated with this image
 	void _setFilename(string s) {m_sFilename = s;};	//Potentially dangerous; use with caution
 
 	//Accessor methods
@@ -36,6 +35,10 @@ public:
 	uint32_t getHeight()    {return m_iHeight;};
 	string getFilename()    {return m_sFilename;};
 	
+	//Texture coordinate helpers, for drawing many pieces of this image in one batch
+	void bind()	{glBindTexture(GL_TEXTURE_2D, m_hTex);};
+	Rect texCoords(Rect rcImg);	//Convert a texel rect into the texture coordinates to use for its corners
+	
 	//Drawing methods for texel-based coordinates
 	void render(Point size);				//Render at 0,0 with specified texel size
 	void render(Point size, Rect rcImg);
@@ -43,11 +46,6 @@ public:
 	void render4V(Point ul, Point ur, Point bl, Point br);
 };
 
-//Image reloading handler functions
-void reloadImages();
-void _addImgReload(Image* img);
-void _removeImgReload(Image* img);
-
 //Other image functions
 Image* getImage(string sFilename);  //Retrieves an image from the filename, creating it if necessary
 void clearImages();
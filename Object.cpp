@@ -94,7 +94,7 @@ void obj::setFrame(string sName)
 		frame = sName;
 	}
 	else
-		errlog << "Unknown object frame: " << sName << ". Ignoring..." << endl;
+		errlog(LOG_WARN) << "Unknown object frame: " << sName << ". Ignoring..." << endl;
 }
 
 void obj::hideFrames()
@@ -400,11 +400,16 @@ void anim::update(float32 dt)
 bool anim::fromXML(string sXMLFilename)
 {
 	//Load in the XML document
-    XMLDocument* doc = new XMLDocument();
-    int iErr = doc->LoadFile(sXMLFilename.c_str());
+	XMLDocument* doc;
+	int iErr;
+	{
+		MEM_TAG(MEM_XML);
+		doc = new XMLDocument();
+		iErr = doc->LoadFile(sXMLFilename.c_str());
+	}
 	if(iErr != XML_NO_ERROR)
 	{
-		errlog << "Error parsing XML file " << sXMLFilename << ": Error " << iErr << endl;
+		errlog(LOG_ERROR) << "Error parsing XML file " << sXMLFilename << ": Error " << iErr << endl;
 		delete doc;
 		return false;
 	}
@@ -413,7 +418,7 @@ bool anim::fromXML(string sXMLFilename)
     XMLElement* root = doc->FirstChildElement("anim");
     if(root == NULL)
 	{
-		errlog << "Error: No toplevel \"anim\" item in XML file " << sXMLFilename << endl;
+		errlog(LOG_ERROR) << "No toplevel \"anim\" item in XML file " << sXMLFilename << endl;
 		delete doc;
 		return false;
 	}
@@ -75,10 +75,11 @@ Engine(iWidth, iHeight, sTitle, sAppName, sIcon, bResizable)
 	m_mCursors["dir"]->fromXML("res/cursor/arrowdir.xml");
 	m_iMouseControl = 0;
 	
-	m_hud = new HUD("hud");
-	m_hud->create("res/hud.xml");
-	m_hud->setScene("intro");
-	m_hud->setSignalHandler(signalHandler);
+	loadHUD("intro");
+#ifdef USE_MEMTRACK
+	m_txtMemOverlay = new Text("res/font/CelestiaMediumRedux.xml");
+	m_bMemOverlay = false;
+#endif
 	
 	setTimeScale(DEFAULT_TIMESCALE);
 	
@@ -170,9 +171,14 @@ Engine(iWidth, iHeight, sTitle, sAppName, sIcon, bResizable)
 	m_fMusicScrubSpeed = soundFreqDefault;
 	m_fSoundVolume = 1.0f;
 	m_fVoxVolume = 1.0f;
+	m_fVisualOffset = -1.0f;
+	m_fSongBPM = 0.0f;
+	m_fSongFirstBeat = 0.0f;
+	m_fMeasuredLatency = -1.0f;
 	m_bHasBoredVox = false;
 	m_fLastMovedSec = 0.0f;
 	m_fSongFxRotate = 0.0f;
+	m_boardRand.seed(g_replay.active() ? g_replay.getSeed() : SDL_GetTicks());	//Before the first resetBoard()
 	m_selectedSongArc = new arc(64, getImage("res/particles/rainbowblur.png"));
 	m_selectedSongArc->add = 0.4;
 	m_selectedSongArc->max = 0.4;
@@ -206,6 +212,9 @@ Pony48Engine::~Pony48Engine()
 	errlog << "~Pony48Engine()" << endl;
 	saveConfig(getSaveLocation() + "config.xml");
 	delete m_rdFly;
+#ifdef USE_MEMTRACK
+	delete m_txtMemOverlay;
+#endif
 	clearBoard();	
 	clearColors();
 	cleanupSongGfx();
@@ -237,6 +246,7 @@ const float32 MUSIC_SCRUBIN_SPEED = soundFreqDefault * 2.0f;
 
 void Pony48Engine::frame(float32 dt)
 {
+	PROFILE_ZONE("Pony48Engine::frame");
 #ifdef DEBUG
 	if(m_joy != NULL && SDL_JoystickGetButton(m_joy, 4))	//Slooow waaay dooown so we can see if everything's working properly
 		dt /= 64.0;
@@ -248,7 +258,7 @@ void Pony48Engine::frame(float32 dt)
 			if(getSeconds() - m_fLastMovedSec > BORED_VOX_TIME && !m_bHasBoredVox)
 			{
 				m_bHasBoredVox = true;
-				playSound("nowhacking_theyreponies", m_fVoxVolume);
+				playSound(m_sndNowHacking, m_fVoxVolume, 0.0f, 1.0f, SOUND_PRIORITY_HIGH);
 				achievementGet("augh");
 			}
 		case GAMEOVER:
@@ -262,7 +272,7 @@ void Pony48Engine::frame(float32 dt)
 				i->second->update(dt);
 			
 			//Bounce camera forward on every bass kick
-			beatDetect();
+			beatDetect(dt);
 			
 			//Handle key presses
 			handleKeys();
@@ -277,7 +287,7 @@ void Pony48Engine::frame(float32 dt)
 				if(!m_bSavedFacepic && getSeconds() > m_fGameoverWebcamFreeze + 0.5)
 				{
 					m_bSavedFacepic = true;
-					playSound("camera", m_fSoundVolume);
+					playSound(m_sndCamera, m_fSoundVolume);
 				}
 			}
 			break;
@@ -293,9 +303,8 @@ void Pony48Engine::frame(float32 dt)
 			}
 			if(alpha < 0) alpha = 0;
 			if(alpha > 1) alpha = 1;
-			HUDItem* hIt = m_hud->getChild("coverintro");
-			if(hIt != NULL)
-				hIt->col.a = 1.0-alpha;
+			if(m_hudCoverIntro)
+				m_hudCoverIntro->col.a = 1.0-alpha;
 			
 			//Done waiting for the player; start the game in case they're derp and haven't hit a key already
 			if(getSeconds() > INTRO_FADEIN_DELAY + INTRO_FADEIN_TIME + INTRO_SIT_THERE_TIME && m_fStartFade < 0.0f)
@@ -322,9 +331,16 @@ void Pony48Engine::frame(float32 dt)
 				(*i)->update(dt);
 			for(list<ParticleSystem*>::iterator i = m_selectedSongParticlesBg.begin(); i != m_selectedSongParticlesBg.end(); i++)
 				(*i)->update(dt);
+			{
+				//Start loading whatever's highlighted, so it's ready by the time they pick it
+				HUDMenu* hMen = m_hudSongMenu;
+				if(hMen != NULL && hMen->m_selected != hMen->m_menu.end() && hMen->m_selected->signal.find("load ") == 0)
+					m_songPrefetch.request(hMen->m_selected->signal.substr(5));
+				m_songPrefetch.update();
+			}
 		case CREDITS:
 		case ACHIEVEMENTS:
-			beatDetect();	//Bounce some menu stuff to the beat
+			beatDetect(dt);	//Bounce some menu stuff to the beat
 			//Check and see if we should change bg colors
 			if(m_bg != NULL && m_bg->type == GRADIENT)
 			{
@@ -363,6 +379,7 @@ void Pony48Engine::frame(float32 dt)
 
 void Pony48Engine::draw()
 {
+	PROFILE_ZONE("Pony48Engine::draw");
 	//Clear bg (not done with OpenGL funcs, cause of weird black frame glitch when loading stuff)
 	fillScreen(m_BgCol);
 	glClear(GL_DEPTH_BUFFER_BIT);
@@ -419,28 +436,19 @@ void Pony48Engine::draw()
 			drawBoard();
 			drawObjects();
 			
-			//Update HUD score
-			HUDTextbox* txt = (HUDTextbox*)m_hud->getChild("scorebox");
-			ostringstream oss;
-			oss << "SCORE: " << m_iScore;
-			txt->setText(oss.str());
-			oss.str("");
-			txt = (HUDTextbox*)m_hud->getChild("hiscorebox");
-			oss << "BEST: " << m_iHighScore;
-			txt->setText(oss.str());
-			txt = (HUDTextbox*)m_hud->getChild("restart");
+			//Update HUD score (textboxes ignore this if the score hasn't changed)
+			m_hudScore->setText(m_iScore);
+			m_hudHiScore->setText(m_iHighScore);
 			if(m_bJoyControl)
-				txt->setText("Press Start to quit, any other button to play again");
+				m_hudRestart->setText("Press Start to quit, any other button to play again");
 			else
-				txt->setText("Press Esc to quit, any other key to play again");
+				m_hudRestart->setText("Press Esc to quit, any other key to play again");
 			
 			float32 fSec = getSeconds();
-			txt = (HUDTextbox*)m_hud->getChild("title");
 			if(fSec > m_fFadeoutTitleTime)
 			{
-				txt->col.a = max((TITLE_FADE_TIME - (fSec - m_fFadeoutTitleTime)), 0.0f);
-				txt = (HUDTextbox*)m_hud->getChild("artist");
-				txt->col.a = max((TITLE_FADE_TIME - (fSec - m_fFadeoutTitleTime)), 0.0f);
+				m_hudTitle->col.a = max((TITLE_FADE_TIME - (fSec - m_fFadeoutTitleTime)), 0.0f);
+				m_hudArtist->col.a = max((TITLE_FADE_TIME - (fSec - m_fFadeoutTitleTime)), 0.0f);
 			}
 			//oss << 1.0 / (fSec - m_fLastFrame);
 			//txt->setText(oss.str());
@@ -451,14 +459,12 @@ void Pony48Engine::draw()
 		
 		case CREDITS:
 		{
-			HUDItem* hIt = m_hud->getChild("escquitfinal");
-			if(hIt != NULL)
+			if(m_hudEscQuitFinal)
 			{
-				HUDTextbox* txt = (HUDTextbox*)hIt;
 				if(m_bJoyControl)
-					txt->setText("Press Start again to quit, B to cancel");
+					m_hudEscQuitFinal->setText("Press Start again to quit, B to cancel");
 				else
-					txt->setText("Press Esc again to quit, Enter to cancel");
+					m_hudEscQuitFinal->setText("Press Esc again to quit, Enter to cancel");
 			}
 			
 			if(m_bg != NULL)
@@ -532,23 +538,20 @@ void Pony48Engine::draw()
 			glClear(GL_DEPTH_BUFFER_BIT);
 			for(list<ParticleSystem*>::iterator i = m_selectedSongParticlesBg.begin(); i != m_selectedSongParticlesBg.end(); i++)
 				(*i)->draw();
-			HUDItem* hIt = m_hud->getChild("songmenu");
-			if(hIt != NULL)
+			HUDMenu* hMen = m_hudSongMenu;
+			if(hMen != NULL)
 			{
-				HUDMenu* hMen = (HUDMenu*)hIt;
 				glTranslatef(0, hMen->selectedY, 0);
 				m_selectedSongArc->p1.Set(-hMen->selectedX-3, m_selectedSongArc->height / 2.0f);
 				m_selectedSongArc->p2.Set(hMen->selectedX+3, m_selectedSongArc->height / 2.0f);
 				m_rdFly->pos.x = hMen->selectedX+4.4;
 			}
-			hIt = m_hud->getChild("escquit");
-			if(hIt != NULL)
+			if(m_hudEscQuit)
 			{
-				HUDTextbox* txt = (HUDTextbox*)hIt;
 				if(m_bJoyControl)
-					txt->setText("Press Start to quit, Back to view achievements");
+					m_hudEscQuit->setText("Press Start to quit, Back to view achievements");
 				else
-					txt->setText("Press Esc to quit, A to view achievements");
+					m_hudEscQuit->setText("Press Esc to quit, A to view achievements");
 			}
 			m_selectedSongArc->draw();
 			for(vector<ParticleSystem*>::iterator i = m_selectedSongParticles.begin(); i != m_selectedSongParticles.end(); i++)
@@ -638,19 +641,67 @@ void Pony48Engine::draw()
 	}
 	
 	drawAchievementPopup();
+#ifdef USE_MEMTRACK
+	if(m_bMemOverlay)
+		drawMemOverlay();
+#endif
 }
 
+#ifdef USE_MEMTRACK
+#define MEM_OVERLAY_PT		0.35f
+#define MEM_OVERLAY_LEFT	-10.0f
+#define MEM_OVERLAY_TOP		4.5f
+
+void Pony48Engine::drawMemOverlay()
+{
+	char cLine[128];
+	float32 y = MEM_OVERLAY_TOP;
+	m_txtMemOverlay->col = Color(1,1,0.5,1);
+	for(int i = 0; i <= MEM_NUM_TAGS; i++)
+	{
+		//One line per tag, then the total
+		memStats s = (i < MEM_NUM_TAGS) ? memGetStats((memTag)i) : memGetTotal();
+		snprintf(cLine, sizeof(cLine), "%-10s %8.1f KB %6d live  %5d allocs/frame %7d B/frame",
+			(i < MEM_NUM_TAGS) ? memTagName((memTag)i) : "total", s.liveBytes / 1024.0, s.liveAllocs, s.frameAllocs, s.frameBytes);
+		m_txtMemOverlay->layout(cLine, MEM_OVERLAY_PT, &m_memOverlayLayout);
+		m_txtMemOverlay->render(m_memOverlayLayout, MEM_OVERLAY_LEFT + m_memOverlayLayout.width / 2.0f, y);	//Text is centered; we want it left-aligned
+		y -= MEM_OVERLAY_PT * 1.2f;
+	}
+}
+#endif
+
 void Pony48Engine::init(list<commandlineArg> sArgs)
 {
 	//Run through list for arguments we recognize
+	bool bAnalyze = false;
+	int iLatencyDriver = -1;
 	for(list<commandlineArg>::iterator i = sArgs.begin(); i != sArgs.end(); i++)
+	{
 		errlog << "Commandline argument. Switch: " << i->sSwitch << ", value: " << i->sValue << endl;
+		if(i->sSwitch == "analyze")
+			bAnalyze = true;
+		else if(i->sSwitch == "measurelatency")
+			iLatencyDriver = atoi(i->sValue.c_str());	//Recording driver to listen with; first one if not given
+	}
 	
 	loadAchievements();
+	m_spectrum.init(getAudioSystem());
+	m_songPrefetch.init(getAudioSystem());
 	
 	//Load our last screen position and such
 	if(!loadConfig(getSaveLocation() + "config.xml"))
 		m_cam->open(m_iCAM);	//Open webcam if config loading fails
+	m_hud->rebuildRoutes();	//Key bindings may have changed
+	
+	//-measurelatency: time a few clicks through the mic, and keep that around for lining visuals up with
+	if(iLatencyDriver >= 0)
+	{
+		float32 fLatency = measureLatency(iLatencyDriver);
+		if(fLatency >= 0.0f)
+			m_fMeasuredLatency = fLatency;
+		else
+			errlog(LOG_WARN) << "Unable to measure audio latency; is something on recording driver " << iLatencyDriver << " in earshot of the speakers?" << endl;
+	}
 	
 	//Set gravity to 0
 	getWorld()->SetGravity(b2Vec2(0,0));
@@ -665,49 +716,49 @@ void Pony48Engine::init(list<commandlineArg> sArgs)
 	
 	m_imgMouseMoveArrow = getImage("res/movearrow.png");
 	
-	//Create sounds up front
-	createSound("res/sfx/jointile.ogg", "jointile");
-	createSound("res/sfx/select.ogg", "select");
-	createSound("res/sfx/camera_shutter.ogg", "camera");
-	createSound("res/sfx/applause.ogg", "applause");
-	createSound("res/vox/nowhacking_theyreponies.ogg", "nowhacking_theyreponies");
-	createSound("res/vox/bulk_yeah.ogg", "bulk_yeah");
+	//Menu bits that bounce to the beat. Particle systems hook up below, as they're created
+	m_menuBeats.addBand(0, 0, 0.95, 0, 0.05f, beatMenuText, this, "menutext");
+	m_menuBeats.addBand(0, 0, 0, 0, 0.5f, beatArc, this, "arc");
+	
+	//Create sounds up front. They load in the background while the intro plays
+	preloadSoundBank();
+	m_sndJoinTile = createSound("res/sfx/jointile.ogg", "jointile");
+	m_sndSelect = createSound("res/sfx/select.ogg", "select");
+	m_sndCamera = createSound("res/sfx/camera_shutter.ogg", "camera");
+	m_sndApplause = createSound("res/sfx/applause.ogg", "applause");
+	m_sndNowHacking = createSound("res/vox/nowhacking_theyreponies.ogg", "nowhacking_theyreponies");
+	m_sndBulkYeah = createSound("res/vox/bulk_yeah.ogg", "bulk_yeah");
 	
 	ParticleSystem* pSys = new ParticleSystem();
 	pSys->fromXML("res/particles/selectsong0.xml");
 	pSys->init();
 	pSys->firing = true;
 	m_selectedSongParticles.push_back(pSys);
-	m_selectedSongParticlesRateMul.push_back(1500);
-	m_selectedSongParticlesThresh.push_back(0.25);
+	m_menuBeats.addBand(0, 0, 0.25, 0, 1500, beatParticles, pSys, "selectsong0");
 	pSys = new ParticleSystem();
 	pSys->fromXML("res/particles/selectsong1.xml");
 	pSys->init();
 	pSys->firing = true;
 	m_selectedSongParticles.push_back(pSys);
-	m_selectedSongParticlesRateMul.push_back(3000);
-	m_selectedSongParticlesThresh.push_back(0.1);
+	m_menuBeats.addBand(1, 1, 0.1, 0, 3000, beatParticles, pSys, "selectsong1");
 	pSys = new ParticleSystem();
 	pSys->fromXML("res/particles/selectsong2.xml");
 	pSys->init();
 	pSys->firing = true;
 	m_selectedSongParticles.push_back(pSys);
-	m_selectedSongParticlesRateMul.push_back(6000);
-	m_selectedSongParticlesThresh.push_back(0.1);
+	m_menuBeats.addBand(2, 2, 0.1, 0, 6000, beatParticles, pSys, "selectsong2");
 	pSys = new ParticleSystem();
 	pSys->fromXML("res/particles/selectsong3.xml");
 	pSys->init();
 	pSys->firing = true;
 	m_selectedSongParticles.push_back(pSys);
-	m_selectedSongParticlesRateMul.push_back(8000);
-	m_selectedSongParticlesThresh.push_back(0.1);
+	m_menuBeats.addBand(3, 3, 0.1, 0, 8000, beatParticles, pSys, "selectsong3");
 	pSys = new ParticleSystem();
 	pSys->fromXML("res/particles/selectsong4.xml");
 	pSys->init();
 	pSys->firing = true;
 	m_selectedSongParticles.push_back(pSys);
-	m_selectedSongParticlesRateMul.push_back(9001);	//IT'S OVER NINE THOU- *shot*
-	m_selectedSongParticlesThresh.push_back(0.1);
+	m_menuBeats.addBand(4, 4, 0.1, 0, 9001, beatParticles, pSys, "selectsong4");	//IT'S OVER NINE THOU- *shot*
 	
 	//Add bg spinning 2048 tile particle system
 	pSys = new ParticleSystem();
@@ -766,9 +817,46 @@ void Pony48Engine::init(list<commandlineArg> sArgs)
 #ifdef DEBUG
 	changeMode(SONGSELECT);
 #endif
+	
+	//-analyze: just rebuild beat maps for all the songs and bail
+	if(bAnalyze)
+	{
+		analyzeSongs();
+		quit();
+	}
 }
 
 
+void Pony48Engine::loadHUD(string sScene)
+{
+	m_hud = new HUD("hud");
+	m_hud->create("res/hud.xml");
+	m_hud->setScene(sScene);
+	m_hud->setSignalHandler(signalHandler);
+	
+	m_hudCoverIntro.resolve(m_hud, "coverintro");
+	m_hudScore.resolve(m_hud, "scorebox");
+	m_hudHiScore.resolve(m_hud, "hiscorebox");
+	m_hudFinalScore.resolve(m_hud, "finalscore");
+	m_hudRestart.resolve(m_hud, "restart");
+	m_hudTitle.resolve(m_hud, "title");
+	m_hudArtist.resolve(m_hud, "artist");
+	m_hudEscQuit.resolve(m_hud, "escquit");
+	m_hudEscQuitFinal.resolve(m_hud, "escquitfinal");
+	m_hudChooseSong.resolve(m_hud, "choosesong");
+	m_hudThanx.resolve(m_hud, "thanx");
+	m_hudAchTitle.resolve(m_hud, "achtitle");
+	m_hudSongMenu.resolve(m_hud, "songmenu");
+	
+	//Score counters keep their labels, so only the number gets formatted when it changes
+	if(m_hudScore)
+		m_hudScore->setPrefix("SCORE: ");
+	if(m_hudHiScore)
+		m_hudHiScore->setPrefix("BEST: ");
+	if(m_hudFinalScore)
+		m_hudFinalScore->setPrefix("FINAL SCORE: ");
+}
+
 void Pony48Engine::hudSignalHandler(string sSignal)
 {
 	if(m_iCurMode == SONGSELECT)
@@ -780,13 +868,17 @@ void Pony48Engine::hudSignalHandler(string sSignal)
 		}
 		else if(sSignal == "select")
 		{
-			playSound("select", m_fSoundVolume);
+			playSound(m_sndSelect, m_fSoundVolume);
 		}
 	}
 }
 
 void Pony48Engine::handleEvent(SDL_Event event)
 {
+#ifdef USE_MEMTRACK
+	if(event.type == SDL_KEYDOWN && event.key.keysym.scancode == MEM_OVERLAY_KEY)
+		m_bMemOverlay = !m_bMemOverlay;
+#endif
 	if(m_hud->event(event))
 	{
 		if(event.type == SDL_KEYDOWN)
@@ -864,10 +956,7 @@ void Pony48Engine::handleEvent(SDL_Event event)
 					string sScene = m_hud->getScene();
 					clearColors();
 					delete m_hud;
-					m_hud = new HUD("hud");
-					m_hud->create("res/hud.xml");
-					m_hud->setScene(sScene);
-					m_hud->setSignalHandler(signalHandler);
+					loadHUD(sScene);
 					//Reload particles
 					for(map<string, ParticleSystem*>::iterator i = songParticles.begin(); i != songParticles.end(); i++)
 					{
@@ -903,10 +992,7 @@ void Pony48Engine::handleEvent(SDL_Event event)
 						string sScene = m_hud->getScene();
 						clearColors();
 						delete m_hud;
-						m_hud = new HUD("hud");
-						m_hud->create("res/hud.xml");
-						m_hud->setScene(sScene);
-						m_hud->setSignalHandler(signalHandler);
+						loadHUD(sScene);
 						//Reload particles
 						for(map<string, ParticleSystem*>::iterator i = songParticles.begin(); i != songParticles.end(); i++)
 						{
@@ -959,10 +1045,7 @@ void Pony48Engine::handleEvent(SDL_Event event)
 					string sScene = m_hud->getScene();
 					clearColors();
 					delete m_hud;
-					m_hud = new HUD("hud");
-					m_hud->create("res/hud.xml");
-					m_hud->setScene(sScene);
-					m_hud->setSignalHandler(signalHandler);
+					loadHUD(sScene);
 				}
 				else
 #endif
@@ -979,10 +1062,7 @@ void Pony48Engine::handleEvent(SDL_Event event)
 					string sScene = m_hud->getScene();
 					clearColors();
 					delete m_hud;
-					m_hud = new HUD("hud");
-					m_hud->create("res/hud.xml");
-					m_hud->setScene(sScene);
-					m_hud->setSignalHandler(signalHandler);
+					loadHUD(sScene);
 				}
 				else
 #endif
@@ -999,10 +1079,7 @@ void Pony48Engine::handleEvent(SDL_Event event)
 					string sScene = m_hud->getScene();
 					clearColors();
 					delete m_hud;
-					m_hud = new HUD("hud");
-					m_hud->create("res/hud.xml");
-					m_hud->setScene(sScene);
-					m_hud->setSignalHandler(signalHandler);
+					loadHUD(sScene);
 				}
 				else
 #endif
@@ -1119,7 +1196,7 @@ void Pony48Engine::handleEvent(SDL_Event event)
 				{
 					if(SDL_HapticRumbleInit(m_rumble) != 0)
 					{
-						errlog << "Error initializing joystick " << (int)event.jdevice.which << " as rumble." << endl;
+						errlog(LOG_ERROR) << "Error initializing joystick " << (int)event.jdevice.which << " as rumble." << endl;
 						SDL_HapticClose(m_rumble);
 						m_rumble = NULL;
 					}
@@ -1250,7 +1327,7 @@ void Pony48Engine::handleEvent(SDL_Event event)
 						m_fStartFade = getSeconds();
 				}
 #ifdef DEBUG	//DEBUG: right trigger fast-forwards music
-				FMOD_CHANNEL* channel = getChannel("music");
+				FMOD_CHANNEL* channel = getMusicChannel();
 				float curval = event.jaxis.value;
 				curval -= JOY_AXIS_MIN;	//Get absolute value of axis, from 0 to 65,535
 				curval /= (float)(JOY_AXIS_MAX-JOY_AXIS_MIN);
@@ -1268,7 +1345,7 @@ void Pony48Engine::handleEvent(SDL_Event event)
 						m_fStartFade = getSeconds();
 				}
 #ifdef DEBUG_REVSOUND	//DEBUG: left trigger rewinds music
-				FMOD_CHANNEL* channel = getChannel("music");
+				FMOD_CHANNEL* channel = getMusicChannel();
 				float curval = event.jaxis.value;
 				curval -= JOY_AXIS_MIN;	//Get absolute value of axis, from 0 to 65,535
 				curval /= (float)(JOY_AXIS_MAX-JOY_AXIS_MIN);
@@ -1375,11 +1452,16 @@ bool Pony48Engine::loadConfig(string sFilename)
 {
 	errlog << "Parsing config file " << sFilename << endl;
 	//Open file
-	XMLDocument* doc = new XMLDocument;
-	int iErr = doc->LoadFile(sFilename.c_str());
+	XMLDocument* doc;
+	int iErr;
+	{
+		MEM_TAG(MEM_XML);
+		doc = new XMLDocument;
+		iErr = doc->LoadFile(sFilename.c_str());
+	}
 	if(iErr != XML_NO_ERROR)
 	{
-		errlog << "Error parsing config file: Error " << iErr << ". Ignoring..." << endl;
+		errlog(LOG_ERROR) << "Error parsing config file: Error " << iErr << ". Ignoring..." << endl;
 		if(isFullscreen())
 			setInitialFullscreen();
 		delete doc;
@@ -1390,7 +1472,7 @@ bool Pony48Engine::loadConfig(string sFilename)
 	XMLElement* root = doc->RootElement();
 	if(root == NULL)
 	{
-		errlog << "Error: Root element NULL in XML file. Ignoring..." << endl;
+		errlog(LOG_ERROR) << "Root element NULL in XML file. Ignoring..." << endl;
 		if(isFullscreen())
 			setInitialFullscreen();
 		delete doc;
@@ -1411,6 +1493,7 @@ bool Pony48Engine::loadConfig(string sFilename)
 		int iMSAA = getMSAA();
 		bool bTexAntialias = getImgBlur();
 		float32 fGamma = getGamma();
+		float32 fMinResScale = getMinRenderScale();
 		
 		window->QueryUnsignedAttribute("width", &width);
 		window->QueryUnsignedAttribute("height", &height);
@@ -1422,6 +1505,7 @@ bool Pony48Engine::loadConfig(string sFilename)
 		window->QueryIntAttribute("MSAA", &iMSAA);
 		window->QueryBoolAttribute("textureantialias", &bTexAntialias);
 		window->QueryFloatAttribute("brightness", &fGamma);
+		window->QueryFloatAttribute("minresscale", &fMinResScale);
 		window->QueryBoolAttribute("pauseminimized", &bPausesOnFocus);
 		
 		const char* cWindowPos = window->Attribute("pos");
@@ -1440,6 +1524,7 @@ bool Pony48Engine::loadConfig(string sFilename)
 		setMSAA(iMSAA);
 		setImgBlur(bTexAntialias);
 		setGamma(fGamma);
+		setMinRenderScale(fMinResScale);
 		pauseOnKeyboard(bPausesOnFocus);
 	}
 	
@@ -1451,6 +1536,8 @@ bool Pony48Engine::loadConfig(string sFilename)
 		pony48->QueryFloatAttribute("soundvol", &m_fSoundVolume);
 		pony48->QueryFloatAttribute("voxvol", &m_fVoxVolume);
 		pony48->QueryFloatAttribute("particlefac", &g_fParticleFac);
+		pony48->QueryFloatAttribute("visualoffset", &m_fVisualOffset);	//Stays automatic if it's "auto"
+		pony48->QueryFloatAttribute("measuredlatency", &m_fMeasuredLatency);
 		const char* cAchievements = pony48->Attribute("achievements");
 		if(cAchievements != NULL && strlen(cAchievements))
 			loadAchievementsGotten(cAchievements);
@@ -1536,6 +1623,7 @@ bool Pony48Engine::loadConfig(string sFilename)
 void Pony48Engine::saveConfig(string sFilename)
 {
 	errlog << "Saving config XML " << sFilename << endl;
+	MEM_TAG(MEM_XML);
 	XMLDocument* doc = new XMLDocument;
 	XMLElement* root = doc->NewElement("config");
 	
@@ -1551,6 +1639,7 @@ void Pony48Engine::saveConfig(string sFilename)
 	window->SetAttribute("MSAA", getMSAA());
 	window->SetAttribute("textureantialias", getImgBlur());
 	window->SetAttribute("brightness", getGamma());
+	window->SetAttribute("minresscale", getMinRenderScale());
 	window->SetAttribute("pauseminimized", pausesOnFocusLost());
 	root->InsertEndChild(window);
 	
@@ -1561,6 +1650,12 @@ void Pony48Engine::saveConfig(string sFilename)
 	pony48->SetAttribute("voxvol", m_fVoxVolume);
 	pony48->SetAttribute("achievements", saveAchievementsGotten().c_str());
 	pony48->SetAttribute("particlefac", g_fParticleFac);
+	if(m_fVisualOffset < 0.0f)
+		pony48->SetAttribute("visualoffset", "auto");
+	else
+		pony48->SetAttribute("visualoffset", m_fVisualOffset);
+	if(m_fMeasuredLatency >= 0.0f)
+		pony48->SetAttribute("measuredlatency", m_fMeasuredLatency);
 	root->InsertEndChild(pony48);
 	
 	XMLElement* joystick = doc->NewElement("joystick");
@@ -1768,11 +1863,8 @@ void Pony48Engine::changeMode(gameMode gm)
 			//Play gameover rumble if ded
 			rumbleController(1.0, 0.8, true);
 			//Update final score counter
-			ostringstream oss;
-			HUDTextbox* txt = (HUDTextbox*)m_hud->getChild("finalscore");
-			oss << "FINAL SCORE: " << m_iScore;
-			if(txt != NULL)
-				txt->setText(oss.str());
+			if(m_hudFinalScore)
+				m_hudFinalScore->setText(m_iScore);
 			m_hud->setScene("gameover");
 			scrubPause();
 			m_fGameoverKeyDelay = getSeconds();
@@ -1806,7 +1898,7 @@ void Pony48Engine::changeMode(gameMode gm)
 					txt->setText("YOU WIN!");
 				
 				//Also cheering
-				playSound("applause", m_fSoundVolume);
+				playSound(m_sndApplause, m_fSoundVolume);
 			}
 			else
 			{
@@ -1831,7 +1923,7 @@ void Pony48Engine::changeMode(gameMode gm)
 				m_bg = (Background*) bg;
 				setCursor(m_mCursors["sel"]);
 				m_fMusicPos[m_sSongToPlay] = getMusicPos();
-				playMusic("res/mus/SleeplessNight.mp3", m_fMusicVolume);
+				playSongMusic(MENU_MUSIC);
 				if(m_iCurMode == INTRO || m_iCurMode == CREDITS)
 					m_fMusicScrubSpeed = soundFreqDefault;
 				else
@@ -1888,18 +1980,10 @@ void Pony48Engine::changeMode(gameMode gm)
 			break;
 	}
 	startMenuPt = 0.0f;
-	HUDItem* hIt = m_hud->getChild("choosesong");
-	if(hIt != NULL)
-	{
-		HUDTextbox* hMen = (HUDTextbox*)hIt;
-		hMen->pt = 1.25f;
-	}
-	hIt = m_hud->getChild("thanx");
-	if(hIt != NULL)
-	{
-		HUDTextbox* hMen = (HUDTextbox*)hIt;
-		hMen->pt = 2.0f;
-	}
+	if(m_hudChooseSong)
+		m_hudChooseSong->pt = 1.25f;
+	if(m_hudThanx)
+		m_hudThanx->pt = 2.0f;
 	m_iCurMode = gm;
 }
 
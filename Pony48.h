@@ -12,6 +12,11 @@
 #include "webcam.h"
 #include "luainterface.h"
 #include "arc.h"
+#include "beatmap.h"
+#include "spectrum.h"
+#include "beatdetect.h"
+#include "songprefetch.h"
+#include "songschedule.h"
 
 #define DEFAULT_WIDTH	800
 #define DEFAULT_HEIGHT	600
@@ -42,6 +47,8 @@
 #define TITLE_FADE_TIME		1.0f
 #define DEV_SCORE			24680
 #define LOW_SCORE			120
+#define SPECTRUM_SIZE		ANALYZER_BARS	//Bars of the music spectrum we look at for beat detection
+#define MENU_MUSIC			"res/mus/SleeplessNight.mp3"
 
 class ColorPhase
 {
@@ -118,11 +125,17 @@ public:
 class Pony48Engine : public Engine
 {
 	friend class PonyLua;
+	friend class Pony48Bench;
 private:
 	//Important general-purpose game variables
 	ttvfs::VFSHelper vfs;
 	Vec3 CameraPos;
 	HUD* m_hud;
+	//HUD items touched every frame, looked up once in loadHUD()
+	HUDHandle<HUDItem> m_hudCoverIntro;
+	HUDHandle<HUDTextbox> m_hudScore, m_hudHiScore, m_hudFinalScore, m_hudRestart, m_hudTitle, m_hudArtist;
+	HUDHandle<HUDTextbox> m_hudEscQuit, m_hudEscQuitFinal, m_hudChooseSong, m_hudThanx, m_hudAchTitle;
+	HUDHandle<HUDMenu> m_hudSongMenu;
 	bool m_bMouseGrabOnWindowRegain;
 	float32 m_fDefCameraZ;	//Default position of camera on z axis
 	list<ColorPhase> m_ColorsChanging;
@@ -154,6 +167,7 @@ private:
 	float32 m_BoardRotAngle;
 	uint32_t m_iScore;
 	uint32_t m_iHighScore;
+	randGen m_boardRand;	//Tile spawns draw from this instead of rand(), so they don't depend on how many particles went off
 	Background* m_bg;
 	gameMode m_iCurMode;
 	float m_fGameoverKeyDelay;
@@ -167,6 +181,7 @@ private:
 	float32 m_fMusicVolume;
 	float32 m_fSoundVolume;
 	float32 m_fVoxVolume;
+	soundHandle m_sndJoinTile, m_sndSelect, m_sndCamera, m_sndApplause, m_sndNowHacking, m_sndBulkYeah;
 	float32 m_fMusicFadeInVolume;
 	float32 m_fMusicScrubSpeed;
 	map<string, float32> m_fMusicPos;
@@ -174,25 +189,37 @@ private:
 	bool m_bHasBoredVox;
 	float32 m_fSongFxRotate;
 	string m_sSongToPlay;
+	BeatMap m_beatMap;		//Precomputed spectrum/beats for whatever music is playing
+	float32 m_fSongBPM;		//From <sfx bpm>, for when there's no beat map (0 if not given)
+	float32 m_fSongFirstBeat;	//From <sfx firstbeat>; seconds in that the first beat lands
+	SpectrumAnalyzer m_spectrum;	//Live spectrum of the music channel
+	SpectrumDelay m_specDelay;		//Lines spectra up with what's audible
+	float32 m_fVisualOffset;		//Seconds to hold beat-driven visuals back by, or < 0 to work it out ourselves
+	float32 m_fMeasuredLatency;		//From the last -measurelatency, or < 0 if it's never been done
+	SongPrefetcher m_songPrefetch;	//Loads whatever's highlighted on song select
 	arc* m_selectedSongArc;
 	float32 m_fFadeoutTitleTime;	//Time into the song we'll fade the artist and title out to transparent
 	map<string, ParticleSystem*> m_ScoreParticles;	//Particle systems for when we score points
 	vector<ParticleSystem*> m_selectedSongParticles;	//Particle systems for main menu/selected song stuff
-	vector<float32> m_selectedSongParticlesRateMul;		//Rate multiplication for above for fine-tweaking
-	vector<float32> m_selectedSongParticlesThresh;		//Threshold for above for fine-tweaking
 	float32 INTRO_FADEIN_DELAY;
 	list<ParticleSystem*> m_selectedSongParticlesBg;	//Aaand background particle effects
 #ifdef DEBUG
 	ParticleSystem* m_fireworksFx;						//Aaaand fireworks stuff
+#endif
+#ifdef USE_MEMTRACK
+	Text* m_txtMemOverlay;		//Font for the allocation overlay
+	TextLayout m_memOverlayLayout;	//Reused for each line, so drawing the overlay doesn't allocate much itself
+	bool m_bMemOverlay;
+	void drawMemOverlay();
 #endif
 	physSegment* m_rdFly;
 	float32 m_fStartFade;
 	
 	//audio.cpp stuff!
 	string sLuaUpdateFunc;
-	float32 beatThresholdVolume;	//The threshold over which to recognize a beat
-	uint32_t beatThresholdBar;		//The bar in the volume distribution to examine
-	float32 beatMul;				//The multiplication factor to move the camera
+	SongScheduler m_songSchedule;	//Song script callbacks, by song position
+	BeatDetector m_songBeats;		//Camera bounce, plus whatever the song XML hooks up
+	BeatDetector m_menuBeats;		//Menu text, arc, and particles
 	float32 maxCamz;				//The maximum value for the camera's z axis
 	float32 m_fCamBounceBack;
 	map<string, ParticleSystem*> songParticles;
@@ -231,11 +258,14 @@ public:
 	Pony48Engine(uint16_t iWidth, uint16_t iHeight, string sTitle, string sAppName, string sIcon, bool bResizable = false);
 	~Pony48Engine();
 	
-	void setLua(LuaInterface* l)	{Lua = l;};
+	void setLua(LuaInterface* l)	{Lua = l; m_songSchedule.setLua(l);};
+	uint32_t getScore()				{return m_iScore;};
+	uint32_t getBoardHash();		//Hash of the tile values on the board, to tell if two runs played out the same
 	
 	bool _shouldSelect(b2Fixture* fix);
 
 	void hudSignalHandler(string sSignal);	//For handling signals that come from the HUD
+	void loadHUD(string sScene);			//(Re)create the HUD from XML and switch to the given scene
 	void handleKeys();						//Poll the keyboard state and update the game accordingly
 	Point worldPosFromCursor(Point cursorpos);	//Get the worldspace position of the given mouse cursor position
 	Point worldMovement(Point cursormove);		//Get the worldspace transform of the given mouse transformation
@@ -257,8 +287,20 @@ public:
 	void clearColors();
 	
 	//audio.cpp functions
-	void beatDetect();					//Bounce to da beat
+	void beatDetect(float32 dt);					//Bounce to da beat
+	void beatDetect(const float* spec, float32 dt);	//Bounce to the given mono spectrum (SPECTRUM_SIZE bars)
+	float32 getVisualOffset();						//How far behind the mixer what we hear is
+	float32 getVisualMusicPos();					//getMusicPos(), minus that
+	float32 songBeatTime(float32 fBeat);			//Seconds into the song of the given beat, or < 0 if we don't know its tempo
+	static void beatCamera(const beatBand& band, void* data);		//Beat callbacks. data is the engine...
+	static void beatMenuText(const beatBand& band, void* data);
+	static void beatArc(const beatBand& band, void* data);
+	static void beatParticles(const beatBand& band, void* data);	//...except this one's is the ParticleSystem
 	void loadSongXML(string sFilename);	//Load a song + playback stuff from XML
+	void applySong(songData* song);		//Set up playback from a loaded song
+	void playSongMusic(string sAudioFile, songData* song = NULL);	//playMusic(), plus hooking up beat detection to it. Uses song's prefetched stream and beat map if it has them
+	void analyzeSongs();				//Rebuild the beat map caches for every song
+	void preloadSoundBank();			//Start loading every sound we might play, in the background
 	void scrubPause();					//Pauses music with a decreasing-frequency effect
 	void scrubResume();					//Resumes music with an increasing-frequency effect
 	void soundUpdate(float32 dt);		//Updates audio fx
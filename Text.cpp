@@ -8,6 +8,12 @@
 Text::Text(string sXMLFilename)
 {
 	m_imgFont = NULL;
+	m_iNumCachedLayouts = 0;
+	for(int i = 0; i < 256; i++)
+	{
+		m_bHasGlyph[i] = false;
+		m_fKerning[i] = 0.0f;
+	}
 
 	//  Load font image and glyphs from xml
 	//  File format:
@@ -19,8 +25,12 @@ Text::Text(string sXMLFilename)
 	//	  ...
 	//  </font>
 
-	XMLDocument* doc = new XMLDocument();
-	doc->LoadFile(sXMLFilename.c_str());
+	XMLDocument* doc;
+	{
+		MEM_TAG(MEM_XML);
+		doc = new XMLDocument();
+		doc->LoadFile(sXMLFilename.c_str());
+	}
 
 	XMLElement* elem = doc->FirstChildElement("font");
 	if(elem == NULL) return;
@@ -46,11 +56,12 @@ Text::Text(string sXMLFilename)
 			if(cChar == NULL) return;
 			const char* cRect = elem->Attribute("rect");
 			if(cRect == NULL) return;
-			Rect rc = rectFromString(cRect);
-			m_mRectangles[cChar[0]] = rc;   //Stick this into the list
+			unsigned char c = cChar[0];
+			m_rcGlyphs[c] = rectFromString(cRect);   //Stick this into the list
+			m_bHasGlyph[c] = true;
 			float32 kern = 0.0f;
 			elem->QueryFloatAttribute("kern", &kern);
-			m_mKerning[cChar[0]] = kern;
+			m_fKerning[c] = kern;
 		}
 	}
 	delete doc;
@@ -63,51 +74,110 @@ Text::~Text()
 		delete m_imgFont;
 }
 
-void Text::render(string sText, float32 x, float32 y, float pt)
+void Text::render(const string& sText, float32 x, float32 y, float pt)
 {
 	if(m_imgFont == NULL)
 		return;
-	x = -x;
-	y = -y;
+	render(*layout(sText, pt), x, y);
+}
+
+void Text::render(const TextLayout& layout, float32 x, float32 y)
+{
+	if(m_imgFont == NULL || layout.verts.empty())
+		return;
+	
 	glColor4f(col.r, col.g, col.b, col.a);
-	float width = size(sText, pt);
-	x += width / 2.0;
-	for(string::iterator i = sText.begin(); i != sText.end(); i++)
+	glPushMatrix();
+	glTranslatef(x, y, 0.0);
+	m_imgFont->bind();
+	glVertexPointer(2, GL_FLOAT, 0, &layout.verts[0]);
+	glTexCoordPointer(2, GL_FLOAT, 0, &layout.texCoords[0]);
+	glDrawArrays(GL_QUADS, 0, layout.verts.size() / 2);
+	glPopMatrix();
+	glColor4f(1.0f,1.0f,1.0f,1.0f);
+}
+
+float32 Text::size(const string& sText, float pt)
+{
+	float32 len = 0.0f;
+	for(string::const_iterator i = sText.begin(); i != sText.end(); i++)
 	{
 		unsigned char c = *i;
 		if(c == '\0')
 			break;
+		
+		if(m_bHasGlyph[c])
+			len += (m_rcGlyphs[c].width() - m_fKerning[c]) * (pt / m_rcGlyphs[c].height());
+	}
+	return len;
+}
 
-		map<unsigned char, Rect>::iterator iRect = m_mRectangles.find(c);
-		if(iRect == m_mRectangles.end())
-			continue;   //Skip over chars we can't draw
-
-		Rect rc = iRect->second;
-
-		glPushMatrix();
-		x -= rc.width() * (pt / rc.height())/2.0;	//Add half the width to get the center (whyyy are we drawing from the center plz dood I fan)
-		glTranslatef(-x, -y, 0.0);
-		Point sz(rc.width() * (pt / rc.height()), pt);	//Ignore kerning when drawing; we only care about that when computing position
-		m_imgFont->render(sz, rc);
-		glPopMatrix();
-		x -= (rc.width() - m_mKerning[c]*2.0) * (pt / rc.height())/2.0;	//Add second half of the width, plus kerning (times 2 because divided by 2... it all works out)
+const TextLayout* Text::layout(const string& sText, float pt)
+{
+	MEM_TAG(MEM_HUDTEXT);
+	map<string, TextLayout>& sizeCache = m_mLayoutCache[pt];
+	map<string, TextLayout>::iterator i = sizeCache.find(sText);
+	if(i != sizeCache.end())
+		return &i->second;
+	
+	//Not cached; lay it out now. If the cache is getting huge (such as from constantly-changing text), start it over
+	if(m_iNumCachedLayouts >= MAX_CACHED_LAYOUTS)
+	{
+		for(map<float, map<string, TextLayout> >::iterator j = m_mLayoutCache.begin(); j != m_mLayoutCache.end(); j++)
+			j->second.clear();
+		m_iNumCachedLayouts = 0;
 	}
-	glColor4f(1.0f,1.0f,1.0f,1.0f);
+	m_iNumCachedLayouts++;
+	TextLayout* lay = &sizeCache[sText];
+	layout(sText, pt, lay);
+	return lay;
 }
 
-float32 Text::size(string sText, float pt)
+void Text::layout(const string& sText, float pt, TextLayout* layout)
 {
-	float32 len = 0.0f;
-	for(string::iterator i = sText.begin(); i != sText.end(); i++)
+	MEM_TAG(MEM_HUDTEXT);
+	layout->verts.clear();
+	layout->texCoords.clear();
+	layout->width = size(sText, pt);
+	if(m_imgFont == NULL)
+		return;
+	
+	float32 x = -layout->width / 2.0;	//Left edge of the current glyph
+	float32 top = pt / 2.0;
+	float32 bottom = -pt / 2.0;
+	for(string::const_iterator i = sText.begin(); i != sText.end(); i++)
 	{
 		unsigned char c = *i;
 		if(c == '\0')
 			break;
+		if(!m_bHasGlyph[c])
+			continue;   //Skip over chars we can't draw
 		
-		if(m_mRectangles.count(c))
-			len += (m_mRectangles[c].width() - m_mKerning[c]) * (pt / m_mRectangles[c].height());
+		Rect rc = m_rcGlyphs[c];
+		float32 scale = pt / rc.height();
+		float32 w = rc.width() * scale;	//Ignore kerning when drawing; we only care about that when computing position
+		Rect tex = m_imgFont->texCoords(rc);
+		
+		//Upper left, upper right, lower right, lower left
+		layout->verts.push_back(x);
+		layout->verts.push_back(top);
+		layout->verts.push_back(x + w);
+		layout->verts.push_back(top);
+		layout->verts.push_back(x + w);
+		layout->verts.push_back(bottom);
+		layout->verts.push_back(x);
+		layout->verts.push_back(bottom);
+		layout->texCoords.push_back(tex.left);
+		layout->texCoords.push_back(tex.top);
+		layout->texCoords.push_back(tex.right);
+		layout->texCoords.push_back(tex.top);
+		layout->texCoords.push_back(tex.right);
+		layout->texCoords.push_back(tex.bottom);
+		layout->texCoords.push_back(tex.left);
+		layout->texCoords.push_back(tex.bottom);
+		
+		x += w - m_fKerning[c] * scale;
 	}
-	return len;
 }
 
 
@@ -9,6 +9,7 @@
 #include "globaldefs.h"
 #include "Image.h"
 #include <map>
+#include <vector>
 
 #define ALIGN_LEFT		1
 #define ALIGN_RIGHT		2
@@ -17,14 +18,28 @@
 #define ALIGN_MIDDLE	16
 #define ALIGN_BOTTOM	32
 
+#define MAX_CACHED_LAYOUTS	256	//Flush text layout cache once it gets this big
+
+//Glyph quads for one string at one point size, centered on 0,0
+class TextLayout
+{
+public:
+	vector<GLfloat> verts;
+	vector<GLfloat> texCoords;
+	float32 width;
+};
+
 class Text
 {
 private:
 	Text(){};								//Default constructor cannot be called
 	Image* m_imgFont;						//Image for this bitmap font
-	map<unsigned char, Rect> m_mRectangles;	//Rectangles for drawing each character
-	map<unsigned char, float32> m_mKerning;	//Kerning info for font glyphs
+	Rect m_rcGlyphs[256];					//Rectangles for drawing each character
+	float32 m_fKerning[256];				//Kerning info for font glyphs
+	bool m_bHasGlyph[256];					//If we can draw each character
 	string m_sName;
+	map<float, map<string, TextLayout> > m_mLayoutCache;	//Cached glyph quads, by point size and then text
+	uint32_t m_iNumCachedLayouts;
 
 public:
 	Color col;
@@ -33,10 +48,15 @@ public:
 	~Text();
 
 	//Render this text to the screen, centered on x and y
-	void render(string sText, float32 x, float32 y, float pt);
+	void render(const string& sText, float32 x, float32 y, float pt);
+	void render(const TextLayout& layout, float32 x, float32 y);	//Render previously laid-out text
 
 	//Find the size of a given string of text
-	float32 size(string sText, float pt);
+	float32 size(const string& sText, float pt);
+	
+	//Get the (cached) glyph quads for this text
+	const TextLayout* layout(const string& sText, float pt);
+	void layout(const string& sText, float pt, TextLayout* layout);	//Lay out text into caller-owned storage, bypassing the cache
 	string getName()	{return m_sName;};
 	void   setName(string sName)	{m_sName = sName;};
 
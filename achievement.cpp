@@ -19,11 +19,16 @@ void Pony48Engine::loadAchievements()
 {
 	//Open our achievements file
 	string sAchievementFilename = "res/achievements/achievements.xml";
-	XMLDocument* doc = new XMLDocument;
-	int iErr = doc->LoadFile(sAchievementFilename.c_str());
+	XMLDocument* doc;
+	int iErr;
+	{
+		MEM_TAG(MEM_XML);
+		doc = new XMLDocument;
+		iErr = doc->LoadFile(sAchievementFilename.c_str());
+	}
 	if(iErr != XML_NO_ERROR)
 	{
-		errlog << "Error parsing achievements file: Error " << iErr << endl;
+		errlog(LOG_ERROR) << "Error parsing achievements file: Error " << iErr << endl;
 		delete doc;
 		return;
 	}
@@ -32,7 +37,7 @@ void Pony48Engine::loadAchievements()
 	XMLElement* root = doc->RootElement();
 	if(root == NULL)
 	{
-		errlog << "Error: Root element NULL in XML file. Ignoring..." << endl;
+		errlog(LOG_ERROR) << "Root element NULL in XML file. Ignoring..." << endl;
 		delete doc;
 		return;
 	}
@@ -107,7 +112,7 @@ void Pony48Engine::achievementGet(string sAch)
 	m_achievementsToDraw.push_back(sAch);
 	
 	//Play getting-achievement sfx
-	playSound("bulk_yeah", m_fVoxVolume);
+	playSound(m_sndBulkYeah, m_fVoxVolume, 0.0f, 1.0f, SOUND_PRIORITY_HIGH);
 }
 
 void Pony48Engine::cleanupAchievements()
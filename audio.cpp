@@ -5,30 +5,49 @@
 
 #include "Pony48.h"
 
-const int sampleSize = 64;
-
-void Pony48Engine::beatDetect()
+void Pony48Engine::beatDetect(float32 dt)
 {
+	PROFILE_ZONE("Pony48Engine::beatDetect");
 	if(m_iCurMode == GAMEOVER) return;	//music stops when game is over, so it looks silly
-	FMOD_CHANNEL* channel = getChannel("music");
+	FMOD_CHANNEL* channel = getMusicChannel();
 	if(channel == NULL) return;
 	
+	//Spectra come from what's being mixed, which we won't hear for a bit yet
+	uint32_t iDelayFrames = (dt > 0.0f) ? (uint32_t)(getVisualOffset() / dt + 0.5f) : 0;
+	
+	float spec[SPECTRUM_SIZE];
+	if(m_beatMap.valid())
+	{
+		//Look it up from the precomputed map; cheaper, and the same every run (so replays match). Can just look up what's audible
+		m_beatMap.spectrum(getVisualMusicPos(), spec, SPECTRUM_SIZE);
+		beatDetect(spec, dt);
+		return;
+	}
+	if(!g_replay.active() && !isAudioNRT() && m_spectrum.read(spec))
+	{
+		//Live from our own analyzer thread. Not when stepping audio by hand, since what it's gotten to by now is up to the thread
+		m_specDelay.push(spec);
+		beatDetect(m_specDelay.get(iDelayFrames), dt);
+		return;
+	}
 	
 	//Code based off of http://katyscode.wordpress.com/2013/01/16/cutting-your-teeth-on-fmod-part-4-frequency-analysis-graphic-equalizer-beat-detection-and-bpm-estimation/
-	float *specLeft, *specRight, *spec;
-
-	specLeft = new float[sampleSize];
-	specRight = new float[sampleSize];
-	spec = new float[sampleSize];
+	float specLeft[SPECTRUM_SIZE], specRight[SPECTRUM_SIZE];
 
 	// Get spectrum for left and right stereo channels
-	FMOD_Channel_GetSpectrum(channel, specLeft, sampleSize, 0, FMOD_DSP_FFT_WINDOW_RECT);
-	FMOD_Channel_GetSpectrum(channel, specRight, sampleSize, 1, FMOD_DSP_FFT_WINDOW_RECT);
+	FMOD_Channel_GetSpectrum(channel, specLeft, SPECTRUM_SIZE, 0, FMOD_DSP_FFT_WINDOW_RECT);
+	FMOD_Channel_GetSpectrum(channel, specRight, SPECTRUM_SIZE, 1, FMOD_DSP_FFT_WINDOW_RECT);
 
 	//Center for a mono sound
-	for(int i = 0; i < sampleSize; i++)
+	for(int i = 0; i < SPECTRUM_SIZE; i++)
 		spec[i] = (specLeft[i] + specRight[i]) / 2.0;
 	
+	m_specDelay.push(spec);
+	beatDetect(m_specDelay.get(iDelayFrames), dt);
+}
+
+void Pony48Engine::beatDetect(const float* spec, float32 dt)
+{
 #ifdef DEBUG
 	/*const int printLen = 150;
 	//Print out a sort of audio-level thing
@@ -45,103 +64,153 @@ void Pony48Engine::beatDetect()
 #endif
 
 	if(m_iCurMode == SONGSELECT || m_iCurMode == CREDITS || m_iCurMode == ACHIEVEMENTS)
-	{
-		beatThresholdVolume = 0.95;
-		beatThresholdBar = 0;
-		beatMul = 0.05f;
-		if(m_iCurMode == SONGSELECT)
-			maxCamz = 3.5f;
-		else
-			maxCamz = 4.25;
-		m_fCamBounceBack = 0.02f;
-		
-		//Bounce parta da menu to da beat
-		HUDItem* hIt = NULL;
-		if(m_iCurMode == SONGSELECT)
-			hIt = m_hud->getChild("choosesong");
-		else if(m_iCurMode == CREDITS)
-			hIt = m_hud->getChild("thanx");
-		else if(m_iCurMode == ACHIEVEMENTS)
-			hIt = m_hud->getChild("achtitle");
-		if(hIt != NULL)
-		{
-			HUDTextbox* hMen = (HUDTextbox*)hIt;
-			if(!startMenuPt)
-				startMenuPt = hMen->pt;
-			
-			//Bounce back
-			if(hMen->pt > startMenuPt)
-				hMen->pt -= m_fCamBounceBack;
-			if(hMen->pt < startMenuPt)
-				hMen->pt = startMenuPt;
-			
-			//Bounce forward
-			if(spec[beatThresholdBar] >= beatThresholdVolume)
-			{
-				hMen->pt += beatMul * spec[beatThresholdBar];
-				if(hMen->pt > startMenuPt + maxCamz)
-					hMen->pt = startMenuPt + maxCamz;
-			}
-		}
-		
-		//Also make electric arc bounce to da beat
-		m_selectedSongArc->max = 0.5 * spec[beatThresholdBar];
-		m_selectedSongArc->add = 0.5;
-		
-		//Also have some particle systems; make them fire according to beat too
-		for(int i = 0; i < m_selectedSongParticles.size(); i++)
-		{
-			if(m_selectedSongParticlesRateMul.size() > i && m_selectedSongParticlesThresh.size() > i && spec[i] >= m_selectedSongParticlesThresh[i])
-				m_selectedSongParticles[i]->rate = m_selectedSongParticlesRateMul[i] * spec[i];
-			else
-				m_selectedSongParticles[i]->rate = 0;
-		}
-	}
+		m_menuBeats.update(spec, SPECTRUM_SIZE, dt);
 	else
-	{
-		//First half of camera bounce; move back a bit every frame in an attempt to get back to default position
-		if(CameraPos.z > m_fDefCameraZ)
-			CameraPos.z -= m_fCamBounceBack;
-		if(CameraPos.z < m_fDefCameraZ)
-			CameraPos.z = m_fDefCameraZ;
+		m_songBeats.update(spec, SPECTRUM_SIZE, dt);
+}
 
+float32 Pony48Engine::getVisualOffset()
+{
+	if(isAudioNRT() || g_replay.active())
+		return 0.0f;					//Nothing's heard, or it has to come out the same on every machine; config.xml doesn't get a say
+	if(m_fVisualOffset >= 0.0f)
+		return m_fVisualOffset;			//Set by hand
+	if(m_fMeasuredLatency >= 0.0f)
+		return m_fMeasuredLatency;		//Includes whatever the OS and hardware add on top of FMOD
+	return getOutputLatency();
+}
 
-		//Second half: test for threshold volume being exceeded and bounce camera forward
-		if(spec[beatThresholdBar] >= beatThresholdVolume)
-		{
-			CameraPos.z += beatMul * spec[beatThresholdBar];
-			if(CameraPos.z > m_fDefCameraZ + maxCamz)
-				CameraPos.z = m_fDefCameraZ + maxCamz;
-		}
+float32 Pony48Engine::getVisualMusicPos()
+{
+	float32 fPos = getMusicPos();
+	if(fPos < 0.0f)
+		return fPos;
+	return max(fPos - getVisualOffset(), 0.0f);
+}
+
+float32 Pony48Engine::songBeatTime(float32 fBeat)
+{
+	float32 fTime = m_beatMap.valid() ? m_beatMap.beatTime(fBeat) : -1.0f;
+	if(fTime < 0.0f && m_fSongBPM > 0.0f)	//Not analyzed; go by what the song says its tempo is
+		fTime = max(m_fSongFirstBeat + fBeat * 60.0f / m_fSongBPM, 0.0f);
+	return fTime;
+}
+
+void Pony48Engine::beatCamera(const beatBand& band, void* data)
+{
+	Pony48Engine* eng = (Pony48Engine*)data;
+	
+	//First half of camera bounce; move back a bit every frame in an attempt to get back to default position
+	if(eng->CameraPos.z > eng->m_fDefCameraZ)
+		eng->CameraPos.z -= eng->m_fCamBounceBack;
+	if(eng->CameraPos.z < eng->m_fDefCameraZ)
+		eng->CameraPos.z = eng->m_fDefCameraZ;
+
+	//Second half: test for threshold volume being exceeded and bounce camera forward
+	if(band.bBeat)
+	{
+		eng->CameraPos.z += band.fMul * band.fLevel;
+		if(eng->CameraPos.z > eng->m_fDefCameraZ + eng->maxCamz)
+			eng->CameraPos.z = eng->m_fDefCameraZ + eng->maxCamz;
 	}
+}
+
+void Pony48Engine::beatMenuText(const beatBand& band, void* data)
+{
+	Pony48Engine* eng = (Pony48Engine*)data;
+	float32 fMax = (eng->m_iCurMode == SONGSELECT) ? 3.5f : 4.25f;
+	const float32 fBounceBack = 0.02f;
+	
+	//Bounce parta da menu to da beat
+	HUDTextbox* hMen = NULL;
+	if(eng->m_iCurMode == SONGSELECT)
+		hMen = eng->m_hudChooseSong;
+	else if(eng->m_iCurMode == CREDITS)
+		hMen = eng->m_hudThanx;
+	else if(eng->m_iCurMode == ACHIEVEMENTS)
+		hMen = eng->m_hudAchTitle;
+	if(hMen == NULL)
+		return;
+	if(!eng->startMenuPt)
+		eng->startMenuPt = hMen->pt;
 	
-	delete [] spec;
-	delete [] specLeft;
-	delete [] specRight;
+	//Bounce back
+	if(hMen->pt > eng->startMenuPt)
+		hMen->pt -= fBounceBack;
+	if(hMen->pt < eng->startMenuPt)
+		hMen->pt = eng->startMenuPt;
+	
+	//Bounce forward
+	if(band.bBeat)
+	{
+		hMen->pt += band.fMul * band.fLevel;
+		if(hMen->pt > eng->startMenuPt + fMax)
+			hMen->pt = eng->startMenuPt + fMax;
+	}
+}
+
+void Pony48Engine::beatArc(const beatBand& band, void* data)
+{
+	//Make electric arc bounce to da beat
+	Pony48Engine* eng = (Pony48Engine*)data;
+	eng->m_selectedSongArc->max = band.fMul * band.fLevel;
+	eng->m_selectedSongArc->add = 0.5;
+}
+
+void Pony48Engine::beatParticles(const beatBand& band, void* data)
+{
+	//Fire particles according to beat too
+	ParticleSystem* pSys = (ParticleSystem*)data;
+	if(band.bBeat)
+		pSys->rate = band.fMul * band.fLevel;
+	else
+		pSys->rate = 0;
+}
+
+//Shared attributes of <bounce> and <beat>. Only the ones given are changed
+static void readBeatBand(XMLElement* elem, beatBand* band)
+{
+	if(elem->QueryUnsignedAttribute("bar", &band->iFirstBar) == XML_NO_ERROR)
+		band->iLastBar = band->iFirstBar;
+	elem->QueryUnsignedAttribute("lastbar", &band->iLastBar);
+	if(band->iLastBar < band->iFirstBar)
+		band->iLastBar = band->iFirstBar;
+	elem->QueryFloatAttribute("threshold", &band->fFloor);
+	elem->QueryFloatAttribute("sensitivity", &band->fSensitivity);
+	elem->QueryFloatAttribute("hold", &band->fHold);
+	elem->QueryFloatAttribute("mul", &band->fMul);
 }
 
 void Pony48Engine::loadSongXML(string sFilename)
 {
+	//Use what song select prefetched if we can, and load it here if not
+	songData* song = m_songPrefetch.take(sFilename);
+	if(song == NULL)
+		song = SongPrefetcher::load(sFilename);
+	applySong(song);
+	SongPrefetcher::release(song);
+}
+
+void Pony48Engine::applySong(songData* song)
+{
+	string sFilename = song->sFilename;
+	g_replay.setSong(sFilename);
 	bPaused = false;
 	startedDecay = 0.0f;
 	
 	//Clean up old data
 	cleanupSongGfx();
+	m_beatMap.clear();
+	m_fSongBPM = 0.0f;
+	m_fSongFirstBeat = 0.0f;
 	
-	XMLDocument* doc = new XMLDocument();
-    int iErr = doc->LoadFile(sFilename.c_str());
-	if(iErr != XML_NO_ERROR)
-	{
-		errlog << "Error parsing XML file " << sFilename << ": Error " << iErr << endl;
-		delete doc;
-		return;
-	}
+	if(song->doc == NULL)
+		return;	//Already complained about in SongPrefetcher::load()
 
-    XMLElement* root = doc->FirstChildElement("song");
+    XMLElement* root = song->doc->FirstChildElement("song");
     if(root == NULL)
 	{
-		errlog << "Error: No toplevel \"song\" item in XML file " << sFilename << endl;
-		delete doc;
+		errlog(LOG_ERROR) << "No toplevel \"song\" item in XML file " << sFilename << endl;
 		return;
 	}
 	
@@ -150,10 +219,9 @@ void Pony48Engine::loadSongXML(string sFilename)
 	const char* cArtist = root->Attribute("artist");
 	if(cArtist && strlen(cArtist))
 	{
-		HUDItem* hIt = m_hud->getChild("artist");
-		if(hIt != NULL)
+		HUDTextbox* txt = m_hudArtist;
+		if(txt != NULL)
 		{
-			HUDTextbox* txt = (HUDTextbox*)hIt;
 			string s = "by ";
 			s += cArtist;
 			txt->setText(s);
@@ -167,10 +235,9 @@ void Pony48Engine::loadSongXML(string sFilename)
 	const char* cTitle = root->Attribute("title");
 	if(cTitle && strlen(cTitle))
 	{
-		HUDItem* hIt = m_hud->getChild("title");
-		if(hIt != NULL)
+		HUDTextbox* txt = m_hudTitle;
+		if(txt != NULL)
 		{
-			HUDTextbox* txt = (HUDTextbox*)hIt;
 			txt->setText(cTitle);
 			txt->col.a = 1.0f;
 			
@@ -181,9 +248,8 @@ void Pony48Engine::loadSongXML(string sFilename)
 	}
 	m_fFadeoutTitleTime = getSeconds() + TITLE_DISPLAY_TIME;
 	
-	beatThresholdVolume = 0.75;
-	beatThresholdBar = 0;
-	beatMul = 45;
+	//Camera bounce is always band 0; <bounce> tweaks it
+	m_songBeats.addBand(0, 0, 0.75, 0, 45, beatCamera, this, "camera");
 	maxCamz = 4;
 	m_fCamBounceBack = 18.0;
 	
@@ -196,9 +262,12 @@ void Pony48Engine::loadSongXML(string sFilename)
 			if(name == "sfx")
 			{
 				const char* cPath = elem->Attribute("path");
+				elem->QueryFloatAttribute("bpm", &m_fSongBPM);	//Only used if the song hasn't been through -analyze
+				elem->QueryFloatAttribute("firstbeat", &m_fSongFirstBeat);
 				if(cPath != NULL && strlen(cPath))
-					playMusic(cPath, m_fMusicVolume);
+					playSongMusic(cPath, song);
 				setMusicFrequency(soundFreqDefault);
+				m_songSchedule.setLoop(0.0f, getMusicLength());	//Whole song, unless there's a <loop>
 			}
 			else if(name == "loop")
 			{
@@ -207,7 +276,10 @@ void Pony48Engine::loadSongXML(string sFilename)
 				elem->QueryFloatAttribute("start", &start);
 				elem->QueryFloatAttribute("end", &end);
 				if(start > 0 && end > 0)
+				{
 					musicLoop(start, end);
+					m_songSchedule.setLoop(start, end);
+				}
 			}
 			else if(name == "background")
 			{
@@ -284,18 +356,32 @@ void Pony48Engine::loadSongXML(string sFilename)
 			}
 			else if(name == "bounce")
 			{
-				elem->QueryFloatAttribute("threshold", &beatThresholdVolume);
-				elem->QueryUnsignedAttribute("bar", &beatThresholdBar);
-				elem->QueryFloatAttribute("mul", &beatMul);
+				beatBand* band = m_songBeats.getBand(0);
+				readBeatBand(elem, band);
 				elem->QueryFloatAttribute("max", &maxCamz);
 				elem->QueryFloatAttribute("bounceback", &m_fCamBounceBack);
 			}
+			else if(name == "beat")
+			{
+				//Drive one of the song's particle systems from a band
+				const char* cParticles = elem->Attribute("particles");
+				if(cParticles == NULL || !songParticles.count(cParticles))
+				{
+					errlog(LOG_WARN) << "No particle system named " << (cParticles ? cParticles : "(none)") << " for <beat> in " << sFilename << endl;
+					continue;
+				}
+				uint32_t iBand = m_songBeats.addBand(0, 0, 0, 0, 1, beatParticles, songParticles[cParticles], cParticles);
+				readBeatBand(elem, m_songBeats.getBand(iBand));
+			}
 			else if(name == "lua")
 			{
 				const char* cLuaFile = elem->Attribute("file");
 				if(cLuaFile)
 				{
-					Lua->call("dofile", cLuaFile);
+					if(song->sLuaFile == cLuaFile && song->sLuaChunk.size())
+						Lua->doBuffer(song->sLuaChunk.data(), song->sLuaChunk.size(), ("@" + song->sLuaFile).c_str());
+					else
+						Lua->call("dofile", cLuaFile);
 					const char* cLuaInitFunc = elem->Attribute("init");
 					if(cLuaInitFunc)
 						Lua->call(cLuaInitFunc);
@@ -311,7 +397,10 @@ void Pony48Engine::loadSongXML(string sFilename)
 				if(cParticleFilename && cParticleName)
 				{
 					ParticleSystem* pSys = new ParticleSystem();
-					pSys->fromXML(cParticleFilename);
+					if(song->particles.count(cParticleFilename))
+						pSys->fromXML(song->particles[cParticleFilename], cParticleFilename);
+					else
+						pSys->fromXML(cParticleFilename);
 					pSys->init();
 					songParticles[cParticleName] = pSys;
 					elem->QueryBoolAttribute("autofire", &pSys->firing);
@@ -321,6 +410,103 @@ void Pony48Engine::loadSongXML(string sFilename)
 	}
 }
 
+void Pony48Engine::playSongMusic(string sAudioFile, songData* song)
+{
+	if(song != NULL && song->music != NULL && song->sMusicPath == sAudioFile)
+	{
+		playMusic(song->music, m_fMusicVolume);
+		song->music = NULL;	//Engine owns it now
+	}
+	else
+		playMusic(sAudioFile, m_fMusicVolume);
+	m_spectrum.attach(getMusicChannel());
+	m_specDelay.clear();
+	
+	//Analyzing a whole song takes seconds, so that's left to -analyze; without a cache, we go by the live spectrum
+	if(song != NULL && song->sMusicPath == sAudioFile && song->beats.valid())
+		m_beatMap.swap(song->beats);
+	else if(!m_beatMap.loadCache(sAudioFile))
+		errlog << "No beat map for " << sAudioFile << " (run with -analyze to build one). Using the live spectrum" << endl;
+}
+
+void Pony48Engine::preloadSoundBank()
+{
+	//Every sound effect and voice clip, by path, so they're ready before anything asks for them by name
+	const char* cDirs[] = {"res/sfx", "res/vox"};
+	for(int dir = 0; dir < 2; dir++)
+	{
+		ttvfs::StringList lFiles;
+		ttvfs::GetFileList(cDirs[dir], lFiles);
+		for(ttvfs::StringList::iterator i = lFiles.begin(); i != lFiles.end(); i++)
+		{
+			string sPath = string(cDirs[dir]) + "/" + *i;
+			createSound(sPath, sPath);
+		}
+	}
+	
+	//Plus whatever the tiles play, under the names loadTile() will want
+	ttvfs::StringList lFiles;
+	ttvfs::GetFileList("res/tiles", lFiles);
+	for(ttvfs::StringList::iterator i = lFiles.begin(); i != lFiles.end(); i++)
+	{
+		if(i->size() < 4 || i->substr(i->size() - 4) != ".xml")
+			continue;
+		string sFilename = "res/tiles/" + *i;
+		XMLDocument doc;
+		XMLError err;
+		{
+			MEM_TAG(MEM_XML);
+			err = doc.LoadFile(sFilename.c_str());
+		}
+		if(err != XML_NO_ERROR)
+			continue;	//loadTile() will complain about it
+		XMLElement* root = doc.FirstChildElement("tile");
+		if(root == NULL)
+			continue;
+		for(XMLElement* sound = root->FirstChildElement("sound"); sound != NULL; sound = sound->NextSiblingElement("sound"))
+		{
+			for(XMLElement* fx = sound->FirstChildElement("fx"); fx != NULL; fx = fx->NextSiblingElement("fx"))
+			{
+				const char* cPath = fx->Attribute("path");
+				const char* cName = fx->Attribute("name");
+				if(cPath && cName)
+					createSound(cPath, cName);
+			}
+		}
+	}
+}
+
+void Pony48Engine::analyzeSongs()
+{
+	BeatMap bm;
+	bm.loadOrAnalyze(getAudioSystem(), MENU_MUSIC, true);
+	
+	ttvfs::StringList lFiles;
+	ttvfs::GetFileList("res/mus", lFiles);
+	for(ttvfs::StringList::iterator i = lFiles.begin(); i != lFiles.end(); i++)
+	{
+		if(i->size() < 4 || i->substr(i->size() - 4) != ".xml")
+			continue;
+		string sFilename = "res/mus/" + *i;
+		XMLDocument doc;
+		XMLError err;
+		{
+			MEM_TAG(MEM_XML);
+			err = doc.LoadFile(sFilename.c_str());
+		}
+		if(err != XML_NO_ERROR)
+		{
+			errlog(LOG_ERROR) << "Error parsing XML file " << sFilename << endl;
+			continue;
+		}
+		XMLElement* root = doc.FirstChildElement("song");
+		XMLElement* sfx = (root == NULL) ? NULL : root->FirstChildElement("sfx");
+		const char* cPath = (sfx == NULL) ? NULL : sfx->Attribute("path");
+		if(cPath != NULL && strlen(cPath))
+			bm.loadOrAnalyze(getAudioSystem(), cPath, true);
+	}
+}
+
 void Pony48Engine::scrubPause()
 {
 	startedDecay = getSeconds();
@@ -337,6 +523,7 @@ const float timeToDecay = 0.75f;
 
 void Pony48Engine::soundUpdate(float32 dt)
 {
+	PROFILE_ZONE("Pony48Engine::soundUpdate");
 	if(startedDecay < 0)	//Resuming
 	{
 		bPaused = false;
@@ -370,7 +557,14 @@ void Pony48Engine::soundUpdate(float32 dt)
 	if(!bPaused)
 	{
 		if(sLuaUpdateFunc.size())
-			Lua->call(sLuaUpdateFunc.c_str(), getMusicPos());
+		{
+			PROFILE_ZONE("Lua update");
+			Lua->call(sLuaUpdateFunc.c_str(), getVisualMusicPos());
+		}
+		{
+			PROFILE_ZONE("Lua schedule");
+			m_songSchedule.update(getVisualMusicPos());
+		}
 		
 		for(map<string, ParticleSystem*>::iterator i = songParticles.begin(); i != songParticles.end(); i++)
 			i->second->update(dt);
@@ -386,6 +580,9 @@ void Pony48Engine::cleanupSongGfx()
 	for(map<string, ParticleSystem*>::iterator i = songParticles.begin(); i != songParticles.end(); i++)
 		delete (i->second);
 	songParticles.clear();
+	m_songBeats.clear();	//Might point at those particles
+	m_songSchedule.clear();
+	sLuaUpdateFunc.clear();	//Only if the next song asks for one
 	m_fSongFxRotate = 0.0f;
 	if(m_bg != NULL)
 		delete m_bg;
@@ -0,0 +1,69 @@
+/*
+	Pony48 source - beatdetect.cpp
+	Copyright (c) 2014 Mark Hutcheson
+*/
+
+#include "beatdetect.h"
+#include <cmath>
+
+uint32_t BeatDetector::addBand(uint32_t iFirstBar, uint32_t iLastBar, float32 fFloor, float32 fSensitivity, float32 fMul, beatCallback callback, void* data, string sTarget)
+{
+	beatBand band;
+	band.iFirstBar = min(iFirstBar, iLastBar);
+	band.iLastBar = max(iFirstBar, iLastBar);
+	band.fSensitivity = fSensitivity;
+	band.fFloor = fFloor;
+	band.fHold = 0.0f;
+	band.fMul = fMul;
+	band.sTarget = sTarget;
+	band.callback = callback;
+	band.data = data;
+	m_bands.push_back(band);
+	reset();
+	return m_bands.size() - 1;
+}
+
+void BeatDetector::reset()
+{
+	for(vector<beatBand>::iterator i = m_bands.begin(); i != m_bands.end(); i++)
+	{
+		i->fLevel = i->fAverage = i->fVariance = 0.0f;
+		i->fThreshold = i->fFloor;
+		i->fSinceOnset = i->fHold;
+		i->bBeat = i->bOnset = false;
+	}
+}
+
+void BeatDetector::update(const float* spec, uint32_t iBars, float32 dt)
+{
+	//Same smoothing for every band; only work it out once
+	float32 fBlend = (dt > 0.0f) ? 1.0f - exp(-dt / BEAT_HISTORY_SEC) : 0.0f;
+
+	for(vector<beatBand>::iterator i = m_bands.begin(); i != m_bands.end(); i++)
+	{
+		//Band level
+		float32 fSum = 0.0f;
+		uint32_t iLast = min(i->iLastBar, iBars - 1);
+		for(uint32_t b = i->iFirstBar; b <= iLast; b++)
+			fSum += spec[b];
+		i->fLevel = (iLast >= i->iFirstBar) ? fSum / (iLast - i->iFirstBar + 1) : 0.0f;
+
+		//Compare against how loud this band has been lately, before folding this frame in
+		i->fThreshold = i->fFloor;
+		if(i->fSensitivity > 0.0f)
+			i->fThreshold = max(i->fThreshold, i->fAverage + i->fSensitivity * (float32)sqrt(i->fVariance));
+		bool bWasBeat = i->bBeat;
+		i->bBeat = (i->fLevel >= i->fThreshold);
+		i->fSinceOnset += dt;
+		i->bOnset = (i->bBeat && !bWasBeat && i->fSinceOnset >= i->fHold);
+		if(i->bOnset)
+			i->fSinceOnset = 0.0f;
+
+		float32 fDiff = i->fLevel - i->fAverage;
+		i->fAverage += fBlend * fDiff;
+		i->fVariance = (1.0f - fBlend) * (i->fVariance + fBlend * fDiff * fDiff);
+
+		if(i->callback != NULL)
+			i->callback(*i, i->data);
+	}
+}
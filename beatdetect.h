@@ -0,0 +1,53 @@
+/*
+	Pony48 header - beatdetect.h
+	Multiband beat detection over a music spectrum, with per-band callbacks
+	Copyright (c) 2014 Mark Hutcheson
+*/
+#ifndef BEATDETECT_H
+#define BEATDETECT_H
+
+#include "globaldefs.h"
+#include <vector>
+
+#define BEAT_HISTORY_SEC	1.0f	//Time constant of each band's running average; roughly how far back "normal" goes
+
+struct beatBand;
+typedef void (*beatCallback)(const beatBand& band, void* data);
+
+//One band being watched. Everything down to callback is config; the rest is updated every frame
+typedef struct beatBand
+{
+	uint32_t iFirstBar, iLastBar;	//Spectrum bars this band averages, inclusive
+	float32 fSensitivity;			//Standard deviations above its running average the band has to go to count as a beat. 0 for a fixed threshold
+	float32 fFloor;					//Never call anything quieter than this a beat
+	float32 fHold;					//Seconds after a beat starts before another one can
+	float32 fMul;					//How hard to respond; up to the callback what that means
+	string sTarget;					//What this band drives; up to the callback what that means too
+	beatCallback callback;			//Called every update, beat or not
+	void* data;
+
+	float32 fLevel;					//Current average amplitude over the band's bars
+	float32 fAverage, fVariance;	//Running stats over the last BEAT_HISTORY_SEC or so
+	float32 fThreshold;				//What fLevel had to beat this frame
+	float32 fSinceOnset;			//Seconds since bOnset was last set
+	bool bBeat;						//fLevel's over fThreshold
+	bool bOnset;					//...and wasn't last update
+} beatBand;
+
+class BeatDetector
+{
+	vector<beatBand> m_bands;
+
+public:
+	//Returns the index of the new band
+	uint32_t addBand(uint32_t iFirstBar, uint32_t iLastBar, float32 fFloor, float32 fSensitivity, float32 fMul, beatCallback callback, void* data, string sTarget = "");
+	beatBand* getBand(uint32_t i)		{return (i < m_bands.size()) ? &m_bands[i] : NULL;};
+	uint32_t size()						{return m_bands.size();};
+	void clear()						{m_bands.clear();};
+	void reset();						//Forget the history (new song, seek, etc)
+
+	//Update every band from this spectrum and fire their callbacks
+	void update(const float* spec, uint32_t iBars, float32 dt);
+};
+
+#endif
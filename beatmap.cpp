@@ -0,0 +1,491 @@
+/*
+	Pony48 source - beatmap.cpp
+	Copyright (c) 2014 Mark Hutcheson
+*/
+
+#include "beatmap.h"
+#include "fft.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+
+#define BEATMAP_DECODE_CHUNK	65536	//Bytes to read from FMOD at a time
+#define BEATMAP_FLUX_COMPRESS	1000.0f	//Flux is computed on log(1 + this * magnitude), so quiet parts count too
+
+BeatMap::BeatMap()
+{
+	clear();
+}
+
+void BeatMap::clear()
+{
+	m_fHopSec = (float32)BEATMAP_HOP / 44100.0f;
+	m_iHops = 0;
+	m_lBands.clear();
+	m_lOnsets.clear();
+	m_lBeats.clear();
+	m_fBPM = 0.0f;
+	m_fRate = 44100.0f;
+	m_iSourceSize = 0;
+	_setBands();
+}
+
+void BeatMap::_setBands()
+{
+	//Log-spaced from BEATMAP_MIN_FREQ up to Nyquist
+	float32 fTop = m_fRate / 2.0f;
+	for(uint32_t i = 0; i <= BEATMAP_BANDS; i++)
+		m_fBandFreq[i] = BEATMAP_MIN_FREQ * pow(fTop / BEATMAP_MIN_FREQ, (float32)i / (float32)BEATMAP_BANDS);
+	m_fBandFreq[0] = 0.0f;	//Lowest band gets everything down to DC
+}
+
+static uint32_t _fileSize(string sFilename)
+{
+	ifstream ifs(sFilename.c_str(), ios_base::binary | ios_base::ate);
+	if(ifs.fail())
+		return 0;
+	return (uint32_t)ifs.tellg();
+}
+
+bool BeatMap::loadCache(string sAudioFile)
+{
+	if(load(sAudioFile + BEATMAP_EXT) && m_iSourceSize == _fileSize(sAudioFile))
+		return true;
+	clear();
+	return false;
+}
+
+bool BeatMap::loadOrAnalyze(FMOD_SYSTEM* sys, string sAudioFile, bool bForce)
+{
+	if(!bForce && loadCache(sAudioFile))
+		return true;
+
+	if(!analyze(sys, sAudioFile))
+		return false;
+	m_iSourceSize = _fileSize(sAudioFile);
+	save(sAudioFile + BEATMAP_EXT);
+	return true;
+}
+
+void BeatMap::swap(BeatMap& other)
+{
+	std::swap(m_fHopSec, other.m_fHopSec);
+	std::swap(m_iHops, other.m_iHops);
+	m_lBands.swap(other.m_lBands);
+	m_lOnsets.swap(other.m_lOnsets);
+	m_lBeats.swap(other.m_lBeats);
+	std::swap(m_fBPM, other.m_fBPM);
+	std::swap(m_fRate, other.m_fRate);
+	std::swap(m_iSourceSize, other.m_iSourceSize);
+	_setBands();
+	other._setBands();
+}
+
+//-------------------------------------------------------------------------------------
+// Analysis
+//-------------------------------------------------------------------------------------
+bool BeatMap::_decode(FMOD_SYSTEM* sys, string sAudioFile, vector<float>* lSamples, float* fRate)
+{
+	FMOD_SOUND* sound = NULL;
+	if(sys == NULL || FMOD_System_CreateSound(sys, sAudioFile.c_str(), FMOD_OPENONLY | FMOD_ACCURATETIME | FMOD_SOFTWARE, 0, &sound) != FMOD_OK)
+	{
+		errlog(LOG_ERROR) << "Unable to open " << sAudioFile << " for beat analysis" << endl;
+		return false;
+	}
+
+	FMOD_SOUND_TYPE type;
+	FMOD_SOUND_FORMAT format;
+	int channels = 0, bits = 0;
+	FMOD_Sound_GetFormat(sound, &type, &format, &channels, &bits);
+	FMOD_Sound_GetDefaults(sound, fRate, NULL, NULL, NULL);
+	if(channels < 1 || (format != FMOD_SOUND_FORMAT_PCM16 && format != FMOD_SOUND_FORMAT_PCMFLOAT && format != FMOD_SOUND_FORMAT_PCM8))
+	{
+		errlog(LOG_ERROR) << "Unsupported sample format in " << sAudioFile << " for beat analysis" << endl;
+		FMOD_Sound_Release(sound);
+		return false;
+	}
+
+	unsigned int iLen = 0;
+	FMOD_Sound_GetLength(sound, &iLen, FMOD_TIMEUNIT_PCM);
+	lSamples->clear();
+	lSamples->reserve(iLen);
+
+	//Read it all in, mixing down to mono as we go
+	uint32_t iFrameBytes = channels * bits / 8;
+	vector<char> lBuf(BEATMAP_DECODE_CHUNK - BEATMAP_DECODE_CHUNK % iFrameBytes);
+	for(;;)
+	{
+		unsigned int iRead = 0;
+		FMOD_RESULT res = FMOD_Sound_ReadData(sound, &lBuf[0], lBuf.size(), &iRead);
+		uint32_t iFrames = iRead / iFrameBytes;
+		for(uint32_t i = 0; i < iFrames; i++)
+		{
+			float f = 0.0f;
+			for(int c = 0; c < channels; c++)
+			{
+				uint32_t iSample = i * channels + c;
+				if(format == FMOD_SOUND_FORMAT_PCM16)
+					f += ((const int16_t*)&lBuf[0])[iSample] / 32768.0f;
+				else if(format == FMOD_SOUND_FORMAT_PCMFLOAT)
+					f += ((const float*)&lBuf[0])[iSample];
+				else
+					f += ((const int8_t*)&lBuf[0])[iSample] / 128.0f;
+			}
+			lSamples->push_back(f / channels);
+		}
+		if(res != FMOD_OK || iRead < lBuf.size())
+			break;	//FMOD_ERR_FILE_EOF, or something went wrong; either way we've got all we're getting
+	}
+	FMOD_Sound_Release(sound);
+	return lSamples->size() > 0;
+}
+
+bool BeatMap::analyze(FMOD_SYSTEM* sys, string sAudioFile)
+{
+	Uint32 iStart = SDL_GetTicks();
+	vector<float> lSamples;
+	float fRate = 44100.0f;
+	clear();
+	if(!_decode(sys, sAudioFile, &lSamples, &fRate))
+		return false;
+	_analyze(lSamples, fRate);
+	errlog << "Analyzed " << sAudioFile << " in " << SDL_GetTicks() - iStart << "ms: " << m_lOnsets.size() << " onsets, "
+		<< m_lBeats.size() << " beats at " << m_fBPM << " BPM" << endl;
+	return true;
+}
+
+void BeatMap::_analyze(const vector<float>& lSamples, float fRate)
+{
+	m_fRate = fRate;
+	m_fHopSec = (float32)BEATMAP_HOP / fRate;
+	m_iHops = (lSamples.size() + BEATMAP_HOP - 1) / BEATMAP_HOP;
+	_setBands();
+
+	//Which FFT bins go in which band. Narrow low bands may share a bin with their neighbors
+	const uint32_t iBins = BEATMAP_WINDOW / 2;
+	float32 fBinHz = fRate / BEATMAP_WINDOW;
+	uint32_t iBandLo[BEATMAP_BANDS], iBandHi[BEATMAP_BANDS];
+	for(uint32_t b = 0; b < BEATMAP_BANDS; b++)
+	{
+		iBandLo[b] = min((uint32_t)(m_fBandFreq[b] / fBinHz), iBins - 1);
+		iBandHi[b] = min((uint32_t)(m_fBandFreq[b+1] / fBinHz), iBins);
+		if(iBandHi[b] <= iBandLo[b])
+			iBandHi[b] = iBandLo[b] + 1;
+	}
+
+	vector<float> lWindow(BEATMAP_WINDOW), lBlock(BEATMAP_WINDOW), lRe(BEATMAP_WINDOW), lIm(BEATMAP_WINDOW);
+	vector<float> lMag(iBins), lPrevLog(iBins, 0.0f);
+	vector<float> lFlux(m_iHops, 0.0f);
+	hannWindow(&lWindow[0], BEATMAP_WINDOW);
+	m_lBands.resize(m_iHops * BEATMAP_BANDS);
+
+	for(uint32_t h = 0; h < m_iHops; h++)
+	{
+		//Block starting at this hop, zero-padded past the end of the song
+		uint32_t iStart = h * BEATMAP_HOP;
+		uint32_t iAvail = min((uint32_t)lSamples.size() - iStart, (uint32_t)BEATMAP_WINDOW);
+		memcpy(&lBlock[0], &lSamples[iStart], iAvail * sizeof(float));
+		if(iAvail < BEATMAP_WINDOW)
+			memset(&lBlock[iAvail], 0, (BEATMAP_WINDOW - iAvail) * sizeof(float));
+		magnitudeSpectrum(&lBlock[0], &lWindow[0], &lRe[0], &lIm[0], &lMag[0], BEATMAP_WINDOW);
+
+		//Band amplitudes, square-root companded into a byte each
+		uint8_t* bands = &m_lBands[h * BEATMAP_BANDS];
+		for(uint32_t b = 0; b < BEATMAP_BANDS; b++)
+		{
+			float fPower = 0.0f;
+			for(uint32_t k = iBandLo[b]; k < iBandHi[b]; k++)
+				fPower += lMag[k] * lMag[k];
+			float fAmp = min(sqrt(fPower), 1.0f);
+			bands[b] = (uint8_t)(sqrt(fAmp) * 255.0f + 0.5f);
+		}
+
+		//Spectral flux: how much louder each bin got since last hop
+		float fFlux = 0.0f;
+		for(uint32_t k = 0; k < iBins; k++)
+		{
+			float fLog = log(1.0f + BEATMAP_FLUX_COMPRESS * lMag[k]);
+			if(fLog > lPrevLog[k])
+				fFlux += fLog - lPrevLog[k];
+			lPrevLog[k] = fLog;
+		}
+		lFlux[h] = (h > 0) ? fFlux : 0.0f;	//First hop is all "new"; don't call it an onset
+	}
+
+	//Onsets: local peaks in flux, well above the flux around them
+	float32 fCenter = (BEATMAP_WINDOW / 2) / fRate;	//A hop's time is the middle of its window
+	float32 fLastOnset = -BEATMAP_ONSET_MIN_GAP;
+	float fFluxSum = 0.0f;
+	uint32_t iWindowLo = 0, iWindowHi = 0;	//Running sum over [iWindowLo, iWindowHi)
+	for(uint32_t h = 0; h < m_iHops; h++)
+	{
+		uint32_t lo = (h > BEATMAP_ONSET_WINDOW) ? h - BEATMAP_ONSET_WINDOW : 0;
+		uint32_t hi = min(h + BEATMAP_ONSET_WINDOW + 1, m_iHops);
+		for(; iWindowHi < hi; iWindowHi++)
+			fFluxSum += lFlux[iWindowHi];
+		for(; iWindowLo < lo; iWindowLo++)
+			fFluxSum -= lFlux[iWindowLo];
+		float fThreshold = fFluxSum / (hi - lo) * BEATMAP_ONSET_MUL;
+
+		if(lFlux[h] <= fThreshold || (h > 0 && lFlux[h] < lFlux[h-1]) || (h + 1 < m_iHops && lFlux[h] <= lFlux[h+1]))
+			continue;
+		float32 fTime = h * m_fHopSec + fCenter;
+		if(fTime - fLastOnset < BEATMAP_ONSET_MIN_GAP)
+			continue;
+		m_lOnsets.push_back(fTime);
+		fLastOnset = fTime;
+	}
+
+	_findTempo(lFlux);
+}
+
+void BeatMap::_findTempo(const vector<float>& lFlux)
+{
+	if(m_iHops < 2)
+		return;
+
+	//Autocorrelate the (zero-mean) flux over the lags we'd believe as beat periods
+	float fMean = 0.0f;
+	for(uint32_t h = 0; h < m_iHops; h++)
+		fMean += lFlux[h];
+	fMean /= m_iHops;
+	vector<float> lCentered(m_iHops);
+	for(uint32_t h = 0; h < m_iHops; h++)
+		lCentered[h] = lFlux[h] - fMean;
+
+	uint32_t iMinLag = max((uint32_t)(60.0f / BEATMAP_MAX_BPM / m_fHopSec), (uint32_t)1);
+	uint32_t iMaxLag = min((uint32_t)(60.0f / BEATMAP_MIN_BPM / m_fHopSec) + 1, m_iHops - 1);
+	if(iMaxLag <= iMinLag + 1)
+		return;
+	vector<float> lCorr(iMaxLag + 1, 0.0f);
+	uint32_t iBest = iMinLag;
+	float fBest = -FLT_MAX;
+	for(uint32_t lag = iMinLag; lag <= iMaxLag; lag++)
+	{
+		float fSum = 0.0f;
+		for(uint32_t h = lag; h < m_iHops; h++)
+			fSum += lCentered[h] * lCentered[h - lag];
+		lCorr[lag] = fSum / (m_iHops - lag);
+
+		//Lean towards 120 BPM (log-Gaussian), so we don't pick double or half the actual tempo
+		float fOctaves = log(60.0f / (lag * m_fHopSec) / 120.0f) / log(2.0f);
+		float fWeighted = lCorr[lag] * exp(-0.5f * fOctaves * fOctaves);
+		if(fWeighted > fBest)
+		{
+			fBest = fWeighted;
+			iBest = lag;
+		}
+	}
+
+	//Fractional lag from a parabola through the peak, so beats don't drift over a whole song
+	float fLag = iBest;
+	if(iBest > iMinLag && iBest < iMaxLag)
+	{
+		float a = lCorr[iBest-1], b = lCorr[iBest], c = lCorr[iBest+1];
+		float fDenom = a - 2.0f * b + c;
+		if(fDenom < 0.0f)
+			fLag += 0.5f * (a - c) / fDenom;
+	}
+	m_fBPM = 60.0f / (fLag * m_fHopSec);
+
+	//Phase: whichever offset into the first period lines up with the most flux
+	uint32_t iPeriod = (uint32_t)(fLag + 0.5f);
+	uint32_t iPhase = 0;
+	fBest = -FLT_MAX;
+	for(uint32_t p = 0; p < iPeriod; p++)
+	{
+		float fSum = 0.0f;
+		for(float h = p; h < m_iHops; h += fLag)
+			fSum += lFlux[(uint32_t)h];
+		if(fSum > fBest)
+		{
+			fBest = fSum;
+			iPhase = p;
+		}
+	}
+
+	//Step through the song a period at a time, nudging each beat onto the strongest flux nearby
+	float32 fCenter = (BEATMAP_WINDOW / 2) / m_fRate;
+	int iSlack = max((int)(fLag * 0.1f), 1);
+	for(float h = iPhase; h < m_iHops; h += fLag)
+	{
+		int iBeat = (int)(h + 0.5f);
+		int iPeak = iBeat;
+		for(int j = max(iBeat - iSlack, 0); j <= min(iBeat + iSlack, (int)m_iHops - 1); j++)
+		{
+			if(lFlux[j] > lFlux[iPeak])
+				iPeak = j;
+		}
+		m_lBeats.push_back(iPeak * m_fHopSec + fCenter);
+		h += iPeak - iBeat;	//Follow the music if it's drifting
+	}
+}
+
+//-------------------------------------------------------------------------------------
+// Cache files
+//-------------------------------------------------------------------------------------
+bool BeatMap::save(string sFilename) const
+{
+	ofstream ofs(sFilename.c_str(), ios_base::binary);
+	if(ofs.fail())
+	{
+		errlog(LOG_WARN) << "Unable to write beat map cache " << sFilename << endl;
+		return false;
+	}
+	uint32_t iMagic = BEATMAP_MAGIC;
+	uint32_t iVersion = BEATMAP_VERSION;
+	uint32_t iOnsets = m_lOnsets.size();
+	uint32_t iBeats = m_lBeats.size();
+	ofs.write((const char*)&iMagic, sizeof(iMagic));
+	ofs.write((const char*)&iVersion, sizeof(iVersion));
+	ofs.write((const char*)&m_iSourceSize, sizeof(m_iSourceSize));
+	ofs.write((const char*)&m_fRate, sizeof(m_fRate));
+	ofs.write((const char*)&m_iHops, sizeof(m_iHops));
+	ofs.write((const char*)&m_fBPM, sizeof(m_fBPM));
+	ofs.write((const char*)&iOnsets, sizeof(iOnsets));
+	ofs.write((const char*)&iBeats, sizeof(iBeats));
+	if(m_lBands.size())
+		ofs.write((const char*)&m_lBands[0], m_lBands.size());
+	if(iOnsets)
+		ofs.write((const char*)&m_lOnsets[0], iOnsets * sizeof(float32));
+	if(iBeats)
+		ofs.write((const char*)&m_lBeats[0], iBeats * sizeof(float32));
+	return true;
+}
+
+bool BeatMap::load(string sFilename)
+{
+	clear();
+	ifstream ifs(sFilename.c_str(), ios_base::binary);
+	if(ifs.fail())
+		return false;
+	uint32_t iMagic = 0, iVersion = 0, iOnsets = 0, iBeats = 0;
+	ifs.read((char*)&iMagic, sizeof(iMagic));
+	ifs.read((char*)&iVersion, sizeof(iVersion));
+	if(iMagic != BEATMAP_MAGIC || iVersion != BEATMAP_VERSION)
+		return false;	//Old cache; redo it
+	ifs.read((char*)&m_iSourceSize, sizeof(m_iSourceSize));
+	ifs.read((char*)&m_fRate, sizeof(m_fRate));
+	ifs.read((char*)&m_iHops, sizeof(m_iHops));
+	ifs.read((char*)&m_fBPM, sizeof(m_fBPM));
+	ifs.read((char*)&iOnsets, sizeof(iOnsets));
+	ifs.read((char*)&iBeats, sizeof(iBeats));
+	if(ifs.fail() || m_fRate <= 0.0f)
+	{
+		clear();
+		return false;
+	}
+	m_fHopSec = (float32)BEATMAP_HOP / m_fRate;
+	_setBands();
+	m_lBands.resize(m_iHops * BEATMAP_BANDS);
+	m_lOnsets.resize(iOnsets);
+	m_lBeats.resize(iBeats);
+	if(m_lBands.size())
+		ifs.read((char*)&m_lBands[0], m_lBands.size());
+	if(iOnsets)
+		ifs.read((char*)&m_lOnsets[0], iOnsets * sizeof(float32));
+	if(iBeats)
+		ifs.read((char*)&m_lBeats[0], iBeats * sizeof(float32));
+	if(ifs.fail())
+	{
+		errlog(LOG_WARN) << "Beat map cache " << sFilename << " is truncated" << endl;
+		clear();
+		return false;
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+// Lookups
+//-------------------------------------------------------------------------------------
+const uint8_t* BeatMap::_hop(float32 fSec) const
+{
+	float32 fCenter = (BEATMAP_WINDOW / 2) / m_fRate;
+	int h = (int)((fSec - fCenter) / m_fHopSec + 0.5f);
+	if(h < 0)
+		h = 0;
+	if(h >= (int)m_iHops)
+		h = m_iHops - 1;
+	return &m_lBands[h * BEATMAP_BANDS];
+}
+
+float32 BeatMap::band(uint32_t iBand, float32 fSec) const
+{
+	if(!m_iHops || iBand >= BEATMAP_BANDS)
+		return 0.0f;
+	float32 f = _hop(fSec)[iBand] / 255.0f;
+	return f * f;
+}
+
+void BeatMap::spectrum(float32 fSec, float* spec, uint32_t iBins) const
+{
+	if(!m_iHops)
+	{
+		memset(spec, 0, iBins * sizeof(float));
+		return;
+	}
+	const uint8_t* bands = _hop(fSec);
+	float32 fBinHz = m_fRate / 2.0f / iBins;
+	uint32_t b = 0;
+	for(uint32_t i = 0; i < iBins; i++)
+	{
+		//Treat each band's power as spread evenly across it, and add up this bin's share of every band it overlaps.
+		//Low bins span several narrow bands, so bar 0 still gets the kick and bass below its center
+		float32 fLo = i * fBinHz;
+		float32 fHi = fLo + fBinHz;
+		while(b < BEATMAP_BANDS - 1 && m_fBandFreq[b+1] <= fLo)
+			b++;
+		float32 fPower = 0.0f;
+		for(uint32_t j = b; j < BEATMAP_BANDS && m_fBandFreq[j] < fHi; j++)
+		{
+			float32 fOverlap = min(fHi, m_fBandFreq[j+1]) - max(fLo, m_fBandFreq[j]);
+			if(fOverlap <= 0.0f)
+				continue;
+			float32 f = bands[j] / 255.0f;
+			float32 fAmp = f * f;
+			fPower += fAmp * fAmp * fOverlap / (m_fBandFreq[j+1] - m_fBandFreq[j]);
+		}
+		spec[i] = min((float32)sqrt(fPower), 1.0f);	//FMOD's spectrum tops out at 1 too
+	}
+}
+
+uint32_t BeatMap::onsetsBetween(float32 fStart, float32 fEnd) const
+{
+	if(fEnd <= fStart)
+		return 0;
+	return lower_bound(m_lOnsets.begin(), m_lOnsets.end(), fEnd) - lower_bound(m_lOnsets.begin(), m_lOnsets.end(), fStart);
+}
+
+uint32_t BeatMap::beatsBetween(float32 fStart, float32 fEnd) const
+{
+	if(fEnd <= fStart)
+		return 0;
+	return lower_bound(m_lBeats.begin(), m_lBeats.end(), fEnd) - lower_bound(m_lBeats.begin(), m_lBeats.end(), fStart);
+}
+
+float32 BeatMap::beatPhase(float32 fSec) const
+{
+	vector<float32>::const_iterator i = upper_bound(m_lBeats.begin(), m_lBeats.end(), fSec);
+	if(i == m_lBeats.begin() || i == m_lBeats.end())
+		return 0.0f;
+	float32 fPrev = *(i - 1);
+	return (fSec - fPrev) / (*i - fPrev);
+}
+
+float32 BeatMap::beatTime(float32 fBeat) const
+{
+	if(m_fBPM <= 0.0f || m_lBeats.empty())
+		return -1.0f;
+	float32 fBeatLen = 60.0f / m_fBPM;
+	
+	//Off either end of the beats we found, carry on at the song's tempo
+	if(fBeat <= 0.0f)
+		return max(m_lBeats.front() + fBeat * fBeatLen, 0.0f);
+	uint32_t iLast = m_lBeats.size() - 1;
+	if(fBeat >= iLast)
+		return m_lBeats[iLast] + (fBeat - iLast) * fBeatLen;
+	
+	uint32_t i = (uint32_t)fBeat;
+	return m_lBeats[i] + (fBeat - i) * (m_lBeats[i+1] - m_lBeats[i]);
+}
@@ -0,0 +1,70 @@
+/*
+	Pony48 header - beatmap.h
+	Offline analysis of a song's onsets, beats, and per-band energy, cached next to the song
+	Copyright (c) 2014 Mark Hutcheson
+*/
+#ifndef BEATMAP_H
+#define BEATMAP_H
+
+#include "globaldefs.h"
+#include <fmod.h>
+#include <vector>
+
+#define BEATMAP_MAGIC		0x42383450	//"P48B"
+#define BEATMAP_VERSION		1			//Bump whenever analysis changes, so old caches get redone
+#define BEATMAP_EXT			".beats"	//Cache file is the song's audio file plus this
+#define BEATMAP_BANDS		16			//Log-spaced frequency bands we keep energy for
+#define BEATMAP_WINDOW		1024		//Samples per FFT (power of 2)
+#define BEATMAP_HOP			512			//Samples between FFTs
+#define BEATMAP_MIN_FREQ	40.0f		//Bottom of the lowest band, in Hz
+#define BEATMAP_ONSET_WINDOW	8		//Hops either side used for the onset threshold's moving average
+#define BEATMAP_ONSET_MUL	1.5f		//Flux has to be this many times its local average to count as an onset...
+#define BEATMAP_ONSET_MIN_GAP	0.05f	//...and this many seconds from the last one
+#define BEATMAP_MIN_BPM		60.0f
+#define BEATMAP_MAX_BPM		200.0f
+
+class BeatMap
+{
+	float32 m_fHopSec;				//Seconds per hop
+	uint32_t m_iHops;
+	vector<uint8_t> m_lBands;		//BEATMAP_BANDS per hop. Amplitude = (v/255)^2, 1 being a full-scale sine
+	vector<float32> m_lOnsets;		//Seconds, ascending
+	vector<float32> m_lBeats;		//Seconds, ascending
+	float32 m_fBPM;
+	float32 m_fBandFreq[BEATMAP_BANDS+1];	//Band edges in Hz
+	float32 m_fRate;				//Sample rate of the song
+	uint32_t m_iSourceSize;			//Size of the audio file we analyzed, so we notice if it's replaced
+
+	bool _decode(FMOD_SYSTEM* sys, string sAudioFile, vector<float>* lSamples, float* fRate);	//To mono floats
+	void _analyze(const vector<float>& lSamples, float fRate);
+	void _findTempo(const vector<float>& lFlux);
+	void _setBands();
+	const uint8_t* _hop(float32 fSec) const;
+
+public:
+	BeatMap();
+
+	void clear();
+	bool valid() const					{return m_iHops > 0;};
+
+	//Load the cache for this audio file, or analyze it (and write the cache) if there isn't an up-to-date one
+	bool loadOrAnalyze(FMOD_SYSTEM* sys, string sAudioFile, bool bForce = false);
+	bool loadCache(string sAudioFile);	//Just the loading half of that. Doesn't touch FMOD, so any thread can do it
+	void swap(BeatMap& other);
+	bool analyze(FMOD_SYSTEM* sys, string sAudioFile);
+	bool load(string sFilename);
+	bool save(string sFilename) const;
+
+	//Lookups by song position; all cheap enough to do every frame
+	float32 band(uint32_t iBand, float32 fSec) const;		//Amplitude of a band (0-1ish)
+	float32 bandFreq(uint32_t iBand) const	{return m_fBandFreq[iBand];};	//Lower edge of a band, in Hz
+	void spectrum(float32 fSec, float* spec, uint32_t iBins) const;	//Resample bands to iBins linear bins up to Nyquist, like FMOD's spectrum
+	uint32_t onsetsBetween(float32 fStart, float32 fEnd) const;	//Onsets in [fStart, fEnd)
+	uint32_t beatsBetween(float32 fStart, float32 fEnd) const;	//Beats in [fStart, fEnd)
+	float32 beatPhase(float32 fSec) const;					//0 on a beat, rising to 1 just before the next
+	float32 beatTime(float32 fBeat) const;					//Song position of a beat (0 being the first one; fractions are in between). < 0 if we don't know
+	float32 getBPM() const				{return m_fBPM;};
+	float32 getLength() const			{return m_iHops * m_fHopSec;};
+};
+
+#endif
@@ -0,0 +1,521 @@
+/*
+	Pony48 source - bench.cpp
+	Microbenchmarks for the game's hot paths. Build and run with "make bench"; results are written as JSON
+	Copyright (c) 2014 Mark Hutcheson
+*/
+
+#include "Pony48.h"
+#include "bg.h"
+#include "arc.h"
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include <cfloat>
+
+#ifdef _WIN32
+#define ICONNAME "res/icons/icon_32.png"
+#else
+#define ICONNAME "res/icons/icon_256.png"
+#endif
+
+#define BENCH_SAMPLES		15		//Timed runs per benchmark. We report the median, plus min and max
+#define BENCH_SAMPLE_MS		20		//Each run repeats the benchmark until it takes at least this long
+#define BENCH_SEED			48		//Reseed rand() before each benchmark, so every run does the same work
+#define BENCH_DT			(1.0f/60.0f)
+#define BENCH_SPECTRA		600		//Frames of synthetic spectrum data (10 seconds at 60fps)
+#define BENCH_SPECTRA_BPM	120
+#define BENCH_BEAT_BANDS	8		//Bands watched in beat_detect_playing
+#define BENCH_COLORS		64		//Colors phasing at once for updateColors()
+#define BENCH_SONG			"res/mus/justfluttershy.mp3"
+#define BENCH_LOOP_START	23.259f	//Loop a couple seconds of it, so looping comes up often
+#define BENCH_LOOP_END		25.259f
+#define BENCH_SCRUB_STEPS	90		//Steps between scrubbing the music to a stop and back
+
+typedef struct
+{
+	string name;
+	uint32_t iters;			//Iterations per timed sample
+	double nsMedian, nsMin, nsMax;	//Per iteration
+} benchResult;
+
+class Pony48Bench
+{
+	typedef void (Pony48Bench::*benchFunc)(uint32_t iters);
+
+	Pony48Engine* m_eng;
+	vector<benchResult> m_results;
+	volatile uint32_t m_iSink;	//So the compiler can't throw away results we don't otherwise use
+
+	//State shared between a benchmark's setup and its run
+	uint32_t m_iParticles;
+	ParticleSystem* m_particles;
+	Text* m_txt;
+	TextLayout m_layout;
+	vector<string> m_lStrings;
+	vector<string> m_lXMLFiles;
+	starfieldBg* m_starfield;
+	Color m_colors[BENCH_COLORS];
+	vector<float> m_spectra;
+	gameMode m_prevMode;
+	uint32_t m_iStep;
+
+	void _run(const char* cName, benchFunc run, benchFunc setup = NULL, benchFunc teardown = NULL);
+	double _time(benchFunc run, uint32_t iters);
+
+	//Benchmarks
+	void _boardSetup(uint32_t);
+	void _boardMove(uint32_t iters);
+	void _boardFullSetup(uint32_t);
+	void _boardGameOver(uint32_t iters);
+	void _boardTeardown(uint32_t);
+	void _particleSetup(uint32_t);
+	void _particleUpdate(uint32_t iters);
+	void _particleTeardown(uint32_t);
+	void _textSize(uint32_t iters);
+	void _textLayout(uint32_t iters);
+	void _xmlHUD(uint32_t iters);
+	void _xmlParticles(uint32_t iters);
+	void _arcUpdate(uint32_t iters);
+	void _starfieldSetup(uint32_t);
+	void _starfieldUpdate(uint32_t iters);
+	void _starfieldTeardown(uint32_t);
+	void _colorSetup(uint32_t);
+	void _colorUpdate(uint32_t iters);
+	void _colorTeardown(uint32_t);
+	void _beatPlayingSetup(uint32_t);
+	void _beatMenuSetup(uint32_t);
+	void _beatDetect(uint32_t iters);
+	void _beatTeardown(uint32_t);
+	void _songSetup(uint32_t);
+	void _songStep(uint32_t iters);
+	void _songTeardown(uint32_t);
+
+public:
+	Pony48Bench(Pony48Engine* eng);	//Initializes the engine as if the game were starting
+	~Pony48Bench();
+
+	void runAll();
+	bool write(string sFilename);	//Write results as JSON
+};
+
+Pony48Bench::Pony48Bench(Pony48Engine* eng)
+{
+	m_eng = eng;
+	list<commandlineArg> lArgs;
+	m_eng->init(lArgs);	//Load everything the game would, without starting the main loop
+	m_iSink = 0;
+	m_iParticles = 0;
+	m_particles = NULL;
+	m_starfield = NULL;
+	m_prevMode = eng->m_iCurMode;
+	m_iStep = 0;
+	m_txt = new Text("res/font/CelestiaMediumRedux.xml");
+
+	//The kind of strings the HUD actually shows
+	m_lStrings.push_back("SCORE: 0");
+	m_lStrings.push_back("SCORE: 248160");
+	m_lStrings.push_back("BEST: 1048576");
+	m_lStrings.push_back("GAME OVER");
+	m_lStrings.push_back("Press Esc to quit, A to view achievements");
+	m_lStrings.push_back("by Some Artist With A Long Name");
+
+	ttvfs::StringList lFiles;
+	ttvfs::GetFileList("res/particles", lFiles);
+	for(ttvfs::StringList::iterator i = lFiles.begin(); i != lFiles.end(); i++)
+	{
+		if(i->size() > 4 && i->substr(i->size() - 4) == ".xml")
+			m_lXMLFiles.push_back("res/particles/" + *i);
+	}
+	sort(m_lXMLFiles.begin(), m_lXMLFiles.end());
+
+	//Fake spectra: falling off with frequency, noise on top, and a kick in the low bars on every beat
+	m_spectra.resize(BENCH_SPECTRA * SPECTRUM_SIZE);
+	srand(BENCH_SEED);
+	uint32_t iFramesPerBeat = 60 * 60 / BENCH_SPECTRA_BPM;
+	for(uint32_t i = 0; i < BENCH_SPECTRA; i++)
+	{
+		float fKick = 1.0f - (float)(i % iFramesPerBeat) / (float)iFramesPerBeat;
+		fKick *= fKick;
+		for(uint32_t j = 0; j < SPECTRUM_SIZE; j++)
+		{
+			float f = 0.5f / (1.0f + j) + randFloat(0.0f, 0.05f);
+			if(j < 4)
+				f += fKick;
+			m_spectra[i * SPECTRUM_SIZE + j] = f;
+		}
+	}
+}
+
+Pony48Bench::~Pony48Bench()
+{
+	delete m_txt;
+}
+
+double Pony48Bench::_time(benchFunc run, uint32_t iters)
+{
+	Uint64 iStart = SDL_GetPerformanceCounter();
+	(this->*run)(iters);
+	Uint64 iEnd = SDL_GetPerformanceCounter();
+	return (double)(iEnd - iStart) * 1000000000.0 / (double)SDL_GetPerformanceFrequency();	//ns
+}
+
+void Pony48Bench::_run(const char* cName, benchFunc run, benchFunc setup, benchFunc teardown)
+{
+	srand(BENCH_SEED);
+	if(setup)
+		(this->*setup)(0);
+
+	//Figure out how many iterations make a long enough sample for the timer to be meaningful
+	uint32_t iters = 1;
+	while(_time(run, iters) < BENCH_SAMPLE_MS * 1000000.0 && iters < (1 << 30))
+		iters *= 2;
+
+	vector<double> lSamples;
+	for(int i = 0; i < BENCH_SAMPLES; i++)
+		lSamples.push_back(_time(run, iters) / (double)iters);
+	sort(lSamples.begin(), lSamples.end());
+
+	if(teardown)
+		(this->*teardown)(0);
+
+	benchResult res;
+	res.name = cName;
+	res.iters = iters;
+	res.nsMedian = lSamples[lSamples.size() / 2];
+	res.nsMin = lSamples.front();
+	res.nsMax = lSamples.back();
+	m_results.push_back(res);
+	printf("%-28s %12.1f ns/op  (min %.1f, max %.1f, %u iterations)\n", cName, res.nsMedian, res.nsMin, res.nsMax, iters);
+	fflush(stdout);
+}
+
+void Pony48Bench::runAll()
+{
+	_run("board_move", &Pony48Bench::_boardMove, &Pony48Bench::_boardSetup, &Pony48Bench::_boardTeardown);
+	_run("board_gameover_check", &Pony48Bench::_boardGameOver, &Pony48Bench::_boardFullSetup, &Pony48Bench::_boardTeardown);
+	m_iParticles = 100;
+	_run("particles_update_100", &Pony48Bench::_particleUpdate, &Pony48Bench::_particleSetup, &Pony48Bench::_particleTeardown);
+	m_iParticles = 1000;
+	_run("particles_update_1000", &Pony48Bench::_particleUpdate, &Pony48Bench::_particleSetup, &Pony48Bench::_particleTeardown);
+	m_iParticles = 10000;
+	_run("particles_update_10000", &Pony48Bench::_particleUpdate, &Pony48Bench::_particleSetup, &Pony48Bench::_particleTeardown);
+	_run("text_size", &Pony48Bench::_textSize);
+	_run("text_layout", &Pony48Bench::_textLayout);
+	_run("xml_parse_hud", &Pony48Bench::_xmlHUD);
+	_run("xml_parse_particles", &Pony48Bench::_xmlParticles);
+	_run("arc_update", &Pony48Bench::_arcUpdate);
+	_run("starfield_update", &Pony48Bench::_starfieldUpdate, &Pony48Bench::_starfieldSetup, &Pony48Bench::_starfieldTeardown);
+	_run("update_colors", &Pony48Bench::_colorUpdate, &Pony48Bench::_colorSetup, &Pony48Bench::_colorTeardown);
+	_run("beat_detect_playing", &Pony48Bench::_beatDetect, &Pony48Bench::_beatPlayingSetup, &Pony48Bench::_beatTeardown);
+	_run("beat_detect_menu", &Pony48Bench::_beatDetect, &Pony48Bench::_beatMenuSetup, &Pony48Bench::_beatTeardown);
+	_run("song_step_nrt", &Pony48Bench::_songStep, &Pony48Bench::_songSetup, &Pony48Bench::_songTeardown);
+}
+
+bool Pony48Bench::write(string sFilename)
+{
+	ofstream ofs(sFilename.c_str());
+	if(ofs.fail())
+	{
+		errlog(LOG_ERROR) << "Unable to open " << sFilename << " to write benchmark results" << endl;
+		return false;
+	}
+	ofs.precision(1);
+	ofs << fixed << "{\"samples\":" << BENCH_SAMPLES << ",\"sample_ms\":" << BENCH_SAMPLE_MS;
+#ifdef DEBUG
+	ofs << ",\"build\":\"debug\"";
+#else
+	ofs << ",\"build\":\"release\"";
+#endif
+	ofs << ",\"benchmarks\":[";
+	for(uint32_t i = 0; i < m_results.size(); i++)
+	{
+		const benchResult& res = m_results[i];
+		ofs << (i ? ",\n" : "\n") << "{\"name\":\"" << res.name << "\",\"iterations\":" << res.iters
+			<< ",\"ns_per_op\":" << res.nsMedian << ",\"ns_min\":" << res.nsMin << ",\"ns_max\":" << res.nsMax << "}";
+	}
+	ofs << "\n]}" << endl;
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+// Board
+//-------------------------------------------------------------------------------------
+void Pony48Bench::_boardSetup(uint32_t)
+{
+	m_prevMode = m_eng->m_iCurMode;
+	m_eng->m_iCurMode = PLAYING;
+	m_eng->resetBoard();
+}
+
+void Pony48Bench::_boardMove(uint32_t iters)
+{
+	//Cycle through directions like a (not very good) player would, starting over whenever the game ends
+	for(uint32_t i = 0; i < iters; i++)
+	{
+		m_eng->move((direction)(i & 3));
+		if(!m_eng->movePossible())
+			m_eng->resetBoard();
+	}
+}
+
+void Pony48Bench::_boardFullSetup(uint32_t)
+{
+	//Full board, no two neighbors alike: the worst case for checking if any move is left
+	m_prevMode = m_eng->m_iCurMode;
+	m_eng->clearBoard();
+	for(int i = 0; i < BOARD_HEIGHT; i++)
+	{
+		for(int j = 0; j < BOARD_WIDTH; j++)
+		{
+			m_eng->m_Board[j][i] = new TilePiece();
+			m_eng->m_Board[j][i]->value = ((i + j) & 1) ? 2 : 4;
+		}
+	}
+}
+
+void Pony48Bench::_boardGameOver(uint32_t iters)
+{
+	for(uint32_t i = 0; i < iters; i++)
+		m_iSink += m_eng->movePossible();
+}
+
+void Pony48Bench::_boardTeardown(uint32_t)
+{
+	m_eng->clearBoard();
+	m_eng->m_highestTile = NULL;
+	m_eng->m_iCurMode = m_prevMode;
+}
+
+//-------------------------------------------------------------------------------------
+// Particles
+//-------------------------------------------------------------------------------------
+void Pony48Bench::_particleSetup(uint32_t)
+{
+	//Steady state of m_iParticles alive, with as many spawning and dying every second
+	m_particles = new ParticleSystem();
+	m_particles->fromXML("res/particles/selectsong0.xml");
+	m_particles->spawnOnDeath.clear();
+	m_particles->max = m_iParticles;
+	m_particles->rate = m_iParticles;
+	m_particles->lifetime = 1.0f;
+	m_particles->lifetimeVar = 0.0f;
+	m_particles->decay = FLT_MAX;
+	m_particles->init();
+	m_particles->firing = true;
+	m_particles->show = true;
+	for(int i = 0; i < 120; i++)
+		m_particles->update(BENCH_DT);
+}
+
+void Pony48Bench::_particleUpdate(uint32_t iters)
+{
+	for(uint32_t i = 0; i < iters; i++)
+		m_particles->update(BENCH_DT);
+}
+
+void Pony48Bench::_particleTeardown(uint32_t)
+{
+	delete m_particles;
+	m_particles = NULL;
+}
+
+//-------------------------------------------------------------------------------------
+// Text
+//-------------------------------------------------------------------------------------
+void Pony48Bench::_textSize(uint32_t iters)
+{
+	float32 f = 0;
+	for(uint32_t i = 0; i < iters; i++)
+		f += m_txt->size(m_lStrings[i % m_lStrings.size()], 1.5f);
+	m_iSink += (uint32_t)f;
+}
+
+void Pony48Bench::_textLayout(uint32_t iters)
+{
+	for(uint32_t i = 0; i < iters; i++)
+		m_txt->layout(m_lStrings[i % m_lStrings.size()], 1.5f, &m_layout);
+	m_iSink += m_layout.verts.size();
+}
+
+//-------------------------------------------------------------------------------------
+// XML
+//-------------------------------------------------------------------------------------
+void Pony48Bench::_xmlHUD(uint32_t iters)
+{
+	for(uint32_t i = 0; i < iters; i++)
+	{
+		XMLDocument doc;
+		m_iSink += doc.LoadFile("res/hud.xml");
+	}
+}
+
+void Pony48Bench::_xmlParticles(uint32_t iters)
+{
+	for(uint32_t i = 0; i < iters; i++)
+	{
+		for(vector<string>::iterator j = m_lXMLFiles.begin(); j != m_lXMLFiles.end(); j++)
+		{
+			XMLDocument doc;
+			m_iSink += doc.LoadFile(j->c_str());
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------
+// Menu effects and backgrounds
+//-------------------------------------------------------------------------------------
+void Pony48Bench::_arcUpdate(uint32_t iters)
+{
+	for(uint32_t i = 0; i < iters; i++)
+		m_eng->m_selectedSongArc->update(BENCH_DT);
+}
+
+void Pony48Bench::_starfieldSetup(uint32_t)
+{
+	m_starfield = new starfieldBg();
+	m_starfield->init();
+}
+
+void Pony48Bench::_starfieldUpdate(uint32_t iters)
+{
+	for(uint32_t i = 0; i < iters; i++)
+		m_starfield->update(BENCH_DT);
+}
+
+void Pony48Bench::_starfieldTeardown(uint32_t)
+{
+	delete m_starfield;
+	m_starfield = NULL;
+}
+
+void Pony48Bench::_colorSetup(uint32_t)
+{
+	m_eng->clearColors();
+	for(int i = 0; i < BENCH_COLORS; i++)
+	{
+		m_colors[i].set(randFloat(0,1), randFloat(0,1), randFloat(0,1), 1);
+		m_eng->phaseColor(&m_colors[i], Color(randFloat(0,1), randFloat(0,1), randFloat(0,1), 1.0f), randFloat(0.5f, 2.0f), true);
+	}
+}
+
+void Pony48Bench::_colorUpdate(uint32_t iters)
+{
+	for(uint32_t i = 0; i < iters; i++)
+		m_eng->updateColors(BENCH_DT);
+}
+
+void Pony48Bench::_colorTeardown(uint32_t)
+{
+	m_eng->clearColors();
+}
+
+//-------------------------------------------------------------------------------------
+// Beat detection
+//-------------------------------------------------------------------------------------
+void Pony48Bench::_beatPlayingSetup(uint32_t)
+{
+	m_prevMode = m_eng->m_iCurMode;
+	m_eng->m_iCurMode = PLAYING;
+	
+	//Camera, plus enough extra bands to look like a busy song
+	m_eng->m_songBeats.clear();
+	m_eng->m_songBeats.addBand(0, 0, 0.75, 0, 0.5, Pony48Engine::beatCamera, m_eng, "camera");
+	for(uint32_t i = 1; i < BENCH_BEAT_BANDS; i++)
+		m_eng->m_songBeats.addBand(i * 4, i * 4 + 3, 0.1, 1.5, 1, NULL, NULL);
+}
+
+void Pony48Bench::_beatMenuSetup(uint32_t)
+{
+	m_prevMode = m_eng->m_iCurMode;
+	m_eng->m_iCurMode = SONGSELECT;	//Bounces the menu, arc, and particle rates instead of the camera
+}
+
+void Pony48Bench::_beatDetect(uint32_t iters)
+{
+	for(uint32_t i = 0; i < iters; i++)
+		m_eng->beatDetect(&m_spectra[(i % BENCH_SPECTRA) * SPECTRUM_SIZE], BENCH_DT);
+}
+
+void Pony48Bench::_beatTeardown(uint32_t)
+{
+	m_eng->m_iCurMode = m_prevMode;
+	m_eng->m_songBeats.clear();
+}
+
+//-------------------------------------------------------------------------------------
+// A song playing, with the mixer stepped along with it
+//-------------------------------------------------------------------------------------
+void Pony48Bench::_songSetup(uint32_t)
+{
+	m_prevMode = m_eng->m_iCurMode;
+	m_eng->m_iCurMode = PLAYING;
+	m_eng->m_songBeats.clear();
+	m_eng->m_songBeats.addBand(0, 0, 0.75, 0, 0.5, Pony48Engine::beatCamera, m_eng, "camera");
+	m_eng->playSongMusic(BENCH_SONG);
+	m_eng->musicLoop(BENCH_LOOP_START, BENCH_LOOP_END);
+	m_eng->seekMusic(BENCH_LOOP_START);
+	m_iStep = 0;
+}
+
+void Pony48Bench::_songStep(uint32_t iters)
+{
+	for(uint32_t i = 0; i < iters; i++, m_iStep++)
+	{
+		//Scrub to a stop and back every so often, like pausing does
+		if(m_iStep % BENCH_SCRUB_STEPS == 0)
+		{
+			if((m_iStep / BENCH_SCRUB_STEPS) % 2)
+				m_eng->scrubPause();
+			else
+				m_eng->scrubResume();
+		}
+		m_eng->soundUpdate(BENCH_DT);
+		m_eng->beatDetect(BENCH_DT);
+		m_eng->stepAudio(BENCH_DT);
+	}
+	m_iSink += (uint32_t)(m_eng->getMusicPos() * 1000.0f);
+}
+
+void Pony48Bench::_songTeardown(uint32_t)
+{
+	m_eng->startedDecay = 0;
+	m_eng->bPaused = false;
+	m_eng->setMusicFrequency(soundFreqDefault);
+	m_eng->m_iCurMode = m_prevMode;
+	m_eng->m_songBeats.clear();
+}
+
+//-------------------------------------------------------------------------------------
+// Entry point
+//-------------------------------------------------------------------------------------
+#ifdef _WIN32
+int SDL_main(int argc, char *argv[])
+#else
+int main(int argc, char** argv)
+#endif
+{
+	string sOut = "bench.json";
+	if(argc > 1)
+		sOut = argv[1];
+
+	Engine::setAudioOutput(AUDIO_OUTPUT_NRT);	//Audio only moves when a benchmark steps it, so runs compare (and no sound card needed)
+	FreeImage_Initialise();
+	LuaInterface Lua("res/lua/init.lua", argc, argv);
+	Lua.Init();
+
+	Pony48Engine* eng = new Pony48Engine(DEFAULT_WIDTH, DEFAULT_HEIGHT, "Pony48 benchmarks", "Pony48", ICONNAME, false);
+	eng->setLua(&Lua);
+
+	Pony48Bench* bench = new Pony48Bench(eng);
+	bench->runAll();
+	bool bWrote = bench->write(sOut);
+	if(bWrote)
+		printf("Results written to %s\n", sOut.c_str());
+	delete bench;
+
+	delete eng;
+	FreeImage_DeInitialise();
+	errlog.close();
+	return bWrote ? 0 : 1;
+}
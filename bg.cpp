@@ -13,6 +13,9 @@ pinwheelBg::pinwheelBg()
 	m_iNumSpokes = 0;
 	acceleration = speed = rot = 0;
 	m_lWheel = NULL;
+	m_vertBuf = NULL;
+	m_colBuf = NULL;
+	m_fBuiltDiag = 0;
 	type = PINWHEEL;
 }
 
@@ -20,26 +23,33 @@ pinwheelBg::~pinwheelBg()
 {
 	if(m_lWheel != NULL)
 		delete [] m_lWheel;
+	if(m_vertBuf != NULL)
+		delete [] m_vertBuf;
+	if(m_colBuf != NULL)
+		delete [] m_colBuf;
 }
 
 void pinwheelBg::draw()
 {
 	if(m_lWheel == NULL || !m_iNumSpokes) return;
-	float32 addAngle = 360.0 / m_iNumSpokes;
+	if(screenDiag != m_fBuiltDiag)	//Screen size changed; rebuild spokes to match
+		_buildVerts();
+	
 	glPushMatrix();
 	glRotatef(rot, 0, 0, 1);	//Rotate according to current rotation
-	for(int i = 0; i < m_iNumSpokes; i++)
-	{
-		glBegin(GL_TRIANGLES);
-		glColor4f(m_lWheel[i].r, m_lWheel[i].g, m_lWheel[i].b, m_lWheel[i].a);
-		glVertex3f(0, 0, 0);	//Center pt
-		glVertex3f(-screenDiag, 0, 0);	//Leftmost pt
-		glVertex3f(-cos(DEG2RAD*addAngle)*screenDiag, sin(DEG2RAD*addAngle)*screenDiag, 0);	//Upper left pt
-		glEnd();
-		glRotatef(addAngle, 0, 0, 1);	//Rotate for next segment
-	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	
+	//Draw every spoke in one go
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, m_vertBuf);
+	glColorPointer(4, GL_FLOAT, 0, m_colBuf);
+	glDrawArrays(GL_TRIANGLES, 0, m_iNumSpokes * 3);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	
+	glColor4f(1,1,1,1);
 	glPopMatrix();
-		
 }
 
 void pinwheelBg::update(float32 dt)
@@ -55,7 +65,16 @@ void pinwheelBg::init(uint32_t num)
 		m_iNumSpokes = num;
 		if(m_lWheel != NULL)
 			delete [] m_lWheel;
+		if(m_vertBuf != NULL)
+			delete [] m_vertBuf;
+		if(m_colBuf != NULL)
+			delete [] m_colBuf;
 		m_lWheel = new Color[num];
+		m_vertBuf = new GLfloat[num * 3 * 3];
+		m_colBuf = new GLfloat[num * 3 * 4];
+		for(uint32_t i = 0; i < num; i++)
+			setWheelCol(i, m_lWheel[i]);
+		_buildVerts();
 	}
 }
 
@@ -64,13 +83,46 @@ void pinwheelBg::setWheelCol(uint32_t wheel, Color col)
 	if(m_iNumSpokes <= wheel) return;
 	if(m_lWheel == NULL) return;
 	m_lWheel[wheel] = col;
+	
+	//All three verts of this spoke get the same color
+	GLfloat* c = &m_colBuf[wheel * 3 * 4];
+	for(int i = 0; i < 3; i++)
+	{
+		*c++ = col.r;
+		*c++ = col.g;
+		*c++ = col.b;
+		*c++ = col.a;
+	}
 }
 
-Color* pinwheelBg::getWheelCol(uint32_t wheel)
+Color pinwheelBg::getWheelCol(uint32_t wheel)
 {
-	if(m_iNumSpokes <= wheel)
-		return NULL;
-	return &m_lWheel[wheel];
+	if(m_iNumSpokes <= wheel || m_lWheel == NULL)
+		return Color();
+	return m_lWheel[wheel];
+}
+
+void pinwheelBg::_buildVerts()
+{
+	m_fBuiltDiag = screenDiag;
+	
+	//Each spoke is a triangle from the center out to the screen's diagonal, starting from the leftmost point
+	//and sweeping counterclockwise. Same layout as rotating one spoke by addAngle each time.
+	float32 addAngle = 2.0 * PI / m_iNumSpokes;
+	GLfloat* v = m_vertBuf;
+	for(uint32_t i = 0; i < m_iNumSpokes; i++)
+	{
+		float32 startAngle = PI + i * addAngle;
+		*v++ = 0;	//Center pt
+		*v++ = 0;
+		*v++ = 0;
+		*v++ = cos(startAngle) * screenDiag;	//Leftmost pt
+		*v++ = sin(startAngle) * screenDiag;
+		*v++ = 0;
+		*v++ = cos(startAngle - addAngle) * screenDiag;	//Upper left pt
+		*v++ = sin(startAngle - addAngle) * screenDiag;
+		*v++ = 0;
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -85,104 +137,150 @@ starfieldBg::starfieldBg()
 	starSize.set(0.1,0.1,0);
 	avoidCam.Set(1,1);
 	type = STARFIELD;
+	m_starX = m_starY = m_starZ = NULL;
+	m_vertBuf = NULL;
+	m_iNumStars = 0;
+}
+
+starfieldBg::~starfieldBg()
+{
+	if(m_starX != NULL)
+		delete [] m_starX;
+	if(m_starY != NULL)
+		delete [] m_starY;
+	if(m_starZ != NULL)
+		delete [] m_starZ;
+	if(m_vertBuf != NULL)
+		delete [] m_vertBuf;
 }
 
+#define VERTS_PER_STAR	24	//6 sides * 4 verts if a star has depth, only the first 4 are used otherwise
+
 void starfieldBg::init()
 {
-	for(int i = 0; i < num; i++)
-	{
-		Vec3 st = _place(randFloat(0,fieldSize.z));
-		m_lStars.push_back(st);
-	}
+	if(m_starX != NULL)
+		delete [] m_starX;
+	if(m_starY != NULL)
+		delete [] m_starY;
+	if(m_starZ != NULL)
+		delete [] m_starZ;
+	if(m_vertBuf != NULL)
+		delete [] m_vertBuf;
+	
+	m_iNumStars = num;
+	m_starX = new float32[m_iNumStars];
+	m_starY = new float32[m_iNumStars];
+	m_starZ = new float32[m_iNumStars];
+	m_vertBuf = new GLfloat[m_iNumStars * VERTS_PER_STAR * 3];	//Allocate for the worst case, since Lua can give stars depth at any time
+	
+	for(uint32_t i = 0; i < m_iNumStars; i++)
+		_place(i, randFloat(0,fieldSize.z));
 }
 
 void starfieldBg::draw()
 {	
-	glPushMatrix();
-	glLoadIdentity();	//So camera is at z = 0
-	glBindTexture(GL_TEXTURE_2D, 0);
-	//Draw stars
-	glColor4f(col.r,col.g,col.b,col.a);
-	for(list<Vec3>::iterator i = m_lStars.begin(); i != m_lStars.end(); i++)
+	if(!m_iNumStars) return;
+	
+	//Vertex offsets of one star, relative to its center
+	float32 sx = starSize.x/2.0;
+	float32 sy = starSize.y/2.0;
+	float32 sz = starSize.z;
+	const GLfloat shape[VERTS_PER_STAR*3] = {
+		//Front side
+		-sx, sy, 0,		sx, sy, 0,		sx, -sy, 0,		-sx, -sy, 0,
+		//Back side
+		-sx, sy, sz,	sx, sy, sz,		sx, -sy, sz,	-sx, -sy, sz,
+		//Top side
+		-sx, sy, 0,		sx, sy, 0,		sx, sy, sz,		-sx, sy, sz,
+		//Right side
+		sx, sy, 0,		sx, -sy, 0,		sx, -sy, sz,	sx, sy, sz,
+		//Bottom side
+		sx, -sy, 0,		-sx, -sy, 0,	-sx, -sy, sz,	sx, -sy, sz,
+		//Left side
+		-sx, sy, 0,		-sx, -sy, 0,	-sx, -sy, sz,	-sx, sy, sz,
+	};
+	uint32_t vertsPerStar = (starSize.z)?(VERTS_PER_STAR):(4);	//If stars have depth, draw all sides
+	
+	//Fill in the vertex buffer for the whole field
+	GLfloat* v = m_vertBuf;
+	for(uint32_t i = 0; i < m_iNumStars; i++)
 	{
-		glPushMatrix();
-		glTranslatef(i->x, i->y, -i->z);
-		
-		//Start drawing
-		glBegin(GL_QUADS);
-		//Draw front side
-		glVertex3f(-starSize.x/2.0, starSize.y/2.0, 0);
-		glVertex3f(starSize.x/2.0, starSize.y/2.0, 0);
-		glVertex3f(starSize.x/2.0, -starSize.y/2.0, 0);
-		glVertex3f(-starSize.x/2.0, -starSize.y/2.0, 0);
-		
-		if(starSize.z)	//If this star has depth
+		for(uint32_t j = 0; j < vertsPerStar*3; j += 3)
 		{
-			//Draw back side
-			glVertex3f(-starSize.x/2.0, starSize.y/2.0, starSize.z);
-			glVertex3f(starSize.x/2.0, starSize.y/2.0, starSize.z);
-			glVertex3f(starSize.x/2.0, -starSize.y/2.0, starSize.z);
-			glVertex3f(-starSize.x/2.0, -starSize.y/2.0, starSize.z);
-			
-			//Draw top side
-			glVertex3f(-starSize.x/2.0, starSize.y/2.0, 0);
-			glVertex3f(starSize.x/2.0, starSize.y/2.0, 0);
-			glVertex3f(starSize.x/2.0, starSize.y/2.0, starSize.z);
-			glVertex3f(-starSize.x/2.0, starSize.y/2.0, starSize.z);
-			
-			//Draw right side
-			glVertex3f(starSize.x/2.0, starSize.y/2.0, 0);
-			glVertex3f(starSize.x/2.0, -starSize.y/2.0, 0);
-			glVertex3f(starSize.x/2.0, -starSize.y/2.0, starSize.z);
-			glVertex3f(starSize.x/2.0, starSize.y/2.0, starSize.z);
-			
-			//Draw bottom side
-			glVertex3f(starSize.x/2.0, -starSize.y/2.0, 0);
-			glVertex3f(-starSize.x/2.0, -starSize.y/2.0, 0);
-			glVertex3f(-starSize.x/2.0, -starSize.y/2.0, starSize.z);
-			glVertex3f(starSize.x/2.0, -starSize.y/2.0, starSize.z);
-			
-			//Draw left side
-			glVertex3f(-starSize.x/2.0, starSize.y/2.0, 0);
-			glVertex3f(-starSize.x/2.0, -starSize.y/2.0, 0);
-			glVertex3f(-starSize.x/2.0, -starSize.y/2.0, starSize.z);
-			glVertex3f(-starSize.x/2.0, starSize.y/2.0, starSize.z);
+			*v++ = m_starX[i] + shape[j];
+			*v++ = m_starY[i] + shape[j+1];
+			*v++ = -m_starZ[i] + shape[j+2];
 		}
-		glEnd();
-		glPopMatrix();
 	}
+	
+	glPushMatrix();
+	glLoadIdentity();	//So camera is at z = 0
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glColor4f(col.r,col.g,col.b,col.a);
+	
+	//Draw all stars in one batch
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, m_vertBuf);
+	glDrawArrays(GL_QUADS, 0, m_iNumStars * vertsPerStar);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	
 	glColor4f(1,1,1,1);
 	glPopMatrix();
 }
 
 void starfieldBg::update(float32 dt)
 {
-	//Update all the stars here
-	for(list<Vec3>::iterator i = m_lStars.begin(); i != m_lStars.end(); i++)
+	//Move all the stars at once
+	float32 dz = speed*dt;
+	for(uint32_t i = 0; i < m_iNumStars; i++)
+		m_starZ[i] -= dz;
+	
+	//Replace any that have gone off the screen either direction
+	float32 zReset = (speed > 0)?(fieldSize.z):(0);
+	for(uint32_t i = 0; i < m_iNumStars; i++)
 	{
-		i->z -= speed*dt;	//Update position
-		if(i->z < 0 || i->z > fieldSize.z)	//If this particle has gone off the screen either direction
-		{
-			if(speed > 0)
-				i->z = fieldSize.z;
-			else
-				i->z = 0;
-			*i = _place(i->z);
-		}
+		if(m_starZ[i] < 0 || m_starZ[i] > fieldSize.z)
+			_place(i, zReset);
 	}
 }
 
-Vec3 starfieldBg::_place(float32 z)
+void starfieldBg::_place(uint32_t star, float32 z)
 {
-	Vec3 ret;
-	ret.z = z;
-	ret.x = randFloat(-fieldSize.x/2.0, fieldSize.x/2.0);
-	ret.y = randFloat(-fieldSize.y/2.0, fieldSize.y/2.0);
-	
-	//Make sure that we're staying outside of our avoid-camera rectangle
-	if(fabs(ret.x) <= avoidCam.x && fabs(ret.y) <= avoidCam.y)
-		return _place(z);
-	return ret;
+	m_starZ[star] = z;
+	
+	//Sample straight from the area outside of our avoid-camera rectangle: either the strips to the left and right
+	//of it, or the strips above and below it. Pick one based on area so the stars stay evenly distributed.
+	float32 hx = fieldSize.x/2.0;
+	float32 hy = fieldSize.y/2.0;
+	float32 ax = min(fabs(avoidCam.x), hx);
+	float32 ay = min(fabs(avoidCam.y), hy);
+	float32 sideArea = (hx - ax) * hy;
+	float32 midArea = ax * (hy - ay);
+	
+	float32 x, y;
+	if(sideArea + midArea <= 0)	//Avoid rectangle covers the whole field; just place anywhere
+	{
+		x = randFloat(-hx, hx);
+		y = randFloat(-hy, hy);
+	}
+	else if(randFloat(0, sideArea + midArea) < sideArea)
+	{
+		x = randFloat(ax, hx);
+		y = randFloat(-hy, hy);
+	}
+	else
+	{
+		x = randFloat(-ax, ax);
+		y = randFloat(ay, hy);
+	}
+	
+	//Flip to a random side
+	if(randInt(0,1))
+		x = -x;
+	if(randInt(0,1))
+		y = -y;
+	m_starX[star] = x;
+	m_starY[star] = y;
 }
 
 
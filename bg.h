@@ -21,7 +21,7 @@ class Background
 {
 public:
 	Background(){screenDiag = 1;type=NONE;};
-	~Background(){};
+	virtual ~Background(){};
 	
 	float32 screenDiag;
 	bgType type;
@@ -41,8 +41,8 @@ public:
 	
 	void init(uint32_t num);
 	uint32_t getNum(){return m_iNumSpokes;};
-	void setWheelCol(uint32_t wheel, Color col);
-	Color* getWheelCol(uint32_t wheel);
+	void setWheelCol(uint32_t wheel, Color col);	//Only touches the color buffer; spoke geometry stays as-is
+	Color getWheelCol(uint32_t wheel);
 	
 	float32 speed;
 	float32 rot;
@@ -51,13 +51,18 @@ public:
 protected:
 	Color* m_lWheel;
 	uint32_t m_iNumSpokes;
+	GLfloat* m_vertBuf;		//3 verts per spoke, built once per screenDiag
+	GLfloat* m_colBuf;		//3 colors per spoke, rewritten only when a spoke changes color
+	float32 m_fBuiltDiag;	//screenDiag that m_vertBuf was built for
+	
+	void _buildVerts();
 };
 
 class starfieldBg : public Background
 {
 public:
 	starfieldBg();
-	~starfieldBg(){};
+	~starfieldBg();
 	
 	void draw();
 	void update(float32 dt);
@@ -72,9 +77,14 @@ public:
 	Point avoidCam;	//Size of rectangle in the center that a star shouldn't be placed in to avoid hitting the camera
 	
 protected:
-	list<Vec3> m_lStars;
+	//Star positions, stored as separate contiguous arrays so update() can run over them in one tight loop
+	float32* m_starX;
+	float32* m_starY;
+	float32* m_starZ;
+	uint32_t m_iNumStars;
+	GLfloat* m_vertBuf;	//Scratch vertex buffer for drawing the whole field in one batch
 	
-	Vec3 _place(float32 z);	//Decide where to put a new star
+	void _place(uint32_t star, float32 z);	//Decide where to put a new star
 };
 
 class gradientBg : public Background
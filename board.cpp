@@ -68,8 +68,8 @@ void Pony48Engine::resetBoard()
 	{
 		while(true)
 		{
-			int x = randInt(0, BOARD_WIDTH-1);
-			int y = randInt(0, BOARD_HEIGHT-1);
+			int x = m_boardRand.randInt(0, BOARD_WIDTH-1);
+			int y = m_boardRand.randInt(0, BOARD_HEIGHT-1);
 			if(m_Board[x][y] != NULL) continue;
 			m_Board[x][y] = loadTile("res/tiles/2.xml");
 			break;
@@ -106,6 +106,8 @@ void Pony48Engine::pieceSlid(int startx, int starty, int endx, int endy)
 
 void Pony48Engine::updateBoard(float32 dt)
 {
+	PROFILE_ZONE("Pony48Engine::updateBoard");
+	MEM_TAG(MEM_BOARD);
 	m_fArrowAdd += dt * ARROW_SPEED;
 	if(m_fArrowAdd >= ARROW_RESET)
 		m_fArrowAdd -= ARROW_RESET;
@@ -149,7 +151,7 @@ void Pony48Engine::updateBoard(float32 dt)
 					float32 xPos = ((float32)(*i)->destx - 2.0f);
 					if(xPos >= 0) xPos++;
 					xPos /= SOUND_DIV_FAC;
-					playSound("jointile", m_fSoundVolume, xPos);
+					playSound(m_sndJoinTile, m_fSoundVolume, xPos, 1.0f, SOUND_PRIORITY_LOW);
 					if(m_highestTile == m_Board[(*i)->destx][(*i)->desty]) 
 						m_highestTile = NULL;
 					rumbleController(0.2, 0.1);
@@ -170,10 +172,10 @@ void Pony48Engine::updateBoard(float32 dt)
 					}
 				}
 				else
-					errlog << "Err board[x][y] == NULL" << (*i)->destx << "," << (*i)->desty << endl;
+					errlog(LOG_WARN) << "Err board[x][y] == NULL" << (*i)->destx << "," << (*i)->desty << endl;
 			}
 			else
-				errlog << "Err destx/y < 0: " << (*i)->destx << "," << (*i)->desty << endl;
+				errlog(LOG_WARN) << "Err destx/y < 0: " << (*i)->destx << "," << (*i)->desty << endl;
 			delete (*i);
 			i = m_lSlideJoinAnimations.erase(i);
 			continue;
@@ -269,7 +271,7 @@ void Pony48Engine::clearBoardAnimations()
 				float32 xPos = ((float32)(*i)->destx - 2.0f);
 				if(xPos >= 0) xPos++;
 				xPos /= SOUND_DIV_FAC;
-				playSound("jointile", m_fSoundVolume, xPos);
+				playSound(m_sndJoinTile, m_fSoundVolume, xPos, 1.0f, SOUND_PRIORITY_LOW);
 				if(m_highestTile == m_Board[(*i)->destx][(*i)->desty]) 
 					m_highestTile = NULL;
 				rumbleController(0.2, 0.1);
@@ -460,11 +462,16 @@ direction Pony48Engine::getDirOfVec2(Point ptVec)
 TilePiece* Pony48Engine::loadTile(string sFilename)
 {
 	TilePiece* ret = new TilePiece();
-	XMLDocument* doc = new XMLDocument();
-    int iErr = doc->LoadFile(sFilename.c_str());
+	XMLDocument* doc;
+	int iErr;
+	{
+		MEM_TAG(MEM_XML);
+		doc = new XMLDocument();
+		iErr = doc->LoadFile(sFilename.c_str());
+	}
 	if(iErr != XML_NO_ERROR)
 	{
-		errlog << "Error parsing XML file " << sFilename << ": Error " << iErr << endl;
+		errlog(LOG_ERROR) << "Error parsing XML file " << sFilename << ": Error " << iErr << endl;
 		delete doc;
 		return NULL;
 	}
@@ -472,7 +479,7 @@ TilePiece* Pony48Engine::loadTile(string sFilename)
     XMLElement* root = doc->FirstChildElement("tile");
     if(root == NULL)
 	{
-		errlog << "Error: No toplevel \"tile\" item in XML file " << sFilename << endl;
+		errlog(LOG_ERROR) << "No toplevel \"tile\" item in XML file " << sFilename << endl;
 		delete doc;
 		return NULL;
 	}
@@ -498,7 +505,7 @@ TilePiece* Pony48Engine::loadTile(string sFilename)
 		}
 		
 		//Save all sfx if there's multiple
-		vector<string> vSounds;
+		vector<soundHandle> vSounds;
 		
 		for(XMLElement* fx = sound->FirstChildElement("fx"); fx != NULL; fx = fx->NextSiblingElement("fx"))
 		{
@@ -506,17 +513,18 @@ TilePiece* Pony48Engine::loadTile(string sFilename)
 			const char* cName = fx->Attribute("name");
 			if(cPath && cName)
 			{
-				createSound(cPath, cName);
-				vSounds.push_back(cName);
+				soundHandle snd = createSound(cPath, cName);	//Already loading or loaded by preloadSoundBank(), so this is just a lookup
+				if(snd != SOUND_NONE)
+					vSounds.push_back(snd);
 			}
 		}
 		//Play one of these randomly
 		if(vSounds.size() && bPlaySoundImmediately)
-			playSound(vSounds[randInt(0, vSounds.size() - 1)], m_fVoxVolume);
+			playSound(vSounds[m_boardRand.randInt(0, vSounds.size() - 1)], m_fVoxVolume, 0.0f, 1.0f, SOUND_PRIORITY_HIGH);
 	}
 	
 	physSegment* tmpseg = new physSegment();
-	int which = randInt(0, vImages.size()-1);
+	int which = m_boardRand.randInt(0, vImages.size()-1);
 	tmpseg->img = vImages[which];
 	tmpseg->size = Point(TILE_WIDTH,TILE_HEIGHT);
 	ret->seg = tmpseg;
@@ -605,6 +613,7 @@ bool Pony48Engine::movePossible(direction dir)
 
 void Pony48Engine::move(direction dir)
 {
+	MEM_TAG(MEM_BOARD);
 	m_fLastMovedSec = getSeconds();
 	m_bHasBoredVox = false;
 	clearBoardAnimations();	//Wipe out any movement animations that are still playing
@@ -802,14 +811,15 @@ bool Pony48Engine::slide(direction dir)
 
 void Pony48Engine::placenew()
 {
+	MEM_TAG(MEM_BOARD);
 	ostringstream oss;
-	oss << "res/tiles/" << randInt(1,2) * 2 << ".xml";
+	oss << "res/tiles/" << m_boardRand.randInt(1,2) * 2 << ".xml";
 	if(movePossible())	//Make sure there aren't no blank spaces or something
 	{
 		while(true)	//Could possibly hang here for a while
 		{
-			int x = randInt(0, BOARD_WIDTH-1);
-			int y = randInt(0, BOARD_HEIGHT-1);
+			int x = m_boardRand.randInt(0, BOARD_WIDTH-1);
+			int y = m_boardRand.randInt(0, BOARD_HEIGHT-1);
 			if(m_Board[x][y] != NULL) continue;
 			m_Board[x][y] = loadTile(oss.str());
 			break;
@@ -817,6 +827,24 @@ void Pony48Engine::placenew()
 	}
 }
 
+uint32_t Pony48Engine::getBoardHash()
+{
+	uint32_t hash = 2166136261u;	//FNV-1a, over each square's value (0 if empty)
+	for(int y = 0; y < BOARD_HEIGHT; y++)
+	{
+		for(int x = 0; x < BOARD_WIDTH; x++)
+		{
+			uint32_t val = (m_Board[x][y] == NULL) ? 0 : m_Board[x][y]->value;
+			for(int i = 0; i < 4; i++)
+			{
+				hash ^= (val >> (i * 8)) & 0xFF;
+				hash *= 16777619u;
+			}
+		}
+	}
+	return hash;
+}
+
 void Pony48Engine::spawnScoreParticles(uint32_t amt)
 {
 	ostringstream oss;
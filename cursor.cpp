@@ -44,11 +44,16 @@ bool myCursor::fromXML(string sXMLFilename)
 {
 	_init();
 	
-	XMLDocument* doc = new XMLDocument();
-    int iErr = doc->LoadFile(sXMLFilename.c_str());
+	XMLDocument* doc;
+	int iErr;
+	{
+		MEM_TAG(MEM_XML);
+		doc = new XMLDocument();
+		iErr = doc->LoadFile(sXMLFilename.c_str());
+	}
 	if(iErr != XML_NO_ERROR)
 	{
-		errlog << "Error parsing XML file " << sXMLFilename << ": Error " << iErr << endl;
+		errlog(LOG_ERROR) << "Error parsing XML file " << sXMLFilename << ": Error " << iErr << endl;
 		delete doc;
 		return false;
 	}
@@ -56,7 +61,7 @@ bool myCursor::fromXML(string sXMLFilename)
     XMLElement* root = doc->FirstChildElement("cursor");
     if(root == NULL)
 	{
-		errlog << "Error: No toplevel \"cursor\" item in XML file " << sXMLFilename << endl;
+		errlog(LOG_ERROR) << "No toplevel \"cursor\" item in XML file " << sXMLFilename << endl;
 		delete doc;
 		return false;
 	}
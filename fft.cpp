@@ -0,0 +1,180 @@
+/*
+	Pony48 source - fft.cpp
+	Copyright (c) 2014 Mark Hutcheson
+*/
+
+#include "fft.h"
+#include <cmath>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void fft(float* re, float* im, uint32_t n)
+{
+	//Bit-reversal permutation
+	for(uint32_t i = 1, j = 0; i < n; i++)
+	{
+		uint32_t bit = n >> 1;
+		for(; j & bit; bit >>= 1)
+			j ^= bit;
+		j ^= bit;
+		if(i < j)
+		{
+			float t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+
+	//Butterflies
+	for(uint32_t len = 2; len <= n; len <<= 1)
+	{
+		double ang = -2.0 * M_PI / len;
+#ifdef __SSE__
+		uint32_t half = len / 2;
+		if(half >= 4)
+		{
+			//Four butterflies at a time, each with its own twiddle, all four turned by w^4 after every step
+			float twRe[4], twIm[4];
+			for(int k = 0; k < 4; k++)
+			{
+				twRe[k] = cos(ang * k);
+				twIm[k] = sin(ang * k);
+			}
+			__m128 stepRe = _mm_set1_ps(cos(ang * 4));
+			__m128 stepIm = _mm_set1_ps(sin(ang * 4));
+			for(uint32_t i = 0; i < n; i += len)
+			{
+				__m128 curRe = _mm_loadu_ps(twRe);
+				__m128 curIm = _mm_loadu_ps(twIm);
+				for(uint32_t j = i; j < i + half; j += 4)
+				{
+					__m128 aRe = _mm_loadu_ps(&re[j]);
+					__m128 aIm = _mm_loadu_ps(&im[j]);
+					__m128 bRe = _mm_loadu_ps(&re[j + half]);
+					__m128 bIm = _mm_loadu_ps(&im[j + half]);
+					__m128 tRe = _mm_sub_ps(_mm_mul_ps(bRe, curRe), _mm_mul_ps(bIm, curIm));
+					__m128 tIm = _mm_add_ps(_mm_mul_ps(bRe, curIm), _mm_mul_ps(bIm, curRe));
+					_mm_storeu_ps(&re[j + half], _mm_sub_ps(aRe, tRe));
+					_mm_storeu_ps(&im[j + half], _mm_sub_ps(aIm, tIm));
+					_mm_storeu_ps(&re[j], _mm_add_ps(aRe, tRe));
+					_mm_storeu_ps(&im[j], _mm_add_ps(aIm, tIm));
+					__m128 nextRe = _mm_sub_ps(_mm_mul_ps(curRe, stepRe), _mm_mul_ps(curIm, stepIm));
+					curIm = _mm_add_ps(_mm_mul_ps(curRe, stepIm), _mm_mul_ps(curIm, stepRe));
+					curRe = nextRe;
+				}
+			}
+			continue;
+		}
+#endif
+		float wRe = cos(ang);
+		float wIm = sin(ang);
+		for(uint32_t i = 0; i < n; i += len)
+		{
+			float curRe = 1.0f, curIm = 0.0f;
+			for(uint32_t j = 0; j < len / 2; j++)
+			{
+				float* aRe = &re[i + j];
+				float* aIm = &im[i + j];
+				float* bRe = &re[i + j + len / 2];
+				float* bIm = &im[i + j + len / 2];
+				float tRe = *bRe * curRe - *bIm * curIm;
+				float tIm = *bRe * curIm + *bIm * curRe;
+				*bRe = *aRe - tRe;
+				*bIm = *aIm - tIm;
+				*aRe += tRe;
+				*aIm += tIm;
+				float nextRe = curRe * wRe - curIm * wIm;
+				curIm = curRe * wIm + curIm * wRe;
+				curRe = nextRe;
+			}
+		}
+	}
+}
+
+void realFFT(const float* in, float* re, float* im, uint32_t n)
+{
+	//Pack even samples as real and odd as imaginary, and do half as much work
+	uint32_t m = n / 2;
+	for(uint32_t k = 0; k < m; k++)
+	{
+		float fEven = in[2*k];
+		float fOdd = in[2*k+1];
+		re[k] = fEven;
+		im[k] = fOdd;
+	}
+	fft(re, im, m);
+
+	//Unpack. Bins k and m-k only depend on each other, so this can go in place a pair at a time
+	float fDC = re[0] + im[0];
+	re[0] = fDC;
+	im[0] = 0.0f;
+	double ang = -2.0 * M_PI / n;
+	float wRe = cos(ang);
+	float wIm = sin(ang);
+	float curRe = wRe, curIm = wIm;
+	for(uint32_t k = 1; k <= m / 2; k++)
+	{
+		uint32_t j = m - k;
+		float feRe = (re[k] + re[j]) * 0.5f;
+		float feIm = (im[k] - im[j]) * 0.5f;
+		float foRe = (im[k] + im[j]) * 0.5f;
+		float foIm = (re[j] - re[k]) * 0.5f;
+		float tRe = foRe * curRe - foIm * curIm;
+		float tIm = foRe * curIm + foIm * curRe;
+		re[k] = feRe + tRe;
+		im[k] = feIm + tIm;
+		re[j] = feRe - tRe;		//X[m-k] = conj(Fe[k] - W^k * Fo[k])
+		im[j] = tIm - feIm;
+		float nextRe = curRe * wRe - curIm * wIm;
+		curIm = curRe * wIm + curIm * wRe;
+		curRe = nextRe;
+	}
+}
+
+void hannWindow(float* w, uint32_t n)
+{
+	for(uint32_t i = 0; i < n; i++)
+		w[i] = 0.5f - 0.5f * cos(2.0 * M_PI * i / (n - 1));
+}
+
+void applyWindow(const float* in, const float* w, float* out, uint32_t n)
+{
+	uint32_t i = 0;
+#ifdef __SSE__
+	for(; i + 4 <= n; i += 4)
+		_mm_storeu_ps(&out[i], _mm_mul_ps(_mm_loadu_ps(&in[i]), _mm_loadu_ps(&w[i])));
+#endif
+	for(; i < n; i++)
+		out[i] = in[i] * w[i];
+}
+
+void magnitudes(const float* re, const float* im, float* mag, uint32_t n, float fScale)
+{
+	uint32_t i = 0;
+#ifdef __SSE__
+	__m128 scale = _mm_set1_ps(fScale);
+	for(; i + 4 <= n; i += 4)
+	{
+		__m128 r = _mm_loadu_ps(&re[i]);
+		__m128 c = _mm_loadu_ps(&im[i]);
+		__m128 sq = _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(c, c));
+		_mm_storeu_ps(&mag[i], _mm_mul_ps(_mm_sqrt_ps(sq), scale));
+	}
+#endif
+	for(; i < n; i++)
+		mag[i] = sqrt(re[i] * re[i] + im[i] * im[i]) * fScale;
+}
+
+void magnitudeSpectrum(const float* samples, const float* window, float* re, float* im, float* mag, uint32_t n)
+{
+	float fWindowSum = 0.0f;
+	for(uint32_t i = 0; i < n; i++)
+		fWindowSum += window[i];
+	applyWindow(samples, window, re, n);
+	realFFT(re, re, im, n);
+	magnitudes(re, im, mag, n / 2, 2.0f / fWindowSum);
+}
@@ -0,0 +1,31 @@
+/*
+	Pony48 header - fft.h
+	Small radix-2 FFT for analyzing music
+	Copyright (c) 2014 Mark Hutcheson
+*/
+#ifndef FFT_H
+#define FFT_H
+
+#include <stdint.h>
+
+//In-place complex FFT. n must be a power of 2. Stages four or more butterflies wide run four at a time with SSE, if we're built with it
+void fft(float* re, float* im, uint32_t n);
+
+//FFT of n real samples, via an n/2-point complex FFT. Writes bins 0 to n/2-1 (Nyquist is dropped) to re and im, n/2 each.
+//in may be the same array as re
+void realFFT(const float* in, float* re, float* im, uint32_t n);
+
+//Fill w with an n-point Hann window
+void hannWindow(float* w, uint32_t n);
+
+//out = in * w, elementwise. out may be in
+void applyWindow(const float* in, const float* w, float* out, uint32_t n);
+
+//mag = |re + i*im| * fScale, elementwise
+void magnitudes(const float* re, const float* im, float* mag, uint32_t n, float fScale);
+
+//Magnitude of the first n/2 bins of a windowed block of n real samples, scaled so a full-scale sine peaks near 1.
+//re (n) and im (n/2) are scratch space; samples and window are left alone
+void magnitudeSpectrum(const float* samples, const float* window, float* re, float* im, float* mag, uint32_t n);
+
+#endif
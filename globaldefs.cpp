@@ -176,6 +176,28 @@ float32 randFloat(float32 min, float32 max)
 	return((scale/1000.0)*(max-min) + min);
 }
 
+uint32_t randGen::next()
+{
+	m_iState ^= m_iState << 13;
+	m_iState ^= m_iState >> 17;
+	m_iState ^= m_iState << 5;
+	return m_iState;
+}
+
+int32_t randGen::randInt(int32_t min, int32_t max)
+{
+	if(min == max)
+		return min;
+	if(min > max)
+	{
+		int32_t temp = min;
+		min = max;
+		max = temp;
+	}
+	uint32_t diff = max-min+1;
+	return(next()%diff + min);
+}
+
 Vec3::Vec3()
 {
 	setZero();
@@ -30,6 +30,8 @@ using namespace tinyxml2;
 #include <GL/gl.h>
 #include <GL/glu.h>
 #endif
+#include "logger.h"
+#include "memtrack.h"
 
 //Defined by SDL
 #define JOY_AXIS_MIN	-32768
@@ -133,7 +135,16 @@ public:
 	
 };
 
-extern ofstream errlog;
+//Random number stream with its own state, so whatever draws from it gets the same numbers for the same seed no matter how much else calls rand()
+class randGen
+{
+	uint32_t m_iState;
+public:
+	randGen(uint32_t iSeed = 1)	{seed(iSeed);};
+	void seed(uint32_t iSeed)	{m_iState = iSeed ? iSeed : 1;};	//Xorshift gets stuck at 0
+	uint32_t next();
+	int32_t randInt(int32_t min, int32_t max);	//Same as the global randInt(), from this stream
+};
 
 //Helper functions
 Vec3 crossProduct(Vec3 vec1, Vec3 vec2);	//Cross product of two vectors
@@ -5,12 +5,32 @@
 
 #include "hud.h"
 #include "Pony48.h"
+#include "opengl-api.h"
 #include <sstream>
+#include <cstring>
 
 extern int screenDrawWidth;
 extern int screenDrawHeight;
 extern Pony48Engine* g_pGlobalEngine;
 
+//Fold a value into a running state hash (FNV-1a, a word at a time)
+static inline uint32_t hashState(uint32_t h, uint32_t v)
+{
+	return (h ^ v) * 16777619u;
+}
+
+static inline uint32_t hashState(uint32_t h, float32 f)
+{
+	uint32_t v;
+	memcpy(&v, &f, sizeof(v));
+	return hashState(h, v);
+}
+
+static inline uint32_t hashState(uint32_t h, const void* p)
+{
+	return hashState(h, (uint32_t)(size_t)p);
+}
+
 //-------------------------------------------------------------------------------------
 // HUDItem class functions
 //-------------------------------------------------------------------------------------
@@ -35,7 +55,7 @@ bool HUDItem::event(SDL_Event event)
     //Base class does nothing with this, except pass on
     for(list<HUDItem*>::iterator i = m_lChildren.begin(); i != m_lChildren.end(); i++)
         bRet = (*i)->event(event) || bRet;
-	return bRet;
+	return handle(event) || bRet;
 }
 
 void HUDItem::draw(float32 fCurTime)
@@ -55,6 +75,21 @@ void HUDItem::setSignalHandler(void (*signalHandler)(string))
         (*i)->setSignalHandler(signalHandler);
 }
 
+uint32_t HUDItem::state()
+{
+	uint32_t h = 2166136261u;
+	h = hashState(h, (uint32_t)hidden);
+	h = hashState(h, col.r);
+	h = hashState(h, col.g);
+	h = hashState(h, col.b);
+	h = hashState(h, col.a);
+	h = hashState(h, m_ptPos.x);
+	h = hashState(h, m_ptPos.y);
+	for(list<HUDItem*>::iterator i = m_lChildren.begin(); i != m_lChildren.end(); i++)
+		h = hashState(h, (*i)->state());
+	return h;
+}
+
 void HUDItem::addChild(HUDItem* hiChild)
 {
     if(hiChild == NULL)
@@ -111,6 +146,17 @@ void HUDImage::setImage(Image* img)
     m_img = img;
 }
 
+uint32_t HUDImage::state()
+{
+	uint32_t h = HUDItem::state();
+	h = hashState(h, m_img);
+	h = hashState(h, pos.x);
+	h = hashState(h, pos.y);
+	h = hashState(h, size.x);
+	h = hashState(h, size.y);
+	return h;
+}
+
 //-------------------------------------------------------------------------------------
 // HUDTextbox class functions
 //-------------------------------------------------------------------------------------
@@ -118,6 +164,11 @@ HUDTextbox::HUDTextbox(string sName) : HUDItem(sName)
 {
     m_txtFont = NULL;
 	pt = 1.0f;
+	m_iLastNum = 0;
+	m_bHasNum = false;
+	m_fLayoutPt = 0.0f;
+	m_bDirty = true;
+	m_iChanges = 0;
 }
 
 HUDTextbox::~HUDTextbox()
@@ -130,17 +181,76 @@ void HUDTextbox::draw(float32 fCurTime)
     HUDItem::draw(fCurTime);
     if(m_txtFont == NULL) return;
 
+	_relayout();
+
     m_txtFont->col = col;
 
     //Render the text
-    m_txtFont->render(m_sValue, m_ptPos.x, m_ptPos.y, pt);
+    m_txtFont->render(m_layout, m_ptPos.x, m_ptPos.y);
 }
 
 void HUDTextbox::setText(uint32_t iNum)
 {
-    ostringstream oss;
-    oss << iNum;
-    setText(oss.str());
+	if(m_bHasNum && iNum == m_iLastNum)
+		return;
+	MEM_TAG(MEM_HUDTEXT);
+	m_iLastNum = iNum;
+	
+	//Write digits backwards into a buffer rather than going through a stringstream
+	char cBuf[16];
+	char* c = &cBuf[sizeof(cBuf)-1];
+	*c = '\0';
+	do
+	{
+		*--c = '0' + (iNum % 10);
+		iNum /= 10;
+	}
+	while(iNum);
+	
+	m_sValue.assign(m_sPrefix);
+	m_sValue.append(c);
+	m_bHasNum = true;
+	m_bDirty = true;
+	m_iChanges++;
+}
+
+void HUDTextbox::setPrefix(const string& s)
+{
+	if(s == m_sPrefix)
+		return;
+	m_sPrefix = s;
+	if(m_bHasNum)	//Redo current number with the new prefix
+	{
+		m_bHasNum = false;
+		setText(m_iLastNum);
+	}
+}
+
+void HUDTextbox::_relayout()
+{
+	//Only lay the glyphs out again if the text or size actually changed
+	if(!m_bDirty && pt == m_fLayoutPt)
+		return;
+	MEM_TAG(MEM_HUDTEXT);
+	m_txtFont->layout(m_sValue, pt, &m_layout);
+	m_fLayoutPt = pt;
+	m_bDirty = false;
+}
+
+uint32_t HUDTextbox::state()
+{
+	uint32_t h = HUDItem::state();
+	h = hashState(h, m_iChanges);
+	h = hashState(h, pt);
+	return h;
+}
+
+float32 HUDTextbox::getWidth()
+{
+	if(m_txtFont == NULL)
+		return 0;
+	_relayout();
+	return m_layout.width;
 }
 
 //-------------------------------------------------------------------------------------
@@ -159,17 +269,20 @@ HUDToggle::~HUDToggle()
 
 }
 
-bool HUDToggle::event(SDL_Event event)
+bool HUDToggle::handle(SDL_Event event)
 {
-	if(hidden) return false;
-	bool bRet = HUDItem::event(event);
     if(event.type == SDL_KEYDOWN && event.key.keysym.sym == m_iKey)
     {
         m_signalHandler(m_sSignal); //Generate signal
         m_bValue = !m_bValue;   //Toggle
         return true;
     }
-    return bRet;
+    return false;
+}
+
+void HUDToggle::routes(vector<HUDRoute>* lRoutes)
+{
+	lRoutes->push_back(HUDRoute(ROUTE_KEYSYM, m_iKey));
 }
 
 void HUDToggle::draw(float32 fCurTime)
@@ -205,6 +318,11 @@ void HUDToggle::setDisabledImage(Image* img)
     m_imgDisabled = img;
 }
 
+uint32_t HUDToggle::state()
+{
+	return hashState(HUDItem::state(), (uint32_t)m_bValue);
+}
+
 //-------------------------------------------------------------------------------------
 // HUDGroup class functions
 //-------------------------------------------------------------------------------------
@@ -213,11 +331,17 @@ HUDGroup::HUDGroup(string sName) : HUDItem(sName)
     m_fFadeDelay = FLT_MAX;
     m_fFadeTime = FLT_MAX;
     m_fStartTime = FLT_MIN;
+	scale = 1.0f;
+	m_bStatic = false;
+	m_iCacheFBO = m_iCacheTex = 0;
+	m_iCacheWidth = m_iCacheHeight = 0;
+	m_iCacheState = 0;
+	m_bCacheValid = false;
 }
 
 HUDGroup::~HUDGroup()
 {
-
+	_freeCache();
 }
 
 void HUDGroup::draw(float32 fCurTime)
@@ -234,19 +358,131 @@ void HUDGroup::draw(float32 fCurTime)
 
     //Draw all the children with this alpha, if we aren't at alpha = 0
     if(fCurTime < m_fFadeDelay+m_fStartTime+m_fFadeTime)
+	{
+		if(m_bStatic && _drawCached(fCurTime))
+			return;
+		glPushMatrix();
+		glScalef(scale, scale, 1.0f);
         HUDItem::draw(fCurTime);
+		glPopMatrix();
+	}
 }
 
-bool HUDGroup::event(SDL_Event event)
+bool HUDGroup::_drawCached(float32 fCurTime)
 {
-	if(hidden) return false;
-    bool bRet = HUDItem::event(event);
+	if(!OpenGLAPI::HasFramebuffers() || !OpenGLAPI::HasBlendFuncSeparate())
+		return false;
+	
+	//Cache at the resolution we're currently drawing at, into whatever target we're currently drawing to
+	GLint vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	GLint iTarget = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT, &iTarget);
+	
+	if(!m_iCacheFBO || vp[2] > m_iCacheWidth || vp[3] > m_iCacheHeight)
+	{
+		_freeCache();
+		m_iCacheWidth = vp[2];
+		m_iCacheHeight = vp[3];
+		glGenTextures(1, &m_iCacheTex);
+		glBindTexture(GL_TEXTURE_2D, m_iCacheTex);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_iCacheWidth, m_iCacheHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		
+		glGenFramebuffersEXT(1, &m_iCacheFBO);
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, m_iCacheFBO);
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, m_iCacheTex, 0);
+		GLenum status = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, iTarget);
+		if(status != GL_FRAMEBUFFER_COMPLETE_EXT)
+		{
+			errlog(LOG_WARN) << "HUD group \"" << m_sName << "\" couldn't create its cache (status " << status << "). Drawing it directly." << endl;
+			_freeCache();
+			m_bStatic = false;
+			return false;
+		}
+	}
+	
+	//Redraw the cache if any of our children changed since last time
+	uint32_t iState = hashState((uint32_t)vp[2], (uint32_t)vp[3]);
+	for(list<HUDItem*>::iterator i = m_lChildren.begin(); i != m_lChildren.end(); i++)
+		iState = hashState(iState, (*i)->state());
+	if(!m_bCacheValid || iState != m_iCacheState)
+	{
+		glPushAttrib(GL_COLOR_BUFFER_BIT);
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, m_iCacheFBO);
+		glViewport(0, 0, vp[2], vp[3]);
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+		glClear(GL_COLOR_BUFFER_BIT);
+		//Store premultiplied color, with alpha accumulating properly over the transparent background
+		glBlendFuncSeparateEXT(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+		HUDItem::draw(fCurTime);
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, iTarget);
+		glViewport(vp[0], vp[1], vp[2], vp[3]);
+		glPopAttrib();
+		m_iCacheState = iState;
+		m_bCacheValid = true;
+	}
+	
+	//Draw the cache as one screen-sized quad. The HUD camera looks straight at the origin, so scaling in screen space is scaling about the HUD origin
+	float32 u = (float32)vp[2] / (float32)m_iCacheWidth;
+	float32 v = (float32)vp[3] / (float32)m_iCacheHeight;
+	glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT);
+	glDisable(GL_DEPTH_TEST);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	glBindTexture(GL_TEXTURE_2D, m_iCacheTex);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glColor4f(col.a, col.a, col.a, col.a);	//Premultiplied, so fading scales everything
+	glBegin(GL_QUADS);
+	glTexCoord2f(0.0, 0.0);
+	glVertex2f(-scale, -scale);
+	glTexCoord2f(u, 0.0);
+	glVertex2f(scale, -scale);
+	glTexCoord2f(u, v);
+	glVertex2f(scale, scale);
+	glTexCoord2f(0.0, v);
+	glVertex2f(-scale, scale);
+	glEnd();
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+	glPopAttrib();
+	glColor4f(1.0, 1.0, 1.0, 1.0);
+	return true;
+}
+
+void HUDGroup::_freeCache()
+{
+	if(m_iCacheFBO)
+		glDeleteFramebuffersEXT(1, &m_iCacheFBO);
+	if(m_iCacheTex)
+		glDeleteTextures(1, &m_iCacheTex);
+	m_iCacheFBO = m_iCacheTex = 0;
+	m_bCacheValid = false;
+}
 
+bool HUDGroup::handle(SDL_Event event)
+{
     if(event.type == SDL_KEYDOWN && m_mKeys.find(event.key.keysym.sym) != m_mKeys.end())
     {
         m_fStartTime = FLT_MIN; //Cause this to reset
     }
-    return bRet;
+    return false;
+}
+
+void HUDGroup::routes(vector<HUDRoute>* lRoutes)
+{
+	for(map<int32_t,bool>::iterator i = m_mKeys.begin(); i != m_mKeys.end(); i++)
+		lRoutes->push_back(HUDRoute(ROUTE_KEYSYM, i->first));
 }
 
 //-------------------------------------------------------------------------------------
@@ -321,10 +557,9 @@ void HUDMenu::_enter()
 		m_signalHandler(m_selected->signal);
 }
 
-bool HUDMenu::event(SDL_Event event)
+bool HUDMenu::handle(SDL_Event event)
 {
-	if(hidden) return false;
-	bool bRet = HUDItem::event(event);
+	bool bRet = false;
 	
 	switch(event.type)
 	{
@@ -428,6 +663,31 @@ bool HUDMenu::event(SDL_Event event)
 	return bRet;
 }
 
+uint32_t HUDMenu::state()
+{
+	uint32_t h = HUDItem::state();
+	h = hashState(h, (m_selected == m_menu.end()) ? NULL : &*m_selected);
+	h = hashState(h, pt);
+	h = hashState(h, selectedpt);
+	h = hashState(h, (uint32_t)m_menu.size());
+	return h;
+}
+
+void HUDMenu::routes(vector<HUDRoute>* lRoutes)
+{
+	lRoutes->push_back(HUDRoute(ROUTE_SCANCODE, KEY_UP1));
+	lRoutes->push_back(HUDRoute(ROUTE_SCANCODE, KEY_UP2));
+	lRoutes->push_back(HUDRoute(ROUTE_SCANCODE, KEY_DOWN1));
+	lRoutes->push_back(HUDRoute(ROUTE_SCANCODE, KEY_DOWN2));
+	lRoutes->push_back(HUDRoute(ROUTE_SCANCODE, KEY_ENTER1));
+	lRoutes->push_back(HUDRoute(ROUTE_SCANCODE, KEY_ENTER2));
+	lRoutes->push_back(HUDRoute(ROUTE_MOUSEBUTTON, SDL_BUTTON_LEFT));
+	lRoutes->push_back(HUDRoute(ROUTE_MOUSEMOTION, 0));
+	lRoutes->push_back(HUDRoute(ROUTE_JOYBUTTON, JOY_BUTTON_A));
+	lRoutes->push_back(HUDRoute(ROUTE_JOYAXIS, JOY_AXIS_VERT));
+	lRoutes->push_back(HUDRoute(ROUTE_JOYHAT, 0));
+}
+
 void HUDMenu::draw(float32 fCurTime)
 {
 	if(hidden) return;
@@ -466,6 +726,9 @@ void HUDMenu::draw(float32 fCurTime)
 //-------------------------------------------------------------------------------------
 HUD::HUD(string sName) : HUDItem(sName)
 {
+	m_lCurScene = NULL;
+	m_lRoutedScene = NULL;
+	m_bRoutesDirty = true;
 }
 
 HUD::~HUD()
@@ -528,6 +791,10 @@ HUDItem* HUD::_getItem(XMLElement* elem)
         float32 fTime = FLT_MAX;
         elem->QueryFloatAttribute("fadetime", &fTime);
         hGroup->setFadeTime(fTime);
+		bool bStatic = false;
+		elem->QueryBoolAttribute("static", &bStatic);
+		hGroup->setStatic(bStatic);
+		elem->QueryFloatAttribute("scale", &hGroup->scale);
 
         //-----------Parse keys and key nums
         int32_t iNumKeys = 0;
@@ -688,18 +955,23 @@ HUDItem* HUD::_getItem(XMLElement* elem)
 	}
     
 	else
-        errlog << "Unknown HUD item \"" << sName << "\". Ignoring..." << endl;
+        errlog(LOG_WARN) << "Unknown HUD item \"" << sName << "\". Ignoring..." << endl;
     return NULL;
 }
 
 void HUD::create(string sXMLFilename)
 {
     //Load in the XML document
-    XMLDocument* doc = new XMLDocument();
-    int iErr = doc->LoadFile(sXMLFilename.c_str());
+	XMLDocument* doc;
+	int iErr;
+	{
+		MEM_TAG(MEM_XML);
+		doc = new XMLDocument();
+		iErr = doc->LoadFile(sXMLFilename.c_str());
+	}
 	if(iErr != XML_NO_ERROR)
 	{
-		errlog << "Error parsing XML file " << sXMLFilename << ": Error " << iErr << endl;
+		errlog(LOG_ERROR) << "Error parsing XML file " << sXMLFilename << ": Error " << iErr << endl;
 		delete doc;
 		return;
 	}
@@ -707,7 +979,7 @@ void HUD::create(string sXMLFilename)
     XMLElement* root = doc->FirstChildElement("hud");
     if(root == NULL)
 	{
-		errlog << "Error: No toplevel \"hud\" item in XML file " << sXMLFilename << endl;
+		errlog(LOG_ERROR) << "No toplevel \"hud\" item in XML file " << sXMLFilename << endl;
 		delete doc;
 		return;
 	}
@@ -743,6 +1015,92 @@ void HUD::create(string sXMLFilename)
 
     }
     delete doc;
+	
+	//Index everything by name, in the same order HUDItem::getChild() would find them
+	m_mNames.clear();
+	_index(this);
+}
+
+void HUD::_index(HUDItem* it)
+{
+	if(m_mNames.find(it->getName()) == m_mNames.end())	//First one with a given name wins
+		m_mNames[it->getName()] = it;
+	for(list<HUDItem*>::iterator i = it->children().begin(); i != it->children().end(); i++)
+		_index(*i);
+}
+
+void HUD::_route(HUDItem* it)
+{
+	if(it->hidden)
+		return;
+	
+	//Children get events before their parents, same as HUDItem::event()
+	for(list<HUDItem*>::iterator i = it->children().begin(); i != it->children().end(); i++)
+		_route(*i);
+	
+	vector<HUDRoute> lRoutes;
+	it->routes(&lRoutes);
+	for(vector<HUDRoute>::iterator i = lRoutes.begin(); i != lRoutes.end(); i++)
+	{
+		vector<HUDItem*>& items = m_mRoutes[*i];
+		if(items.empty() || items.back() != it)	//Don't route the same event to one item twice (KEY_UP1 == KEY_UP2, say)
+			items.push_back(it);
+	}
+}
+
+bool HUD::_dispatch(HUDRoute r, SDL_Event event)
+{
+	map<HUDRoute, vector<HUDItem*> >::iterator i = m_mRoutes.find(r);
+	if(i == m_mRoutes.end())
+		return false;
+	bool bRet = false;
+	for(vector<HUDItem*>::iterator j = i->second.begin(); j != i->second.end(); j++)
+		bRet = (*j)->handle(event) || bRet;
+	return bRet;
+}
+
+bool HUD::event(SDL_Event event)
+{
+	if(m_bRoutesDirty || m_lRoutedScene != m_lCurScene)
+	{
+		m_mRoutes.clear();
+		_route(this);
+		m_lRoutedScene = m_lCurScene;
+		m_bRoutesDirty = false;
+	}
+	
+	switch(event.type)
+	{
+		case SDL_KEYDOWN:
+		{
+			bool bRet = _dispatch(HUDRoute(ROUTE_KEYSYM, event.key.keysym.sym), event);
+			return _dispatch(HUDRoute(ROUTE_SCANCODE, event.key.keysym.scancode), event) || bRet;
+		}
+		
+		case SDL_MOUSEBUTTONDOWN:
+			return _dispatch(HUDRoute(ROUTE_MOUSEBUTTON, event.button.button), event);
+		
+		case SDL_MOUSEMOTION:
+			return _dispatch(HUDRoute(ROUTE_MOUSEMOTION, 0), event);
+		
+		case SDL_JOYBUTTONDOWN:
+			return _dispatch(HUDRoute(ROUTE_JOYBUTTON, event.jbutton.button), event);
+		
+		case SDL_JOYAXISMOTION:
+			return _dispatch(HUDRoute(ROUTE_JOYAXIS, event.jaxis.axis), event);
+		
+		case SDL_JOYHATMOTION:
+			return _dispatch(HUDRoute(ROUTE_JOYHAT, 0), event);
+	}
+	return false;	//Nothing in the HUD cares about any other events
+}
+
+HUDItem* HUD::getChild(string sName)
+{
+	map<string, HUDItem*>::iterator i = m_mNames.find(sName);
+	if(i == m_mNames.end())
+		return NULL;
+	return i->second;
 }
 
 void HUD::destroy()
@@ -760,28 +1118,20 @@ void HUD::setScene(string sScene)
 {
 	m_sScene = sScene;
 	
-	//Hide all elements
-	for(list<HUDItem*>::iterator i = m_lChildren.begin(); i != m_lChildren.end(); i++)
-		(*i)->hidden = true;
+	//Hide the elements of the last scene (or everything, if we haven't picked a scene yet)
+	if(m_lCurScene == NULL)
+	{
+		for(list<HUDItem*>::iterator i = m_lChildren.begin(); i != m_lChildren.end(); i++)
+			(*i)->hidden = true;
+	}
+	else
+	{
+		for(list<HUDItem*>::iterator i = m_lCurScene->begin(); i != m_lCurScene->end(); i++)
+			(*i)->hidden = true;
+	}
 	
 	//Reveal the elements of this scene
-	for(list<HUDItem*>::iterator i = m_mScenes[sScene].begin(); i != m_mScenes[sScene].end(); i++)
+	m_lCurScene = &m_mScenes[sScene];
+	for(list<HUDItem*>::iterator i = m_lCurScene->begin(); i != m_lCurScene->end(); i++)
 		(*i)->hidden = false;
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
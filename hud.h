@@ -11,7 +11,20 @@
 #include "Text.h"
 
 //Global functions for use with HUD objects
-inline void stubSignal(string sSignal){errlog << "Generating signal: " << sSignal << endl;}; //For stubbing out HUD signal handling functions
+inline void stubSignal(string sSignal){errlog(LOG_DEBUG) << "Generating signal: " << sSignal << endl;}; //For stubbing out HUD signal handling functions
+
+//Kinds of input a HUD item can ask to be routed to it
+enum hudRouteKind
+{
+	ROUTE_KEYSYM,		//SDL_KEYDOWN, by keysym.sym
+	ROUTE_SCANCODE,		//SDL_KEYDOWN, by keysym.scancode
+	ROUTE_MOUSEBUTTON,	//SDL_MOUSEBUTTONDOWN, by button
+	ROUTE_MOUSEMOTION,	//SDL_MOUSEMOTION (code unused)
+	ROUTE_JOYBUTTON,	//SDL_JOYBUTTONDOWN, by button
+	ROUTE_JOYAXIS,		//SDL_JOYAXISMOTION, by axis
+	ROUTE_JOYHAT		//SDL_JOYHATMOTION (code unused)
+};
+typedef pair<int32_t, int32_t> HUDRoute;	//Kind, code
 
 // HUDItem class -- base class for HUD items
 class HUDItem
@@ -31,12 +44,15 @@ public:
 	bool hidden;
 
 	HUDItem(string sName);
-	~HUDItem();
+	virtual ~HUDItem();
 
-	virtual bool	event(SDL_Event event);						 //For handling input events as they come in
+	virtual bool	event(SDL_Event event);						 //For handling input events as they come in (passes down to children, then handle())
+	virtual bool	handle(SDL_Event event)		{return false;};	 //Respond to an event aimed at this item alone (not children)
+	virtual void	routes(vector<HUDRoute>* lRoutes)	{};			 //Add the events this item wants handle() called for
+	virtual uint32_t state();										 //Hash of everything that affects how this and its children look
 	virtual void	draw(float32 fCurTime);						   //For drawing to the screen
 	void			addChild(HUDItem* hiChild);						 //Add this child to this HUDItem
-	HUDItem*		getChild(string sName);							 //Get the first child that has this name (return NULL if none)
+	virtual HUDItem* getChild(string sName);						 //Get the first child that has this name (return NULL if none)
 
 	//Accessor methods
 	string		  getName()				   {return m_sName;};
@@ -46,6 +62,7 @@ public:
 	void			setSignal(string sSignal)   {m_sSignal = sSignal;};
 	string		  getSignal()				 {return m_sSignal;};
 	void			setSignalHandler(void (*signalHandler)(string));
+	list<HUDItem*>& children()				{return m_lChildren;};
 
 };
 
@@ -62,6 +79,7 @@ public:
 	~HUDImage();
 
 	void draw(float32 fCurTime);
+	uint32_t state();
 
 	void	setImage(Image* img);
 	Image*  getImage()			  {return m_img;};
@@ -72,6 +90,16 @@ class HUDTextbox : public HUDItem
 protected:
 	Text* m_txtFont;
 	string m_sValue;
+	string m_sPrefix;		//Prepended to numbers set through setText(uint32_t)
+	uint32_t m_iLastNum;	//Last number set, so repeated identical scores are free
+	bool m_bHasNum;
+	TextLayout m_layout;	//Our own glyph quads, so rapidly-changing text doesn't churn the font's cache
+	float m_fLayoutPt;
+	bool m_bDirty;			//If m_layout needs rebuilding before we draw
+	uint32_t m_iChanges;	//Bumped whenever the text changes, for state()
+
+	void _relayout();
+	void _setValue(const string& s)	{if(s == m_sValue) return; m_sValue = s; m_bHasNum = false; m_bDirty = true; m_iChanges++;};
 
 public:
 	float pt;
@@ -81,12 +109,15 @@ public:
 
 	void draw(float32 fCurTime);
 
-	void	setFont(Text* txt)			{m_txtFont = txt;};	 //Set the font used by this textbox
+	void	setFont(Text* txt)			{if(txt != m_txtFont) {m_bDirty = true; m_iChanges++;} m_txtFont = txt;};	 //Set the font used by this textbox
 	Text*   getFont()					{return m_txtFont;};
-	void	setText(string s)			{m_sValue = s;};		//Set the text to display
-	void	setText(uint32_t iNum);							 //Set the text from an integer
+	void	setText(const string& s)	{_setValue(s);};		//Set the text to display. Does nothing if it hasn't changed
+	void	setText(const char* s)		{if(m_sValue != s) _setValue(s);};
+	void	setText(uint32_t iNum);							 //Set the text from an integer (with prefix)
+	void	setPrefix(const string& s);						 //Set the text shown before numbers from setText(uint32_t)
 	string  getText()					{return m_sValue;};
-	float32 getWidth()					{if(m_txtFont)return m_txtFont->size(m_sValue, pt);return 0;};
+	float32 getWidth();
+	uint32_t state();
 
 };
 
@@ -103,8 +134,10 @@ public:
 	HUDToggle(string sName);
 	~HUDToggle();
 
-	bool event(SDL_Event event);						//This will create a signal if the event matches our set key
+	bool handle(SDL_Event event);						//This will create a signal if the event matches our set key
+	void routes(vector<HUDRoute>* lRoutes);
 	void draw(float32 fCurTime);						//Draws the enabled or disabled image
+	uint32_t state();
 
 	void setEnabled(bool bValue)		{m_bValue = bValue;};
 	bool getEnabled()				   {return m_bValue;};
@@ -141,14 +174,27 @@ protected:
 	float32 m_fFadeTime;
 	float32 m_fStartTime;
 	map<int32_t,bool> m_mKeys;  //The keys our children are responding to, that we'll set our alpha to 255 for
+	bool m_bStatic;				//If our children rarely change, so we render them once to a texture and draw that instead
+	GLuint m_iCacheFBO, m_iCacheTex;
+	GLint m_iCacheWidth, m_iCacheHeight;	//Size of m_iCacheTex
+	uint32_t m_iCacheState;		//state() of our children when the cache was drawn
+	bool m_bCacheValid;
+
+	bool _drawCached(float32 fCurTime);	//Draw through the texture cache. Returns false if we can't
+	void _freeCache();
 
 public:
 	HUDGroup(string sName);
 	~HUDGroup();
 
-	bool event(SDL_Event event);						//If this event matches any of our keys, set alpha to 255
+	bool handle(SDL_Event event);						//If this event matches any of our keys, set alpha to 255
+	void routes(vector<HUDRoute>* lRoutes);
 	void draw(float32 fCurTime);						//Override draw so can draw members with low alpha and such
 
+	float32 scale;	//Scale of the whole group about the HUD origin (applied to the cached texture if static)
+
+	void	setStatic(bool b)				{m_bStatic = b; m_bCacheValid = false;};
+	bool	isStatic()						{return m_bStatic;};
 	void	setFadeDelay(float32 fDelay)	{m_fFadeDelay = fDelay;};
 	float32 getFadeDelay()				  {return m_fFadeDelay;};
 	void	setFadeTime(float32 fTime)	  {m_fFadeTime = fTime;};
@@ -185,8 +231,10 @@ public:
 	list<menuItem> m_menu;
 	list<menuItem>::iterator m_selected;
 	
-	bool event(SDL_Event event);
+	bool handle(SDL_Event event);
+	void routes(vector<HUDRoute>* lRoutes);
 	void draw(float32 fCurTime);
+	uint32_t state();
 	void addMenuItem(menuItem it) {m_menu.push_back(it);};
 	
 };
@@ -199,8 +247,16 @@ protected:
 	map<string, Text*>  m_mFonts;
 	map<string, list<HUDItem*> > m_mScenes;
 	string m_sScene;
+	list<HUDItem*>* m_lCurScene;	//Items currently shown; NULL until the first setScene()
+	map<string, HUDItem*> m_mNames;	//All items by name, built in create()
+	map<HUDRoute, vector<HUDItem*> > m_mRoutes;	//Visible items interested in each input
+	list<HUDItem*>* m_lRoutedScene;	//Scene m_mRoutes was built for
+	bool m_bRoutesDirty;
 
 	HUDItem* _getItem(XMLElement* elem);	//Load the specific item pointed to (assumes elem != NULL)
+	void _index(HUDItem* it);				//Add this item and its children to the name index
+	void _route(HUDItem* it);				//Add this item and its children to the routing table, if visible
+	bool _dispatch(HUDRoute r, SDL_Event event);
 
 public:
 	HUD(string sName);
@@ -210,6 +266,24 @@ public:
 	void destroy(); //Free memory associated with HUD items
 	void setScene(string sScene);
 	string getScene()	{return m_sScene;};
+	HUDItem* getChild(string sName);	//Indexed lookup rather than walking the tree
+	bool event(SDL_Event event);		//Only passes events to the visible items that asked for them
+	void rebuildRoutes()	{m_bRoutesDirty = true;};	//Call if key bindings or item visibility change outside of setScene()
+};
+
+//Typed pointer to a named HUD item, looked up once and kept around
+template<class T> class HUDHandle
+{
+	T* m_item;
+
+public:
+	HUDHandle()		{m_item = NULL;};
+
+	void resolve(HUD* hud, string sName)	{m_item = (T*)hud->getChild(sName);};	//Must be redone whenever the HUD is recreated
+	void clear()							{m_item = NULL;};
+	T* get()								{return m_item;};
+	T* operator->()							{return m_item;};
+	operator T*()							{return m_item;};
 };
 
 
@@ -0,0 +1,290 @@
+/*
+	Pony48 source - logger.cpp
+	Copyright (c) 2014 Mark Hutcheson
+*/
+
+#include "logger.h"
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <algorithm>
+
+LogStream errlog;
+
+#ifdef _WIN32
+#define LOG_FMT_LL	"%I64d"
+#define LOG_FMT_ULL	"%I64u"
+#else
+#define LOG_FMT_LL	"%lld"
+#define LOG_FMT_ULL	"%llu"
+#endif
+
+static const char* g_logPrefix[] = {"DEBUG: ", "", "WARNING: ", "ERROR: "};
+
+//-------------------------------------------------------------------------------------
+// LogLine class functions
+//-------------------------------------------------------------------------------------
+LogLine::LogLine(LogStream* log, logLevel level)
+{
+	m_log = log;
+	m_level = level;
+	m_iLen = 0;
+	m_bActive = (level >= SDL_AtomicGet(&log->m_iMinLevel));
+}
+
+LogLine::LogLine(const LogLine& l)
+{
+	m_log = l.m_log;
+	m_level = l.m_level;
+	m_bActive = l.m_bActive;
+	m_iLen = l.m_iLen;
+	memcpy(m_cBuf, l.m_cBuf, m_iLen);
+	l.m_bActive = false;
+}
+
+LogLine::~LogLine()
+{
+	if(m_iLen)
+		_send();	//Whoever wrote this forgot the endl
+}
+
+void LogLine::_append(const char* c, uint32_t len)
+{
+	if(!m_bActive)
+		return;
+	if(len > LOG_LINE_SIZE - m_iLen)
+		len = LOG_LINE_SIZE - m_iLen;
+	memcpy(&m_cBuf[m_iLen], c, len);
+	m_iLen += len;
+}
+
+void LogLine::_format(const char* fmt, ...)
+{
+	if(!m_bActive)
+		return;
+	char cNum[64];
+	va_list args;
+	va_start(args, fmt);
+	int len = vsnprintf(cNum, sizeof(cNum), fmt, args);
+	va_end(args);
+	if(len > 0)
+		_append(cNum, min(len, (int)sizeof(cNum) - 1));
+}
+
+void LogLine::_send()
+{
+	if(m_bActive)
+		m_log->_push(m_level, m_cBuf, m_iLen);
+	m_bActive = false;
+	m_iLen = 0;
+}
+
+LogLine& LogLine::operator<<(const char* c)
+{
+	if(c == NULL)
+		c = "(null)";
+	_append(c, strlen(c));
+	return *this;
+}
+
+LogLine& LogLine::operator<<(const string& s)
+{
+	_append(s.data(), s.size());
+	return *this;
+}
+
+LogLine& LogLine::operator<<(char c)
+{
+	_append(&c, 1);
+	return *this;
+}
+
+LogLine& LogLine::operator<<(int i)					{_format("%d", i); return *this;}
+LogLine& LogLine::operator<<(unsigned int i)		{_format("%u", i); return *this;}
+LogLine& LogLine::operator<<(long i)				{_format("%ld", i); return *this;}
+LogLine& LogLine::operator<<(unsigned long i)		{_format("%lu", i); return *this;}
+LogLine& LogLine::operator<<(long long i)			{_format(LOG_FMT_LL, i); return *this;}
+LogLine& LogLine::operator<<(unsigned long long i)	{_format(LOG_FMT_ULL, i); return *this;}
+LogLine& LogLine::operator<<(double f)				{_format("%g", f); return *this;}	//Same as ostream's default formatting
+LogLine& LogLine::operator<<(const void* p)			{_format("%p", p); return *this;}
+
+LogLine& LogLine::operator<<(ostream& (*manip)(ostream&))
+{
+	_send();	//Only endl/flush make any sense here; either way, this line's done
+	return *this;
+}
+
+//-------------------------------------------------------------------------------------
+// LogStream class functions
+//-------------------------------------------------------------------------------------
+LogStream::LogStream()
+{
+	for(int i = 0; i < LOG_QUEUE_SIZE; i++)
+		SDL_AtomicSet(&m_slots[i].seq, i);
+	SDL_AtomicSet(&m_iHead, 0);
+	m_iTail = 0;
+	SDL_AtomicSet(&m_iTokens, LOG_BURST);
+	SDL_AtomicSet(&m_iLastRefill, 0);
+	SDL_AtomicSet(&m_iDropped, 0);
+#ifdef DEBUG
+	SDL_AtomicSet(&m_iMinLevel, LOG_DEBUG);
+#else
+	SDL_AtomicSet(&m_iMinLevel, LOG_INFO);
+#endif
+	SDL_AtomicSet(&m_bQuit, 0);
+	m_semWake = NULL;
+	m_thread = NULL;
+}
+
+LogStream::~LogStream()
+{
+	close();
+}
+
+void LogStream::open(const char* cFilename)
+{
+	m_file.clear();
+	m_file.open(cFilename);
+	if(m_file.fail() || m_thread != NULL)
+		return;
+
+	SDL_AtomicSet(&m_bQuit, 0);
+	m_semWake = SDL_CreateSemaphore(0);
+	m_thread = SDL_CreateThread(_writerThread, "logger", this);
+	if(m_thread == NULL)	//Can't write in the background; we'll have to do it on close()
+	{
+		SDL_DestroySemaphore(m_semWake);
+		m_semWake = NULL;
+	}
+}
+
+void LogStream::close()
+{
+	if(m_thread != NULL)
+	{
+		SDL_AtomicSet(&m_bQuit, 1);
+		SDL_SemPost(m_semWake);
+		SDL_WaitThread(m_thread, NULL);
+		SDL_DestroySemaphore(m_semWake);
+		m_thread = NULL;
+		m_semWake = NULL;
+	}
+	if(m_file.is_open())
+	{
+		_drain();	//Anything logged since the writer thread stopped
+		m_file.close();
+	}
+}
+
+void LogStream::_refill()
+{
+	Uint32 iNow = SDL_GetTicks();
+	Uint32 iLast = (Uint32)SDL_AtomicGet(&m_iLastRefill);
+	Uint32 iElapsed = iNow - iLast;
+	if(iElapsed < 1000 / LOG_RATE)
+		return;
+	
+	int iRefill;
+	Uint32 iRefilledTo;
+	if(iElapsed >= LOG_BURST * 1000 / LOG_RATE)	//Long enough to fill the bucket back up entirely
+	{
+		iRefill = LOG_BURST;
+		iRefilledTo = iNow;
+	}
+	else
+	{
+		iRefill = iElapsed * LOG_RATE / 1000;
+		iRefilledTo = iLast + iRefill * 1000 / LOG_RATE;	//Keep the remainder for next time
+	}
+	if(!SDL_AtomicCAS(&m_iLastRefill, (int)iLast, (int)iRefilledTo))
+		return;	//Another thread's refilling for this same stretch of time
+	
+	int iTokens = SDL_AtomicAdd(&m_iTokens, iRefill) + iRefill;
+	if(iTokens > LOG_BURST)
+		SDL_AtomicAdd(&m_iTokens, LOG_BURST - iTokens);
+}
+
+void LogStream::_push(logLevel level, const char* cText, uint32_t len)
+{
+	//Errors always get through; everything else gets throttled if something's spamming the log.
+	//Refilled here rather than on the writer thread, so throttling still lets up if there isn't one
+	if(level < LOG_ERROR)
+	{
+		_refill();
+		if(SDL_AtomicAdd(&m_iTokens, -1) <= 0)
+		{
+			SDL_AtomicAdd(&m_iTokens, 1);
+			SDL_AtomicAdd(&m_iDropped, 1);
+			return;
+		}
+	}
+
+	//Claim a slot (bounded multi-producer queue, as per Dmitry Vyukov)
+	int pos;
+	logSlot* slot;
+	for(;;)
+	{
+		pos = SDL_AtomicGet(&m_iHead);
+		slot = &m_slots[pos & (LOG_QUEUE_SIZE-1)];
+		int diff = SDL_AtomicGet(&slot->seq) - pos;
+		if(diff == 0)
+		{
+			if(SDL_AtomicCAS(&m_iHead, pos, pos + 1))
+				break;
+		}
+		else if(diff < 0)	//Queue's full; writer thread is way behind. Don't wait for it
+		{
+			SDL_AtomicAdd(&m_iDropped, 1);
+			return;
+		}
+		//else someone else just took this slot; try the next one
+	}
+
+	slot->level = level;
+	memcpy(slot->text, cText, len);
+	if(len < LOG_LINE_SIZE)
+		slot->text[len] = '\0';
+	else
+		slot->text[LOG_LINE_SIZE-1] = '\0';
+	SDL_AtomicSet(&slot->seq, pos + 1);	//Publish
+
+	if(m_semWake != NULL && level >= LOG_ERROR)
+		SDL_SemPost(m_semWake);	//Get errors onto disk as soon as we can, in case we're about to crash
+}
+
+bool LogStream::_drain()
+{
+	bool bWrote = false;
+	for(;;)
+	{
+		logSlot* slot = &m_slots[m_iTail & (LOG_QUEUE_SIZE-1)];
+		if(SDL_AtomicGet(&slot->seq) != m_iTail + 1)
+			break;	//Nothing more published yet
+		m_file << g_logPrefix[slot->level] << slot->text << '\n';
+		SDL_AtomicSet(&slot->seq, m_iTail + LOG_QUEUE_SIZE);	//Free for the next pass around the queue
+		m_iTail++;
+		bWrote = true;
+	}
+
+	int iDropped = SDL_AtomicSet(&m_iDropped, 0);
+	if(iDropped)
+	{
+		m_file << "(" << iDropped << " log lines dropped)" << '\n';
+		bWrote = true;
+	}
+	if(bWrote)
+		m_file.flush();
+	return bWrote;
+}
+
+int LogStream::_writerThread(void* data)
+{
+	LogStream* log = (LogStream*)data;
+	while(!SDL_AtomicGet(&log->m_bQuit))
+	{
+		SDL_SemWaitTimeout(log->m_semWake, LOG_WRITE_INTERVAL);
+		log->_drain();
+	}
+	log->_drain();
+	return 0;
+}
@@ -0,0 +1,117 @@
+/*
+	Pony48 header - logger.h
+	Asynchronous log file writer, so logging never waits on the disk
+	Copyright (c) 2014 Mark Hutcheson
+*/
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <string>
+#include <fstream>
+#ifdef USE_SDL_FRAMEWORK
+#include <SDL.h>
+#else
+#include <SDL2/SDL.h>
+#endif
+using namespace std;
+
+#define LOG_LINE_SIZE		512		//Longest line we'll log; anything past this is cut off
+#define LOG_QUEUE_SIZE		1024	//Lines waiting to be written (power of 2). If it fills up, new lines are dropped
+#define LOG_RATE			200		//Lines per second we'll sustain (errors are exempt)...
+#define LOG_BURST			400		//...after allowing a burst of this many
+#define LOG_WRITE_INTERVAL	100		//Milliseconds between checks for new lines, if we aren't woken up sooner
+
+typedef enum
+{
+	LOG_DEBUG,
+	LOG_INFO,		//Default for plain errlog << ...
+	LOG_WARN,
+	LOG_ERROR
+} logLevel;
+
+class LogStream;
+
+//One line of log output, built up in place and handed to the writer thread when it ends with endl (or goes out of scope)
+class LogLine
+{
+	friend class LogStream;
+
+	LogStream* m_log;
+	logLevel m_level;
+	mutable bool m_bActive;		//False once sent, or if this line is filtered out
+	uint32_t m_iLen;
+	char m_cBuf[LOG_LINE_SIZE];
+
+	LogLine(LogStream* log, logLevel level);
+	void _append(const char* c, uint32_t len);
+	void _format(const char* fmt, ...);
+	void _send();
+
+public:
+	LogLine(const LogLine& l);		//Takes over the line; l won't send it
+	~LogLine();
+
+	LogLine& operator<<(const char* c);
+	LogLine& operator<<(const string& s);
+	LogLine& operator<<(char c);
+	LogLine& operator<<(unsigned char c)	{return *this << (char)c;};
+	LogLine& operator<<(bool b)				{return *this << (int)b;};
+	LogLine& operator<<(int i);
+	LogLine& operator<<(unsigned int i);
+	LogLine& operator<<(long i);
+	LogLine& operator<<(unsigned long i);
+	LogLine& operator<<(long long i);
+	LogLine& operator<<(unsigned long long i);
+	LogLine& operator<<(double f);
+	LogLine& operator<<(float f)			{return *this << (double)f;};
+	LogLine& operator<<(const void* p);
+	LogLine& operator<<(ostream& (*manip)(ostream&));	//endl (or flush) sends the line
+};
+
+class LogStream
+{
+	friend class LogLine;
+
+	typedef struct
+	{
+		SDL_atomic_t seq;		//Which pass through the queue this slot is ready for
+		logLevel level;
+		char text[LOG_LINE_SIZE];
+	} logSlot;
+
+	ofstream m_file;
+	logSlot m_slots[LOG_QUEUE_SIZE];
+	SDL_atomic_t m_iHead;		//Next slot to write to (producers)
+	int m_iTail;				//Next slot to read from (writer thread only)
+	SDL_atomic_t m_iTokens;		//Token bucket for rate limiting
+	SDL_atomic_t m_iLastRefill;	//SDL_GetTicks() the bucket's been refilled up to
+	SDL_atomic_t m_iDropped;	//Lines lost to rate limiting or a full queue, since the last report
+	SDL_atomic_t m_iMinLevel;
+	SDL_atomic_t m_bQuit;
+	SDL_sem* m_semWake;
+	SDL_Thread* m_thread;
+
+	void _push(logLevel level, const char* cText, uint32_t len);	//Called by LogLine; never blocks
+	void _refill();					//Top up the rate limiter for the time that's passed. Any thread
+	bool _drain();					//Write everything queued. Returns true if anything was written
+	static int _writerThread(void* data);
+
+public:
+	LogStream();
+	~LogStream();
+
+	void open(const char* cFilename);	//Open log file and start writing to it in the background
+	bool fail()							{return m_file.fail();};
+	void close();						//Write out anything still queued and stop
+
+	void setLevel(logLevel level)		{SDL_AtomicSet(&m_iMinLevel, level);};	//Lines below this severity are ignored
+	logLevel getLevel()					{return (logLevel)SDL_AtomicGet(&m_iMinLevel);};
+
+	LogLine operator()(logLevel level)	{return LogLine(this, level);};	//errlog(LOG_WARN) << ...
+	template<class T> LogLine operator<<(const T& t)	{LogLine l(this, LOG_INFO); l << t; return l;};
+	LogLine operator<<(const char* c)	{LogLine l(this, LOG_INFO); l << c; return l;};
+};
+
+extern LogStream errlog;
+
+#endif
@@ -63,6 +63,16 @@ public:
 	{
 		g_pGlobalEngine->m_fSongFxRotate = fRot;
 	}
+	
+	static SongScheduler* getSchedule()
+	{
+		return &g_pGlobalEngine->m_songSchedule;
+	}
+	
+	static float32 getBeatTime(float32 fBeat)
+	{
+		return g_pGlobalEngine->songBeatTime(fBeat);
+	}
 };
 
 luaFunc(fireparticles)	//fireparticles(string particleSysName, bool bFire)
@@ -106,6 +116,19 @@ luaFunc(pinwheelspeed)	//pinwheelspeed(float speed)
 	luaReturnNil();
 }
 
+//Set the color of one spoke of a pinwheel background (0-indexed)
+luaFunc(setpinwheelcol)	//setpinwheelcol(int spoke, float r, float g, float b, float a)
+{
+	int spoke = lua_tointeger(L, 1);
+	Background* bgtest = PonyLua::getBg();
+	if(bgtest && bgtest->type == PINWHEEL && spoke >= 0)
+	{
+		pinwheelBg* bg = (pinwheelBg*)bgtest;
+		bg->setWheelCol(spoke, Color(lua_tonumber(L,2), lua_tonumber(L,3), lua_tonumber(L,4), lua_tonumber(L,5)));
+	}
+	luaReturnNil();
+}
+
 luaFunc(setcameraxy)	//setcameraxy(float x, float y)
 {
 	float32 x = lua_tonumber(L, 1);
@@ -235,12 +258,54 @@ luaFunc(setboardrot)	//setboardrot(float32 fAngleDeg)
 	luaReturnNil();
 }
 
+//Calls f(time, curtime) once the song gets to time, and every `every` seconds after that (up to `until`) if given. Returns an id for unschedule()
+luaFunc(schedule)	//schedule(float time, function f [, float every, float until])
+{
+	if(!lua_isfunction(L, 2))
+		luaReturnNil();
+	float32 fTime = lua_tonumber(L, 1);
+	float32 fEvery = lua_tonumber(L, 3);	//0 if not given
+	float32 fUntil = lua_isnumber(L, 4) ? lua_tonumber(L, 4) : -1.0f;
+	lua_pushvalue(L, 2);
+	int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	luaReturnInt(PonyLua::getSchedule()->add(fTime, ref, fEvery, fUntil));
+}
+
+//Same as schedule(), but in beats (0 being the first; fractions are fine). Put <lua> after <sfx>.
+//Beats come from the song's beat map, which only exists once the game's been run with -analyze; without one, it
+//falls back on <sfx bpm="" firstbeat=""> if the song gives them. Otherwise this warns and returns nil.
+luaFunc(schedulebeat)	//schedulebeat(float beat, function f [, float every, float until])
+{
+	if(!lua_isfunction(L, 2))
+		luaReturnNil();
+	float32 fBeat = lua_tonumber(L, 1);
+	float32 fTime = PonyLua::getBeatTime(fBeat);
+	if(fTime < 0.0f)
+	{
+		errlog(LOG_WARN) << "schedulebeat(): No beat map or <sfx bpm> for this song (run with -analyze to build one). Nothing scheduled" << endl;
+		luaReturnNil();
+	}
+	float32 fEvery = lua_tonumber(L, 3);
+	if(fEvery > 0.0f)
+		fEvery = PonyLua::getBeatTime(fBeat + fEvery) - fTime;
+	float32 fUntil = lua_isnumber(L, 4) ? PonyLua::getBeatTime(lua_tonumber(L, 4)) : -1.0f;
+	lua_pushvalue(L, 2);
+	int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	luaReturnInt(PonyLua::getSchedule()->add(fTime, ref, fEvery, fUntil));
+}
+
+luaFunc(unschedule)	//unschedule(int id)
+{
+	luaReturnBool(PonyLua::getSchedule()->remove(lua_tointeger(L, 1)));
+}
+
 static LuaFunctions s_functab[] =
 {
 	luaRegister(fireparticles),
 	luaRegister(showparticles),
 	luaRegister(resetparticles),
 	luaRegister(pinwheelspeed),
+	luaRegister(setpinwheelcol),
 	luaRegister(setcameraxy),
 	luaRegister(settilecol),
 	luaRegister(rumblecontroller),
@@ -252,6 +317,9 @@ static LuaFunctions s_functab[] =
 	luaRegister(setstarbgsize),
 	luaRegister(setstarbgcol),
 	luaRegister(setboardrot),
+	luaRegister(schedule),
+	luaRegister(schedulebeat),
+	luaRegister(unschedule),
 	//luaRegister(),
 	{NULL, NULL}
 };
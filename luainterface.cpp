@@ -51,7 +51,11 @@ bool LuaInterface::Init()
 {
 	if(!_lua)
 	{
+#ifdef USE_MEMTRACK
+		_lua = lua_newstate(memLuaAlloc, NULL);
+#else
 		_lua = luaL_newstate();
+#endif
 		if(!_lua)
 			return false;
 
@@ -127,6 +131,17 @@ bool LuaInterface::doCall(int nparams, int nrets /* = 0 */)
     return true;
 }
 
+bool LuaInterface::doBuffer(const char *buf, unsigned int len, const char *chunkname)
+{
+    if(luaL_loadbuffer(_lua, buf, len, chunkname) != LUA_OK)
+    {
+        printCallstack(_lua, getCStr(_lua, -1));
+        lua_pop(_lua, 1);
+        return false;
+    }
+    return doCall(0);
+}
+
 bool LuaInterface::call(const char *func)
 {
     lookupFunc(func);
@@ -169,6 +184,19 @@ bool LuaInterface::call(const char *func, const char *a, const char *b)
 	return doCall(2);
 }
 
+bool LuaInterface::callRef(int ref, float a, float b)
+{
+    lua_rawgeti(_lua, LUA_REGISTRYINDEX, ref);
+    lua_pushnumber(_lua, a);
+    lua_pushnumber(_lua, b);
+    return doCall(2);
+}
+
+void LuaInterface::unref(int ref)
+{
+    luaL_unref(_lua, LUA_REGISTRYINDEX, ref);
+}
+
 bool LuaInterface::call(const char *func, float f)
 {
     lookupFunc(func);
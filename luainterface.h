@@ -15,6 +15,7 @@ public:
     void GC();
     unsigned int MemUsed();
 
+    bool doBuffer(const char *buf, unsigned int len, const char *chunkname);	//Like dofile, for a file that's already been read in
     bool call(const char *f);
     bool call(const char *f, const char *);
     bool call(const char *f, const char *a, const char *b);
@@ -25,6 +26,8 @@ public:
 	bool call(const char *func, int a, int b, int c, int d, int e);
 	bool call(const char *func, const char *a, const char *b, const char *c, const char *d, const char *e);
 	bool call(const char *func, const char *a, const char *b, const char *c, const char *d);
+	bool callRef(int ref, float a, float b);	//Call a function stashed in the registry with luaL_ref()
+	void unref(int ref);
 
 protected:
 
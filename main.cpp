@@ -17,6 +17,8 @@ int SDL_main(int argc, char *argv[])
 int main(int argc, char** argv)
 #endif
 {
+	g_replay.commandline(argc, argv);	//Before the engine exists, so its window, clock, and random seed start out right
+	Engine::audioCommandline(argc, argv);	//Likewise for FMOD's output
 	FreeImage_Initialise();
 	
 	LuaInterface Lua("res/lua/init.lua", argc, argv);
@@ -31,6 +33,8 @@ int main(int argc, char** argv)
 
 	eng->commandline(lCommandLine);
 	eng->start(); //Get the engine rolling
+	g_replay.setOutcome(eng->getScore(), eng->getBoardHash());	//So playback can tell if it ended up in a different game
+	int iRet = g_replay.finish();	//Save the recording or report on the playback, if there was one
 	
 	//Done main loop; exit program	
 	errlog << "Deleting engine" << endl;
@@ -39,5 +43,5 @@ int main(int argc, char** argv)
 	FreeImage_DeInitialise();
 	errlog << "Ending program happily" << endl;
 	errlog.close();
-	return 0;
+	return iRet;
 }
@@ -0,0 +1,212 @@
+/*
+	Pony48 source - memtrack.cpp
+	Copyright (c) 2014 Mark Hutcheson
+*/
+
+#include "memtrack.h"
+
+#ifdef USE_MEMTRACK
+
+#include "profiler.h"
+#include <fmod.h>
+#include <cstdlib>
+#include <new>
+
+#ifdef _MSC_VER
+#define MEM_TLS __declspec(thread)
+#else
+#define MEM_TLS __thread
+#endif
+
+//Stashed in front of every block we hand out, so frees know what to subtract from where
+typedef union
+{
+	struct
+	{
+		size_t size;
+		int tag;
+	} info;
+	char pad[16];	//Keep the returned block as aligned as malloc's
+} memHeader;
+
+typedef struct
+{
+	SDL_atomic_t liveBytes, liveAllocs, frameBytes, frameAllocs;
+} memCounters;
+
+//Plain zero-initialized data, so it's valid before any constructors run (global new gets called very early)
+static memCounters g_memCounters[MEM_NUM_TAGS];
+static memStats g_memLastFrame[MEM_NUM_TAGS];
+static MEM_TLS int g_memTag = MEM_OTHER;
+
+static const char* g_memTagNames[MEM_NUM_TAGS] = {"other", "particles", "board", "hudtext", "xml", "lua", "fmod"};
+#ifdef USE_PROFILER
+static const char* g_memLiveCounters[MEM_NUM_TAGS] = {"KB other", "KB particles", "KB board", "KB hudtext", "KB xml", "KB lua", "KB fmod"};
+static const char* g_memFrameCounters[MEM_NUM_TAGS] = {"allocs/frame other", "allocs/frame particles", "allocs/frame board",
+	"allocs/frame hudtext", "allocs/frame xml", "allocs/frame lua", "allocs/frame fmod"};
+#endif
+
+static inline void _memCount(int tag, int bytes)
+{
+	memCounters* c = &g_memCounters[tag];
+	SDL_AtomicAdd(&c->liveBytes, bytes);
+	if(bytes > 0)
+	{
+		SDL_AtomicAdd(&c->liveAllocs, 1);
+		SDL_AtomicAdd(&c->frameAllocs, 1);
+		SDL_AtomicAdd(&c->frameBytes, bytes);
+	}
+	else
+		SDL_AtomicAdd(&c->liveAllocs, -1);
+}
+
+static void* _memAlloc(size_t size, int tag)
+{
+	memHeader* h = (memHeader*)malloc(size + sizeof(memHeader));
+	if(h == NULL)
+		return NULL;
+	h->info.size = size;
+	h->info.tag = tag;
+	_memCount(tag, (int)size);
+	return h + 1;
+}
+
+static void _memFree(void* ptr)
+{
+	if(ptr == NULL)
+		return;
+	memHeader* h = (memHeader*)ptr - 1;
+	_memCount(h->info.tag, -(int)h->info.size);
+	free(h);
+}
+
+static void* _memRealloc(void* ptr, size_t size, int tag)
+{
+	if(ptr == NULL)
+		return _memAlloc(size, tag);
+	memHeader* h = (memHeader*)ptr - 1;
+	int oldTag = h->info.tag;
+	size_t oldSize = h->info.size;
+	memHeader* h2 = (memHeader*)realloc(h, size + sizeof(memHeader));
+	if(h2 == NULL)
+		return NULL;
+	_memCount(oldTag, -(int)oldSize);
+	h2->info.size = size;
+	h2->info.tag = tag;
+	_memCount(tag, (int)size);
+	return h2 + 1;
+}
+
+//-------------------------------------------------------------------------------------
+// Global new/delete
+//-------------------------------------------------------------------------------------
+void* operator new(size_t size)
+{
+	void* p = _memAlloc(size, g_memTag);
+	if(p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	void* p = _memAlloc(size, g_memTag);
+	if(p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) throw()		{return _memAlloc(size, g_memTag);}
+void* operator new[](size_t size, const std::nothrow_t&) throw()	{return _memAlloc(size, g_memTag);}
+void operator delete(void* p) throw()								{_memFree(p);}
+void operator delete[](void* p) throw()								{_memFree(p);}
+void operator delete(void* p, const std::nothrow_t&) throw()		{_memFree(p);}
+void operator delete[](void* p, const std::nothrow_t&) throw()		{_memFree(p);}
+
+//-------------------------------------------------------------------------------------
+// Lua and FMOD allocators
+//-------------------------------------------------------------------------------------
+void* memLuaAlloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+	if(nsize == 0)
+	{
+		_memFree(ptr);
+		return NULL;
+	}
+	return _memRealloc(ptr, nsize, MEM_LUA);
+}
+
+static void* F_CALLBACK _memFMODAlloc(unsigned int size, FMOD_MEMORY_TYPE type, const char* sourcestr)
+{
+	return _memAlloc(size, MEM_FMOD);
+}
+
+static void* F_CALLBACK _memFMODRealloc(void* ptr, unsigned int size, FMOD_MEMORY_TYPE type, const char* sourcestr)
+{
+	return _memRealloc(ptr, size, MEM_FMOD);
+}
+
+static void F_CALLBACK _memFMODFree(void* ptr, FMOD_MEMORY_TYPE type, const char* sourcestr)
+{
+	_memFree(ptr);
+}
+
+bool memInitFMOD()
+{
+	return FMOD_Memory_Initialize(NULL, 0, _memFMODAlloc, _memFMODRealloc, _memFMODFree, FMOD_MEMORY_ALL) == FMOD_OK;
+}
+
+//-------------------------------------------------------------------------------------
+// Stats
+//-------------------------------------------------------------------------------------
+memTag memSetTag(memTag tag)
+{
+	memTag prev = (memTag)g_memTag;
+	g_memTag = tag;
+	return prev;
+}
+
+void memFrame()
+{
+	for(int i = 0; i < MEM_NUM_TAGS; i++)
+	{
+		memCounters* c = &g_memCounters[i];
+		memStats* s = &g_memLastFrame[i];
+		s->frameAllocs = SDL_AtomicSet(&c->frameAllocs, 0);
+		s->frameBytes = SDL_AtomicSet(&c->frameBytes, 0);
+#ifdef USE_PROFILER
+		profileCounter(g_memLiveCounters[i], SDL_AtomicGet(&c->liveBytes) / 1024.0);
+		profileCounter(g_memFrameCounters[i], s->frameAllocs);
+#endif
+	}
+}
+
+memStats memGetStats(memTag tag)
+{
+	memStats s = g_memLastFrame[tag];
+	s.liveBytes = SDL_AtomicGet(&g_memCounters[tag].liveBytes);
+	s.liveAllocs = SDL_AtomicGet(&g_memCounters[tag].liveAllocs);
+	return s;
+}
+
+memStats memGetTotal()
+{
+	memStats total;
+	total.liveBytes = total.liveAllocs = total.frameBytes = total.frameAllocs = 0;
+	for(int i = 0; i < MEM_NUM_TAGS; i++)
+	{
+		memStats s = memGetStats((memTag)i);
+		total.liveBytes += s.liveBytes;
+		total.liveAllocs += s.liveAllocs;
+		total.frameBytes += s.frameBytes;
+		total.frameAllocs += s.frameAllocs;
+	}
+	return total;
+}
+
+const char* memTagName(memTag tag)
+{
+	return g_memTagNames[tag];
+}
+
+#endif	//USE_MEMTRACK
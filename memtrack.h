@@ -0,0 +1,71 @@
+/*
+	Pony48 header - memtrack.h
+	Heap allocation accounting, per frame and per tagged subsystem
+	Copyright (c) 2014 Mark Hutcheson
+*/
+#ifndef MEMTRACK_H
+#define MEMTRACK_H
+
+#include <cstddef>
+#ifdef USE_SDL_FRAMEWORK
+#include <SDL.h>
+#else
+#include <SDL2/SDL.h>
+#endif
+
+//Build with -DUSE_MEMTRACK to replace global new/delete with counting versions, and route Lua and FMOD
+//through them as well. Otherwise MEM_TAG() compiles away to nothing.
+
+typedef enum
+{
+	MEM_OTHER,		//Anything not inside a MEM_TAG() scope
+	MEM_PARTICLES,
+	MEM_BOARD,
+	MEM_HUDTEXT,
+	MEM_XML,
+	MEM_LUA,		//Lua's allocator, whatever the current tag
+	MEM_FMOD,		//FMOD's allocator, whatever the current tag
+	MEM_NUM_TAGS
+} memTag;
+
+#ifdef USE_MEMTRACK
+
+#define MEM_OVERLAY_KEY		SDL_SCANCODE_F9	//Toggle the allocation overlay while the game is running
+
+//Attribute allocations on this thread to a subsystem until the end of the scope
+#define MEM_TAG(tag)		MemTagScope MEM_CONCAT(_memTag, __LINE__)(tag)
+#define MEM_CONCAT2(a, b)	a##b
+#define MEM_CONCAT(a, b)	MEM_CONCAT2(a, b)
+
+typedef struct
+{
+	int liveBytes;		//Currently allocated
+	int liveAllocs;
+	int frameBytes;		//Allocated during the last whole frame
+	int frameAllocs;
+} memStats;
+
+memTag memSetTag(memTag tag);				//Returns the previous tag for this thread
+void memFrame();							//Call once per frame to roll over the per-frame counts (and send them to the profiler)
+memStats memGetStats(memTag tag);
+memStats memGetTotal();						//Sum over all tags
+const char* memTagName(memTag tag);
+void* memLuaAlloc(void* ud, void* ptr, size_t osize, size_t nsize);	//lua_Alloc for lua_newstate()
+bool memInitFMOD();							//Hook FMOD's allocator. Call before FMOD_System_Create()
+
+class MemTagScope
+{
+	memTag m_prev;
+
+public:
+	MemTagScope(memTag tag)	{m_prev = memSetTag(tag);};
+	~MemTagScope()			{memSetTag(m_prev);};
+};
+
+#else
+
+#define MEM_TAG(tag)
+
+#endif	//USE_MEMTRACK
+
+#endif
@@ -20,12 +20,14 @@
 #define GLAPIENTRY
 #endif
 
+static unsigned int g_iGLCalls = 0;	//Calls through any stub since the last ResetCallCount()
+
 // Populate global namespace with static function pointers pFUNC,
 // and function stubs FUNC that call their associated function pointer
 #define GL_FUNC(ret,fn,params,call,rt) \
     extern "C" { \
     static ret (GLAPIENTRY *p##fn) params = NULL; \
-    ret fn params { rt p##fn call; } \
+    ret fn params { g_iGLCalls++; rt p##fn call; } \
     }
 
 #include "opengl-stubs.h"
@@ -62,6 +64,28 @@ bool LoadSymbols()
     return lookup_all_glsyms();
 }
 
+bool HasFramebuffers()
+{
+    return pglGenFramebuffersEXT && pglDeleteFramebuffersEXT && pglBindFramebufferEXT && pglFramebufferTexture2DEXT &&
+           pglCheckFramebufferStatusEXT && pglGenRenderbuffersEXT && pglDeleteRenderbuffersEXT && pglBindRenderbufferEXT &&
+           pglRenderbufferStorageEXT && pglFramebufferRenderbufferEXT;
+}
+
+bool HasBlendFuncSeparate()
+{
+    return pglBlendFuncSeparateEXT != NULL;
+}
+
+void ResetCallCount()
+{
+    g_iGLCalls = 0;
+}
+
+unsigned int GetCallCount()
+{
+    return g_iGLCalls;
+}
+
 void ClearSymbols()
 {
     // reset all the entry points to NULL, so we know exactly what happened
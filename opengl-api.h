@@ -8,6 +8,25 @@ namespace OpenGLAPI
     void ClearSymbols();
     void ResetCallCount();
     unsigned int GetCallCount();
+    bool HasFramebuffers();	//If EXT_framebuffer_object functions were found
+    bool HasBlendFuncSeparate();	//If EXT_blend_func_separate was found
+};
+
+//Extension functions we stub ourselves, which GL headers only declare with GL_GLEXT_PROTOTYPES
+//(include after the GL headers)
+extern "C"
+{
+    void glGenFramebuffersEXT(GLsizei n, GLuint *framebuffers);
+    void glDeleteFramebuffersEXT(GLsizei n, const GLuint *framebuffers);
+    void glBindFramebufferEXT(GLenum target, GLuint framebuffer);
+    void glFramebufferTexture2DEXT(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
+    GLenum glCheckFramebufferStatusEXT(GLenum target);
+    void glGenRenderbuffersEXT(GLsizei n, GLuint *renderbuffers);
+    void glDeleteRenderbuffersEXT(GLsizei n, const GLuint *renderbuffers);
+    void glBindRenderbufferEXT(GLenum target, GLuint renderbuffer);
+    void glRenderbufferStorageEXT(GLenum target, GLenum internalformat, GLsizei width, GLsizei height);
+    void glFramebufferRenderbufferEXT(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer);
+    void glBlendFuncSeparateEXT(GLenum sfactorRGB, GLenum dfactorRGB, GLenum sfactorAlpha, GLenum dfactorAlpha);
 };
 
 
@@ -37,6 +37,21 @@ GL_FUNC(void,glTexParameteri,(GLenum target, GLenum pname, GLint param),(target,
 GL_FUNC(void,glPixelStorei,(GLenum pname, GLint param),(pname,param),)
 GL_FUNC(void,glTexSubImage2D,(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid *pixels),(target,level,xoffset,yoffset,width,height, format,type,pixels),)
 
+// framebuffer objects (EXT_framebuffer_object; check OpenGLAPI::HasFramebuffers() before using)
+GL_FUNC(void,glGenFramebuffersEXT,(GLsizei n, GLuint *framebuffers),(n,framebuffers),)
+GL_FUNC(void,glDeleteFramebuffersEXT,(GLsizei n, const GLuint *framebuffers),(n,framebuffers),)
+GL_FUNC(void,glBindFramebufferEXT,(GLenum target, GLuint framebuffer),(target,framebuffer),)
+GL_FUNC(void,glFramebufferTexture2DEXT,(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level),(target,attachment,textarget,texture,level),)
+GL_FUNC(GLenum,glCheckFramebufferStatusEXT,(GLenum target),(target),return)
+GL_FUNC(void,glGenRenderbuffersEXT,(GLsizei n, GLuint *renderbuffers),(n,renderbuffers),)
+GL_FUNC(void,glDeleteRenderbuffersEXT,(GLsizei n, const GLuint *renderbuffers),(n,renderbuffers),)
+GL_FUNC(void,glBindRenderbufferEXT,(GLenum target, GLuint renderbuffer),(target,renderbuffer),)
+GL_FUNC(void,glRenderbufferStorageEXT,(GLenum target, GLenum internalformat, GLsizei width, GLsizei height),(target,internalformat,width,height),)
+GL_FUNC(void,glFramebufferRenderbufferEXT,(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer),(target,attachment,renderbuffertarget,renderbuffer),)
+
+// separate alpha blending (EXT_blend_func_separate; check OpenGLAPI::HasBlendFuncSeparate() before using)
+GL_FUNC(void,glBlendFuncSeparateEXT,(GLenum sfactorRGB, GLenum dfactorRGB, GLenum sfactorAlpha, GLenum dfactorAlpha),(sfactorRGB,dfactorRGB,sfactorAlpha,dfactorAlpha),)
+
 // deprecated?
 GL_FUNC(void,glBegin,(GLenum e),(e),)
 GL_FUNC(void,glEnd,(void),(),)
@@ -52,6 +67,7 @@ GL_FUNC(void,glTranslatef,(GLfloat x, GLfloat y, GLfloat z),(x,y,z),)
 // drawing
 GL_FUNC(void,glVertexPointer,(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer),(size,type,stride,pointer),)
 GL_FUNC(void,glTexCoordPointer,(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer),(size,type,stride,pointer),)
+GL_FUNC(void,glColorPointer,(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer),(size,type,stride,pointer),)
 GL_FUNC(void,glDrawArrays,(GLenum mode, GLint first, GLsizei count),(mode,first,count),)
 
 GL_FUNC(void,glVertex3f,(GLfloat x, GLfloat y, GLfloat z),(x,y,z),)
@@ -74,15 +90,6 @@ GL_FUNC(void,glHint,(GLenum target,  GLenum mode),(target,mode),)
 GL_FUNC(void,glShadeModel,(GLenum  mode),(mode),)
 GL_FUNC(void,glLightfv,(GLenum light, GLenum pname, const GLfloat *params),(light,pname,params),)
 
-//Win32 context stuff
-#ifdef _WIN32
-#include <windows.h>
-GL_FUNC(HGLRC,wglCreateContext,(HDC hdc),(hdc),)
-GL_FUNC(HGLRC,wglGetCurrentContext,(void),(),)
-GL_FUNC(BOOL,wglShareLists,(HGLRC hglrc1, HGLRC hglrc2),(hglrc1, hglrc2),)
-GL_FUNC(BOOL,wglDeleteContext,(HGLRC hglrc),(hglrc),)
-#endif
-
 
 
 
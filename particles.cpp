@@ -250,6 +250,7 @@ void ParticleSystem::_initValues()
 
 void ParticleSystem::update(float32 dt)
 {
+	MEM_TAG(MEM_PARTICLES);
 	if(!show) return;
 	curTime += dt;
 	if(startedFiring)
@@ -421,24 +422,34 @@ void ParticleSystem::init()
 
 void ParticleSystem::fromXML(string sXMLFilename)
 {
-	_initValues();
-	
-	XMLDocument* doc = new XMLDocument();
-    int iErr = doc->LoadFile(sXMLFilename.c_str());
+	XMLDocument* doc;
+	int iErr;
+	{
+		MEM_TAG(MEM_XML);
+		doc = new XMLDocument();
+		iErr = doc->LoadFile(sXMLFilename.c_str());
+	}
 	if(iErr != XML_NO_ERROR)
 	{
-		errlog << "Error parsing XML file " << sXMLFilename << ": Error " << iErr << endl;
+		errlog(LOG_ERROR) << "Error parsing XML file " << sXMLFilename << ": Error " << iErr << endl;
+		_initValues();
 		delete doc;
 		return;
 	}
-	
+	fromXML(doc, sXMLFilename);
+	delete doc;
+}
+
+void ParticleSystem::fromXML(XMLDocument* doc, string sXMLFilename)
+{
+	MEM_TAG(MEM_PARTICLES);
+	_initValues();
 	m_sXMLFrom = sXMLFilename;
 
     XMLElement* root = doc->FirstChildElement("particlesystem");
     if(root == NULL)
 	{
-		errlog << "Error: No toplevel \"particlesystem\" item in XML file " << sXMLFilename << endl;
-		delete doc;
+		errlog(LOG_ERROR) << "No toplevel \"particlesystem\" item in XML file " << sXMLFilename << endl;
 		return;
 	}
 	
@@ -594,10 +605,9 @@ void ParticleSystem::fromXML(string sXMLFilename)
 			}
 		}
 		else
-			errlog << "Warning: Unknown element type \"" << sName << "\" found in XML file " << sXMLFilename << ". Ignoring..." << endl;
+			errlog(LOG_WARN) << "Unknown element type \"" << sName << "\" found in XML file " << sXMLFilename << ". Ignoring..." << endl;
 	}
 	
-	delete doc;
 	init();
 }
 
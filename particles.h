@@ -111,6 +111,7 @@ public:
 	void draw();
 	void init();
 	void fromXML(string sXMLFilename);		//Load particle definitions from XML file
+	void fromXML(XMLDocument* doc, string sXMLFilename);	//Same, from an already-parsed file
 	uint32_t count() {return m_num;};		//How many particles are currently alive (read-only because reasons)
 	void killParticles()	{m_num=0;};		//Kill all active particles
 	void reload()			{fromXML(m_sXMLFrom);};	//Reload 
@@ -0,0 +1,137 @@
+/*
+	Pony48 source - profiler.cpp
+	Copyright (c) 2014 Mark Hutcheson
+*/
+
+#include "profiler.h"
+
+#ifdef USE_PROFILER
+
+#include <vector>
+
+#ifdef _MSC_VER
+#define PROFILE_TLS __declspec(thread)
+#else
+#define PROFILE_TLS __thread
+#endif
+
+typedef struct
+{
+	const char* name;
+	Uint64 start, end;	//For counters, end is 0
+	double value;
+} profileEvent;
+
+//Ring of zones written by one thread only. The dump reads it without stopping the writer, so a zone
+//being written right then may come out garbled; that's fine for a debugging tool
+class ProfileThread
+{
+public:
+	profileEvent* events;
+	SDL_atomic_t count;		//Total zones ever written; events[count % PROFILE_RING_SIZE] is next
+	SDL_threadID id;
+	string name;
+};
+
+static PROFILE_TLS ProfileThread* g_profileThread = NULL;
+static vector<ProfileThread*> g_profileThreads;
+static SDL_mutex* g_profileLock = SDL_CreateMutex();
+static Uint64 g_profileStart = SDL_GetPerformanceCounter();
+
+static ProfileThread* _profileThread()
+{
+	if(g_profileThread == NULL)
+	{
+		ProfileThread* pt = new ProfileThread;
+		pt->events = new profileEvent[PROFILE_RING_SIZE];
+		SDL_AtomicSet(&pt->count, 0);
+		pt->id = SDL_ThreadID();
+		SDL_LockMutex(g_profileLock);
+		g_profileThreads.push_back(pt);
+		SDL_UnlockMutex(g_profileLock);
+		g_profileThread = pt;
+	}
+	return g_profileThread;
+}
+
+void profileZone(const char* cName, Uint64 iStart, Uint64 iEnd)
+{
+	ProfileThread* pt = _profileThread();
+	int i = SDL_AtomicGet(&pt->count);
+	profileEvent* ev = &pt->events[i & (PROFILE_RING_SIZE-1)];
+	ev->name = cName;
+	ev->start = iStart;
+	ev->end = iEnd;
+	SDL_AtomicSet(&pt->count, i + 1);
+}
+
+void profileCounter(const char* cName, double fValue)
+{
+	ProfileThread* pt = _profileThread();
+	int i = SDL_AtomicGet(&pt->count);
+	profileEvent* ev = &pt->events[i & (PROFILE_RING_SIZE-1)];
+	ev->name = cName;
+	ev->start = SDL_GetPerformanceCounter();
+	ev->end = 0;
+	ev->value = fValue;
+	SDL_AtomicSet(&pt->count, i + 1);
+}
+
+void profileThreadName(const char* cName)
+{
+	_profileThread()->name = cName;
+}
+
+bool profileDump(string sFilename)
+{
+	ofstream ofs(sFilename.c_str());
+	if(ofs.fail())
+	{
+		errlog(LOG_ERROR) << "Unable to open " << sFilename << " to write profiler trace" << endl;
+		return false;
+	}
+
+	double fUsPerTick = 1000000.0 / (double)SDL_GetPerformanceFrequency();
+	uint32_t iWritten = 0;
+	ofs.precision(3);
+	ofs << fixed << "{\"traceEvents\":[";
+	SDL_LockMutex(g_profileLock);
+	for(vector<ProfileThread*>::iterator i = g_profileThreads.begin(); i != g_profileThreads.end(); i++)
+	{
+		ProfileThread* pt = *i;
+		if(pt->name.size())
+		{
+			ofs << (iWritten++ ? ",\n" : "\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << pt->id
+				<< ",\"args\":{\"name\":\"" << pt->name << "\"}}";
+		}
+
+		//Oldest zone still in the ring first
+		int iCount = SDL_AtomicGet(&pt->count);
+		int iFirst = max(iCount - PROFILE_RING_SIZE, 0);
+		for(int j = iFirst; j < iCount; j++)
+		{
+			const profileEvent& ev = pt->events[j & (PROFILE_RING_SIZE-1)];
+			if(ev.start < g_profileStart)
+				continue;
+			if(ev.end == 0)
+			{
+				ofs << (iWritten++ ? ",\n" : "\n") << "{\"name\":\"" << ev.name << "\",\"ph\":\"C\",\"pid\":1,\"tid\":" << pt->id
+					<< ",\"ts\":" << (double)(ev.start - g_profileStart) * fUsPerTick
+					<< ",\"args\":{\"value\":" << ev.value << "}}";
+				continue;
+			}
+			if(ev.end < ev.start)
+				continue;
+			ofs << (iWritten++ ? ",\n" : "\n") << "{\"name\":\"" << ev.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << pt->id
+				<< ",\"ts\":" << (double)(ev.start - g_profileStart) * fUsPerTick
+				<< ",\"dur\":" << (double)(ev.end - ev.start) * fUsPerTick << "}";
+		}
+	}
+	SDL_UnlockMutex(g_profileLock);
+	ofs << "\n]}" << endl;
+
+	errlog << "Wrote " << iWritten << " profiler events to " << sFilename << endl;
+	return true;
+}
+
+#endif	//USE_PROFILER
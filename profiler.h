@@ -0,0 +1,49 @@
+/*
+	Pony48 header - profiler.h
+	Scoped timing zones, recorded per thread and dumped as Chrome trace_event JSON
+	Copyright (c) 2014 Mark Hutcheson
+*/
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "globaldefs.h"
+
+//Build with -DUSE_PROFILER to record anything; otherwise every macro here compiles away to nothing.
+//Open a dump in Chrome's about:tracing (or ui.perfetto.dev) to look at it.
+
+#ifdef USE_PROFILER
+
+#define PROFILE_RING_SIZE	65536			//Zones kept per thread (power of 2). Older ones are overwritten
+#define PROFILE_DUMP_KEY	SDL_SCANCODE_F12	//Dump a trace while the game is running
+
+//Time one scope. Name must be a string literal (or otherwise outlive the profiler)
+#define PROFILE_ZONE(name)			ProfileZone PROFILE_CONCAT(_profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name)		profileThreadName(name)
+#define PROFILE_DUMP(filename)		profileDump(filename)
+#define PROFILE_CONCAT2(a, b)		a##b
+#define PROFILE_CONCAT(a, b)		PROFILE_CONCAT2(a, b)
+
+void profileZone(const char* cName, Uint64 iStart, Uint64 iEnd);	//Record a finished zone for the calling thread
+void profileThreadName(const char* cName);						//Name the calling thread in the trace
+void profileCounter(const char* cName, double fValue);				//Record a counter sample (graphed over time in the trace)
+bool profileDump(string sFilename);								//Write everything recorded so far
+
+class ProfileZone
+{
+	const char* m_cName;
+	Uint64 m_iStart;
+
+public:
+	ProfileZone(const char* cName)	{m_cName = cName; m_iStart = SDL_GetPerformanceCounter();};
+	~ProfileZone()					{profileZone(m_cName, m_iStart, SDL_GetPerformanceCounter());};
+};
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_THREAD(name)
+#define PROFILE_DUMP(filename)
+
+#endif	//USE_PROFILER
+
+#endif
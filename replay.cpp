@@ -0,0 +1,329 @@
+/*
+	Pony48 source - replay.cpp
+	Copyright (c) 2014 Mark Hutcheson
+*/
+
+#include "replay.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+Replay g_replay;
+
+Replay::Replay()
+{
+	m_mode = REPLAY_OFF;
+	m_iSeed = 0;
+	m_fFramerate = 60.0f;
+	m_iFrame = m_iFrames = 0;
+	m_iNext = 0;
+	memset(m_iKeys, 0, sizeof(m_iKeys));
+	m_iMouseButtons = 0;
+	m_iScore = m_iBoardHash = 0;
+	m_iRecordedScore = m_iRecordedBoardHash = 0;
+}
+
+void Replay::commandline(int argc, char** argv)
+{
+	for(int i = 1; i < argc - 1; i++)
+	{
+		string sSwitch = argv[i];
+		if(sSwitch == "-record" || sSwitch == "--record")
+		{
+			m_mode = REPLAY_RECORD;
+			m_sFilename = argv[++i];
+			m_iSeed = SDL_GetTicks() ^ (Uint32)SDL_GetPerformanceCounter();
+		}
+		else if(sSwitch == "-replay" || sSwitch == "--replay")
+		{
+			m_sFilename = argv[++i];
+			if(_load(m_sFilename))
+				m_mode = REPLAY_PLAYBACK;
+		}
+		else if(sSwitch == "-baseline" || sSwitch == "--baseline")
+			m_sBaseline = argv[++i];
+	}
+}
+
+void Replay::recordEvent(const SDL_Event& event)
+{
+	if(m_mode != REPLAY_RECORD)
+		return;
+	switch(event.type)
+	{
+		case SDL_KEYDOWN:
+		case SDL_KEYUP:
+		case SDL_MOUSEMOTION:
+		case SDL_MOUSEBUTTONDOWN:
+		case SDL_MOUSEBUTTONUP:
+		case SDL_MOUSEWHEEL:
+		case SDL_JOYAXISMOTION:
+		case SDL_JOYBALLMOTION:
+		case SDL_JOYHATMOTION:
+		case SDL_JOYBUTTONDOWN:
+		case SDL_JOYBUTTONUP:
+		case SDL_CONTROLLERAXISMOTION:
+		case SDL_CONTROLLERBUTTONDOWN:
+		case SDL_CONTROLLERBUTTONUP:
+		{
+			replayEvent ev;
+			ev.frame = m_iFrame;
+			ev.event = event;
+			m_lEvents.push_back(ev);
+			break;
+		}
+		default:	//Window events and such depend on the machine, not the player
+			break;
+	}
+}
+
+bool Replay::nextEvent(SDL_Event* event)
+{
+	if(m_iNext >= m_lEvents.size() || m_lEvents[m_iNext].frame > m_iFrame)
+		return false;
+	*event = m_lEvents[m_iNext++].event;
+
+	//Track what the game would otherwise poll SDL for
+	switch(event->type)
+	{
+		case SDL_KEYDOWN:
+		case SDL_KEYUP:
+			if(event->key.keysym.scancode < SDL_NUM_SCANCODES)
+				m_iKeys[event->key.keysym.scancode] = (event->type == SDL_KEYDOWN);
+			break;
+		case SDL_MOUSEBUTTONDOWN:
+			m_iMouseButtons |= SDL_BUTTON(event->button.button);
+			break;
+		case SDL_MOUSEBUTTONUP:
+			m_iMouseButtons &= ~SDL_BUTTON(event->button.button);
+			break;
+	}
+	return true;
+}
+
+void Replay::addFrame(float32 fMs, int iAllocs, uint32_t iGLCalls)
+{
+	m_lFrameMs.push_back(fMs);
+	m_lAllocs.push_back(iAllocs);
+	m_lGLCalls.push_back(iGLCalls);
+}
+
+int Replay::finish()
+{
+	if(m_mode == REPLAY_RECORD)
+	{
+		m_iFrames = m_iFrame;
+		m_sRecordedSong = m_sSong;
+		m_iRecordedScore = m_iScore;
+		m_iRecordedBoardHash = m_iBoardHash;
+		return _save() ? 0 : 1;
+	}
+	if(m_mode != REPLAY_PLAYBACK)
+		return 0;
+
+	if(m_iFrame < m_iFrames)
+		errlog(LOG_WARN) << "Replay stopped after " << m_iFrame << " of " << m_iFrames << " frames" << endl;
+	bool bDesynced = false;
+	if(m_sSong != m_sRecordedSong)
+	{
+		errlog(LOG_ERROR) << "Replay desynced: recording ended on song " << m_sRecordedSong << ", playback on " << m_sSong << endl;
+		bDesynced = true;
+	}
+	if(m_iScore != m_iRecordedScore || m_iBoardHash != m_iRecordedBoardHash)
+	{
+		errlog(LOG_ERROR) << "Replay desynced: recording ended with score " << m_iRecordedScore << " (board hash " << m_iRecordedBoardHash
+			<< "), playback with " << m_iScore << " (board hash " << m_iBoardHash << ")" << endl;
+		bDesynced = true;
+	}
+
+	replayStats stats = _stats();
+	printf("Replayed %u frames: frame time p50 %.2fms, p99 %.2fms, max %.2fms; %.1f allocations, %.1f GL calls per frame\n",
+		stats.frames, stats.frameMsP50, stats.frameMsP99, stats.frameMsMax, stats.allocsPerFrame, stats.glCallsPerFrame);
+	_writeStats(m_sFilename + ".json", stats);
+	if(bDesynced)
+	{
+		printf("Replay desynced from the recording, so these stats are for a different game; see err.log\n");
+		return 1;
+	}
+
+	if(!m_sBaseline.size())
+		return 0;
+	replayStats baseline;
+	if(!_readStats(m_sBaseline, &baseline))
+		return 1;
+	return _compare(baseline, stats) ? 0 : 1;
+}
+
+//-------------------------------------------------------------------------------------
+// Recording files
+//-------------------------------------------------------------------------------------
+bool Replay::_save()
+{
+	ofstream ofs(m_sFilename.c_str(), ios_base::binary);
+	if(ofs.fail())
+	{
+		errlog(LOG_ERROR) << "Unable to open " << m_sFilename << " to save recording" << endl;
+		return false;
+	}
+	uint32_t iMagic = REPLAY_MAGIC;
+	uint32_t iVersion = REPLAY_VERSION;
+	uint32_t iSongLen = m_sRecordedSong.size();
+	uint32_t iNumEvents = m_lEvents.size();
+	ofs.write((const char*)&iMagic, sizeof(iMagic));
+	ofs.write((const char*)&iVersion, sizeof(iVersion));
+	ofs.write((const char*)&m_iSeed, sizeof(m_iSeed));
+	ofs.write((const char*)&m_fFramerate, sizeof(m_fFramerate));
+	ofs.write((const char*)&m_iFrames, sizeof(m_iFrames));
+	ofs.write((const char*)&iSongLen, sizeof(iSongLen));
+	ofs.write(m_sRecordedSong.data(), iSongLen);
+	ofs.write((const char*)&m_iRecordedScore, sizeof(m_iRecordedScore));
+	ofs.write((const char*)&m_iRecordedBoardHash, sizeof(m_iRecordedBoardHash));
+	ofs.write((const char*)&iNumEvents, sizeof(iNumEvents));
+	if(iNumEvents)
+		ofs.write((const char*)&m_lEvents[0], iNumEvents * sizeof(replayEvent));
+	errlog << "Recorded " << m_iFrames << " frames and " << iNumEvents << " events to " << m_sFilename << endl;
+	return true;
+}
+
+bool Replay::_load(string sFilename)
+{
+	ifstream ifs(sFilename.c_str(), ios_base::binary);
+	if(ifs.fail())
+	{
+		errlog(LOG_ERROR) << "Unable to open recording " << sFilename << endl;
+		return false;
+	}
+	uint32_t iMagic = 0, iVersion = 0, iSongLen = 0, iNumEvents = 0;
+	ifs.read((char*)&iMagic, sizeof(iMagic));
+	ifs.read((char*)&iVersion, sizeof(iVersion));
+	if(iMagic != REPLAY_MAGIC || iVersion != REPLAY_VERSION)
+	{
+		errlog(LOG_ERROR) << sFilename << " isn't a recording this version of the game can play" << endl;
+		return false;
+	}
+	ifs.read((char*)&m_iSeed, sizeof(m_iSeed));
+	ifs.read((char*)&m_fFramerate, sizeof(m_fFramerate));
+	ifs.read((char*)&m_iFrames, sizeof(m_iFrames));
+	ifs.read((char*)&iSongLen, sizeof(iSongLen));
+	m_sRecordedSong.resize(iSongLen);
+	if(iSongLen)
+		ifs.read(&m_sRecordedSong[0], iSongLen);
+	ifs.read((char*)&m_iRecordedScore, sizeof(m_iRecordedScore));
+	ifs.read((char*)&m_iRecordedBoardHash, sizeof(m_iRecordedBoardHash));
+	ifs.read((char*)&iNumEvents, sizeof(iNumEvents));
+	m_lEvents.resize(iNumEvents);
+	if(iNumEvents)
+		ifs.read((char*)&m_lEvents[0], iNumEvents * sizeof(replayEvent));
+	if(ifs.fail())
+	{
+		errlog(LOG_ERROR) << "Recording " << sFilename << " is truncated" << endl;
+		m_lEvents.clear();
+		return false;
+	}
+	errlog << "Playing back " << m_iFrames << " frames and " << iNumEvents << " events from " << sFilename << endl;
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+// Playback stats
+//-------------------------------------------------------------------------------------
+replayStats Replay::_stats()
+{
+	replayStats stats;
+	stats.frames = m_lFrameMs.size();
+	stats.frameMsP50 = stats.frameMsP99 = stats.frameMsMax = 0;
+	stats.allocsPerFrame = stats.glCallsPerFrame = 0;
+	if(!stats.frames)
+		return stats;
+
+	vector<float> lSorted = m_lFrameMs;
+	sort(lSorted.begin(), lSorted.end());
+	stats.frameMsP50 = lSorted[lSorted.size() / 2];
+	stats.frameMsP99 = lSorted[min((size_t)(lSorted.size() * 0.99), lSorted.size() - 1)];
+	stats.frameMsMax = lSorted.back();
+
+	double fAllocs = 0, fGLCalls = 0;
+	for(uint32_t i = 0; i < stats.frames; i++)
+	{
+		fAllocs += m_lAllocs[i];
+		fGLCalls += m_lGLCalls[i];
+	}
+	stats.allocsPerFrame = (m_lAllocs[0] < 0) ? -1 : fAllocs / stats.frames;
+	stats.glCallsPerFrame = fGLCalls / stats.frames;
+	return stats;
+}
+
+bool Replay::_writeStats(string sFilename, const replayStats& stats)
+{
+	ofstream ofs(sFilename.c_str());
+	if(ofs.fail())
+	{
+		errlog(LOG_ERROR) << "Unable to open " << sFilename << " to write replay stats" << endl;
+		return false;
+	}
+	ofs.precision(3);
+	ofs << fixed << "{\"frames\":" << stats.frames
+		<< ",\n\"frame_ms_p50\":" << stats.frameMsP50
+		<< ",\n\"frame_ms_p99\":" << stats.frameMsP99
+		<< ",\n\"frame_ms_max\":" << stats.frameMsMax
+		<< ",\n\"allocs_per_frame\":" << stats.allocsPerFrame
+		<< ",\n\"gl_calls_per_frame\":" << stats.glCallsPerFrame << "}" << endl;
+	return true;
+}
+
+static double _jsonNumber(const string& sJSON, const char* cKey, double fDefault)
+{
+	string sKey = string("\"") + cKey + "\":";
+	size_t pos = sJSON.find(sKey);
+	if(pos == string::npos)
+		return fDefault;
+	return atof(sJSON.c_str() + pos + sKey.size());
+}
+
+bool Replay::_readStats(string sFilename, replayStats* stats)
+{
+	ifstream ifs(sFilename.c_str());
+	if(ifs.fail())
+	{
+		errlog(LOG_ERROR) << "Unable to open replay baseline " << sFilename << endl;
+		return false;
+	}
+	ostringstream oss;
+	oss << ifs.rdbuf();
+	string sJSON = oss.str();
+	stats->frames = (uint32_t)_jsonNumber(sJSON, "frames", 0);
+	stats->frameMsP50 = _jsonNumber(sJSON, "frame_ms_p50", 0);
+	stats->frameMsP99 = _jsonNumber(sJSON, "frame_ms_p99", 0);
+	stats->frameMsMax = _jsonNumber(sJSON, "frame_ms_max", 0);
+	stats->allocsPerFrame = _jsonNumber(sJSON, "allocs_per_frame", -1);
+	stats->glCallsPerFrame = _jsonNumber(sJSON, "gl_calls_per_frame", 0);
+	return true;
+}
+
+bool Replay::_compare(const replayStats& baseline, const replayStats& stats)
+{
+	bool bOK = true;
+	if(stats.frameMsP50 > baseline.frameMsP50 * REPLAY_FRAMETIME_SLACK + REPLAY_FRAMETIME_MIN_MS)
+	{
+		errlog(LOG_ERROR) << "Replay regression: p50 frame time " << stats.frameMsP50 << "ms, baseline " << baseline.frameMsP50 << "ms" << endl;
+		bOK = false;
+	}
+	if(stats.frameMsP99 > baseline.frameMsP99 * REPLAY_FRAMETIME_SLACK + REPLAY_FRAMETIME_MIN_MS)
+	{
+		errlog(LOG_ERROR) << "Replay regression: p99 frame time " << stats.frameMsP99 << "ms, baseline " << baseline.frameMsP99 << "ms" << endl;
+		bOK = false;
+	}
+	if(baseline.allocsPerFrame >= 0 && stats.allocsPerFrame >= 0 && stats.allocsPerFrame > baseline.allocsPerFrame * REPLAY_ALLOC_SLACK + 1.0)
+	{
+		errlog(LOG_ERROR) << "Replay regression: " << stats.allocsPerFrame << " allocations per frame, baseline " << baseline.allocsPerFrame << endl;
+		bOK = false;
+	}
+	if(stats.glCallsPerFrame > baseline.glCallsPerFrame * REPLAY_GLCALL_SLACK + 1.0)
+	{
+		errlog(LOG_ERROR) << "Replay regression: " << stats.glCallsPerFrame << " GL calls per frame, baseline " << baseline.glCallsPerFrame << endl;
+		bOK = false;
+	}
+	printf(bOK ? "No regressions against %s\n" : "Regressed against %s; see err.log\n", m_sBaseline.c_str());
+	return bOK;
+}
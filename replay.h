@@ -0,0 +1,106 @@
+/*
+	Pony48 header - replay.h
+	Record play sessions, and play them back deterministically as a performance regression test
+	Copyright (c) 2014 Mark Hutcheson
+*/
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "globaldefs.h"
+#include <vector>
+
+//Record with "-record file", play back with "-replay file". Playback runs without a window or sound, one
+//simulation step per rendered frame as fast as possible, and writes frame time/allocation/GL call stats to
+//file.json. Add "-baseline stats.json" to compare against an earlier run; the game exits nonzero if it got worse.
+//Both recording and playback run the game on a fixed clock, so the two see the same getSeconds() every step.
+//Playback mixes audio non-realtime, one simulation step's worth per step, so the music keeps pace with it.
+//Joystick axes and hats that the game polls directly (rather than through events) aren't recorded.
+//The recording also keeps the final score and a hash of the board; if playback ends up somewhere else it's
+//reported as a desync and the game exits nonzero, since the stats would be for a different game.
+
+#define REPLAY_MAGIC			0x52383450	//"P48R"
+#define REPLAY_VERSION			2
+#define REPLAY_CLOCK_START		10000		//getTicks() at the start of a recording, so nothing starts out at 0
+#define REPLAY_FRAMETIME_SLACK	1.15		//Frame time percentiles can be this much worse than the baseline...
+#define REPLAY_FRAMETIME_MIN_MS	0.5			//...plus this, so tiny frames don't fail on timer noise
+#define REPLAY_ALLOC_SLACK		1.05		//Allocations per frame can be this much worse
+#define REPLAY_GLCALL_SLACK		1.05		//GL calls per frame can be this much worse
+
+typedef enum
+{
+	REPLAY_OFF,
+	REPLAY_RECORD,
+	REPLAY_PLAYBACK
+} replayMode;
+
+typedef struct
+{
+	uint32_t frame;		//Simulation step this event came in before
+	SDL_Event event;
+} replayEvent;
+
+typedef struct
+{
+	uint32_t frames;
+	double frameMsP50, frameMsP99, frameMsMax;
+	double allocsPerFrame;		//Mean. -1 if not built with USE_MEMTRACK
+	double glCallsPerFrame;		//Mean
+} replayStats;
+
+class Replay
+{
+	replayMode m_mode;
+	string m_sFilename;
+	string m_sBaseline;
+	uint32_t m_iSeed;
+	float32 m_fFramerate;		//Simulation steps per second
+	string m_sSong;				//Last song loaded
+	string m_sRecordedSong;		//Last song loaded while recording (on playback)
+	uint32_t m_iScore, m_iBoardHash;				//How this run ended up
+	uint32_t m_iRecordedScore, m_iRecordedBoardHash;	//How the recording ended up (on playback)
+	uint32_t m_iFrame;			//Simulation steps so far
+	uint32_t m_iFrames;			//Total simulation steps in the recording
+	vector<replayEvent> m_lEvents;
+	uint32_t m_iNext;			//Next event to play back
+	Uint8 m_iKeys[SDL_NUM_SCANCODES];	//Keyboard state, as of the events played back so far
+	Uint32 m_iMouseButtons;
+
+	vector<float> m_lFrameMs;
+	vector<int> m_lAllocs;
+	vector<uint32_t> m_lGLCalls;
+
+	bool _load(string sFilename);
+	bool _save();
+	replayStats _stats();
+	bool _writeStats(string sFilename, const replayStats& stats);
+	bool _readStats(string sFilename, replayStats* stats);
+	bool _compare(const replayStats& baseline, const replayStats& stats);	//Returns false if stats regressed
+
+public:
+	Replay();
+
+	void commandline(int argc, char** argv);	//Look for replay switches. Call before creating the engine
+	int finish();								//Save the recording or report on playback. Returns the program's exit code
+
+	replayMode getMode()		{return m_mode;};
+	bool active()				{return m_mode != REPLAY_OFF;};
+	bool playing()				{return m_mode == REPLAY_PLAYBACK;};
+	bool done()					{return playing() && m_iFrame >= m_iFrames;};
+	uint32_t getSeed()			{return m_iSeed;};
+	float32 getFramerate()		{return m_fFramerate;};
+	void setFramerate(float32 f)	{m_fFramerate = f;};
+	Uint32 getTicks()			{return REPLAY_CLOCK_START + (Uint32)((double)m_iFrame * 1000.0 / m_fFramerate);};
+	void step()					{m_iFrame++;};	//Call after every simulation step
+	void setSong(string sSong)	{m_sSong = sSong;};
+	void setOutcome(uint32_t iScore, uint32_t iBoardHash)	{m_iScore = iScore; m_iBoardHash = iBoardHash;};	//Call before finish()
+
+	void recordEvent(const SDL_Event& event);	//Keep input events that came in before the next simulation step
+	bool nextEvent(SDL_Event* event);			//Get the next recorded event due before the next simulation step
+	const Uint8* getKeys()		{return m_iKeys;};
+	Uint32 getMouseButtons()	{return m_iMouseButtons;};
+	void addFrame(float32 fMs, int iAllocs, uint32_t iGLCalls);	//Stats for one played-back frame
+};
+
+extern Replay g_replay;
+
+#endif
@@ -0,0 +1,49 @@
+/*
+	Pony48 header - snapshot.h
+	Lock-free triple buffer for handing state from one thread to another
+	Copyright (c) 2014 Mark Hutcheson
+*/
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "globaldefs.h"
+
+//One writer fills in back() and calls publish(); one reader calls consume() and reads front().
+//Neither side ever waits on the other, and the reader always gets the most recently published copy.
+template<class T> class TripleBuffer
+{
+public:
+	TripleBuffer()	{m_iBack = 0; m_iFront = 1; SDL_AtomicSet(&m_iMiddle, 2);};
+
+	//Writer side
+	T& back()		{return m_buf[m_iBack];};
+	void publish()	{m_iBack = _exchange(m_iBack | SNAPSHOT_FRESH) & SNAPSHOT_INDEX;};	//Swap back buffer into the middle, flagged as new
+
+	//Reader side
+	bool consume()	//Grab the newest published buffer, if there is one. Returns false if nothing new was published
+	{
+		if(!(SDL_AtomicGet(&m_iMiddle) & SNAPSHOT_FRESH))
+			return false;
+		m_iFront = _exchange(m_iFront) & SNAPSHOT_INDEX;
+		return true;
+	};
+	const T& front()	{return m_buf[m_iFront];};
+
+private:
+	enum {SNAPSHOT_INDEX = 0x3, SNAPSHOT_FRESH = 0x4};
+
+	T m_buf[3];
+	int m_iBack, m_iFront;	//Owned by writer and reader, respectively
+	SDL_atomic_t m_iMiddle;	//Index of the buffer in between, plus whether it's been published since last read
+
+	int _exchange(int val)	//Full-barrier swap, so buffer contents are visible before the index is
+	{
+		int old;
+		do
+			old = SDL_AtomicGet(&m_iMiddle);
+		while(!SDL_AtomicCAS(&m_iMiddle, old, val));
+		return old;
+	};
+};
+
+#endif
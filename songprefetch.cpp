@@ -0,0 +1,256 @@
+/*
+	Pony48 source - songprefetch.cpp
+	Copyright (c) 2014 Mark Hutcheson
+*/
+
+#include "songprefetch.h"
+#include "Engine.h"
+#include <fstream>
+#include <sstream>
+
+SongPrefetcher::SongPrefetcher()
+{
+	m_sys = NULL;
+	m_thread = NULL;
+	m_mutex = NULL;
+	m_condDone = NULL;
+	m_semWake = NULL;
+	m_bQuit = false;
+	m_ready = NULL;
+}
+
+SongPrefetcher::~SongPrefetcher()
+{
+	shutdown();
+}
+
+bool SongPrefetcher::init(FMOD_SYSTEM* sys)
+{
+	if(m_thread != NULL)
+		return false;
+	m_sys = sys;	//May be NULL with no sound; we'll still parse everything else
+	m_bQuit = false;
+	m_mutex = SDL_CreateMutex();
+	m_condDone = SDL_CreateCond();
+	m_semWake = SDL_CreateSemaphore(0);
+	m_thread = SDL_CreateThread(_workerThread, "songprefetch", this);
+	if(m_thread == NULL)
+	{
+		errlog(LOG_WARN) << "Unable to start song prefetch thread: " << SDL_GetError() << endl;
+		shutdown();
+		return false;
+	}
+	return true;
+}
+
+void SongPrefetcher::shutdown()
+{
+	if(m_thread != NULL)
+	{
+		SDL_LockMutex(m_mutex);
+		m_bQuit = true;
+		SDL_UnlockMutex(m_mutex);
+		SDL_SemPost(m_semWake);
+		SDL_WaitThread(m_thread, NULL);
+		m_thread = NULL;
+	}
+	release(m_ready);	//Worker's gone, so this is ours now
+	m_ready = NULL;
+	m_sWanted = m_sLoading = m_sRequested = "";
+	if(m_semWake != NULL)
+	{
+		SDL_DestroySemaphore(m_semWake);
+		m_semWake = NULL;
+	}
+	if(m_condDone != NULL)
+	{
+		SDL_DestroyCond(m_condDone);
+		m_condDone = NULL;
+	}
+	if(m_mutex != NULL)
+	{
+		SDL_DestroyMutex(m_mutex);
+		m_mutex = NULL;
+	}
+	m_sys = NULL;
+}
+
+void SongPrefetcher::request(string sFilename)
+{
+	if(m_thread == NULL || sFilename == m_sRequested)
+		return;
+	m_sRequested = sFilename;
+
+	songData* stale = NULL;
+	SDL_LockMutex(m_mutex);
+	m_sWanted = sFilename;
+	if(m_ready != NULL && m_ready->sFilename != sFilename)
+	{
+		stale = m_ready;
+		m_ready = NULL;
+	}
+	SDL_UnlockMutex(m_mutex);
+	release(stale);	//Out here, since it may have a music stream open (and FMOD calls stay on this thread)
+	SDL_SemPost(m_semWake);
+}
+
+void SongPrefetcher::update()
+{
+	if(m_thread == NULL || m_sys == NULL)
+		return;
+
+	SDL_LockMutex(m_mutex);
+	if(m_ready != NULL && !m_ready->bMusicOpened && m_ready->sMusicPath.size())
+	{
+		//Nonblocking, so FMOD does the actual file work on its own thread; playMusic() waits out whatever's left
+		m_ready->bMusicOpened = true;
+		if(FMOD_System_CreateSound(m_sys, m_ready->sMusicPath.c_str(), MUSIC_OPEN_MODE | FMOD_NONBLOCKING, 0, &m_ready->music) != FMOD_OK)
+			m_ready->music = NULL;
+	}
+	SDL_UnlockMutex(m_mutex);
+}
+
+songData* SongPrefetcher::take(string sFilename)
+{
+	if(m_thread == NULL)
+		return NULL;
+
+	songData* ret = NULL;
+	SDL_LockMutex(m_mutex);
+	m_sWanted = "";	//Whatever happens, we're done with song select
+	while(m_sLoading == sFilename)
+		SDL_CondWait(m_condDone, m_mutex);
+	if(m_ready != NULL && m_ready->sFilename == sFilename)
+	{
+		ret = m_ready;
+		m_ready = NULL;
+	}
+	SDL_UnlockMutex(m_mutex);
+	m_sRequested = "";
+	return ret;
+}
+
+int SongPrefetcher::_workerThread(void* data)
+{
+	SongPrefetcher* me = (SongPrefetcher*)data;
+	while(true)
+	{
+		SDL_SemWait(me->m_semWake);
+
+		SDL_LockMutex(me->m_mutex);
+		if(me->m_bQuit)
+		{
+			SDL_UnlockMutex(me->m_mutex);
+			break;
+		}
+		string sFilename = me->m_sWanted;
+		if(!sFilename.size() || (me->m_ready != NULL && me->m_ready->sFilename == sFilename))
+		{
+			SDL_UnlockMutex(me->m_mutex);
+			continue;
+		}
+		me->m_sLoading = sFilename;
+		SDL_UnlockMutex(me->m_mutex);
+
+		songData* song = load(sFilename);
+
+		SDL_LockMutex(me->m_mutex);
+		me->m_sLoading = "";
+		if(me->m_sWanted == sFilename && me->m_ready == NULL)
+		{
+			me->m_ready = song;
+			song = NULL;
+		}
+		SDL_CondBroadcast(me->m_condDone);
+		SDL_UnlockMutex(me->m_mutex);
+
+		//Moved off it while we were loading. Never made it to m_ready, so there's no music open to worry about
+		release(song);
+	}
+	return 0;
+}
+
+songData* SongPrefetcher::load(string sFilename)
+{
+	songData* song = new songData;
+	song->sFilename = sFilename;
+	song->music = NULL;
+	song->bMusicOpened = false;
+
+	int iErr;
+	{
+		MEM_TAG(MEM_XML);
+		song->doc = new XMLDocument();
+		iErr = song->doc->LoadFile(sFilename.c_str());
+	}
+	if(iErr != XML_NO_ERROR)
+	{
+		errlog(LOG_ERROR) << "Error parsing XML file " << sFilename << ": Error " << iErr << endl;
+		delete song->doc;
+		song->doc = NULL;
+		return song;
+	}
+
+	XMLElement* root = song->doc->FirstChildElement("song");
+	if(root == NULL)
+		return song;	//Complained about when it's applied
+
+	for(XMLElement* elem = root->FirstChildElement(); elem != NULL; elem = elem->NextSiblingElement())
+	{
+		const char* cName = elem->Name();
+		if(cName == NULL)
+			continue;
+		string name = cName;
+		if(name == "sfx")
+		{
+			const char* cPath = elem->Attribute("path");
+			if(cPath && !song->sMusicPath.size())
+			{
+				song->sMusicPath = cPath;
+				song->beats.loadCache(cPath);	//Only if it's already been analyzed; that's not something to do speculatively
+			}
+		}
+		else if(name == "lua")
+		{
+			const char* cLuaFile = elem->Attribute("file");
+			if(cLuaFile && !song->sLuaFile.size())
+			{
+				song->sLuaFile = cLuaFile;
+				ifstream infile(cLuaFile, ios_base::in | ios_base::binary);
+				if(!infile.fail())
+				{
+					ostringstream oss;
+					oss << infile.rdbuf();
+					song->sLuaChunk = oss.str();
+				}
+			}
+		}
+		else if(name == "particles")
+		{
+			const char* cParticleFilename = elem->Attribute("effect");
+			if(cParticleFilename && !song->particles.count(cParticleFilename))
+			{
+				MEM_TAG(MEM_XML);
+				XMLDocument* particleDoc = new XMLDocument();
+				if(particleDoc->LoadFile(cParticleFilename) == XML_NO_ERROR)
+					song->particles[cParticleFilename] = particleDoc;
+				else
+					delete particleDoc;	//Let ParticleSystem::fromXML() complain about it later
+			}
+		}
+	}
+	return song;
+}
+
+void SongPrefetcher::release(songData* song)
+{
+	if(song == NULL)
+		return;
+	if(song->doc != NULL)
+		delete song->doc;
+	if(song->music != NULL)
+		FMOD_Sound_Release(song->music);
+	for(map<string, XMLDocument*>::iterator i = song->particles.begin(); i != song->particles.end(); i++)
+		delete i->second;
+	delete song;
+}
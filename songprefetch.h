@@ -0,0 +1,60 @@
+/*
+	Pony48 header - songprefetch.h
+	Loads the song highlighted on the song select screen in the background, so picking it is instant
+	Copyright (c) 2014 Mark Hutcheson
+*/
+#ifndef SONGPREFETCH_H
+#define SONGPREFETCH_H
+
+#include "globaldefs.h"
+#include "beatmap.h"
+#include <fmod.h>
+#include <map>
+
+//Everything about a song that can be loaded without touching game state
+typedef struct
+{
+	string sFilename;			//Song XML
+	XMLDocument* doc;			//Parsed song XML, or NULL if it didn't parse
+	string sMusicPath;			//From <sfx>
+	FMOD_SOUND* music;			//Stream for sMusicPath, opened in the background. NULL until then
+	bool bMusicOpened;			//If we've tried opening music yet
+	BeatMap beats;				//Cached beat map for sMusicPath, if there was an up-to-date one
+	string sLuaFile;			//From <lua>
+	string sLuaChunk;			//Contents of sLuaFile
+	map<string, XMLDocument*> particles;	//Parsed particle templates, by filename
+} songData;
+
+class SongPrefetcher
+{
+	FMOD_SYSTEM* m_sys;
+	SDL_Thread* m_thread;
+	SDL_mutex* m_mutex;			//Guards everything below
+	SDL_cond* m_condDone;		//Signaled whenever the worker finishes a song
+	SDL_sem* m_semWake;
+	bool m_bQuit;
+	string m_sWanted;			//Song the game would like next
+	string m_sLoading;			//Song the worker's on right now
+	songData* m_ready;			//Finished song, waiting to be taken or replaced
+	string m_sRequested;		//Last thing request() was asked for. Game thread only, so it doesn't need the lock
+
+	static int _workerThread(void* data);
+
+public:
+	SongPrefetcher();
+	~SongPrefetcher();
+
+	bool init(FMOD_SYSTEM* sys);
+	void shutdown();
+
+	//Game thread only
+	void request(string sFilename);		//Start loading this song in the background, if we haven't already
+	void update();						//Opens the prefetched song's music stream (FMOD calls stay on this thread)
+	songData* take(string sFilename);	//Hand over the prefetched song if it's this one (waiting if it's on its way), or NULL. Caller owns it
+
+	//Any thread
+	static songData* load(string sFilename);	//What the worker does; also usable directly if nothing was prefetched
+	static void release(songData* song);		//Free anything in song that wasn't taken out of it
+};
+
+#endif
@@ -0,0 +1,157 @@
+/*
+	Pony48 source - songschedule.cpp
+	Copyright (c) 2014 Mark Hutcheson
+*/
+
+#include "songschedule.h"
+#include "luainterface.h"
+#include <algorithm>
+#include <cmath>
+
+#define SCHEDULE_REWIND_EPSILON	0.0001f	//Back off this far when rewinding, so events right on the loop start fire
+
+SongScheduler::SongScheduler()
+{
+	m_lua = NULL;
+	m_fLastPos = -1.0f;
+	m_fLoopStart = 0.0f;
+	m_fLoopEnd = -1.0f;
+	m_iNextId = 1;
+	m_bDispatching = false;
+}
+
+int32_t SongScheduler::add(float32 fTime, int iLuaRef, float32 fRepeat, float32 fUntil)
+{
+	songEvent ev;
+	ev.id = m_iNextId++;
+	ev.iLuaRef = iLuaRef;
+	ev.fFirst = max(fTime, 0.0f);
+	ev.fRepeat = (fRepeat > 0.0f) ? max(fRepeat, SCHEDULE_MIN_REPEAT) : 0.0f;
+	ev.fUntil = fUntil;
+	m_events.insert(make_pair(ev.fFirst, ev));	//If that's already behind us, it waits for the song to loop
+	return ev.id;
+}
+
+bool SongScheduler::remove(int32_t id)
+{
+	for(multimap<float32, songEvent>::iterator i = m_events.begin(); i != m_events.end(); i++)
+	{
+		if(i->second.id == id)
+		{
+			if(m_bDispatching)
+				m_lRemoved.push_back(id);
+			_unref(i->second.iLuaRef);
+			m_events.erase(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+void SongScheduler::clear()
+{
+	for(multimap<float32, songEvent>::iterator i = m_events.begin(); i != m_events.end(); i++)
+	{
+		if(m_bDispatching)
+			m_lRemoved.push_back(i->second.id);
+		_unref(i->second.iLuaRef);
+	}
+	m_events.clear();
+	m_fLastPos = -1.0f;
+	m_fLoopStart = 0.0f;
+	m_fLoopEnd = -1.0f;
+}
+
+void SongScheduler::_unref(int iLuaRef)
+{
+	if(m_bDispatching)
+		m_lDeadRefs.push_back(iLuaRef);	//Might be about to get called; Lua would hand the ref to the next thing that asks if we let it go now
+	else if(m_lua != NULL)
+		m_lua->unref(iLuaRef);
+}
+
+void SongScheduler::_rewind(float32 fFrom)
+{
+	multimap<float32, songEvent> events;
+	for(multimap<float32, songEvent>::iterator i = m_events.begin(); i != m_events.end(); i++)
+	{
+		const songEvent& ev = i->second;
+		float32 fNext = ev.fFirst;
+		if(ev.fRepeat > 0.0f && ev.fFirst < fFrom)
+		{
+			fNext = ev.fFirst + ceil((fFrom - ev.fFirst) / ev.fRepeat) * ev.fRepeat;
+			if(ev.fUntil >= 0.0f && fNext > ev.fUntil)
+				fNext = ev.fFirst;
+		}
+		events.insert(make_pair(fNext, ev));
+	}
+	m_events.swap(events);
+	m_fLastPos = fFrom - SCHEDULE_REWIND_EPSILON;
+}
+
+void SongScheduler::_collect(float32 fTo)
+{
+	//Repeating events go back in at their next time after fTo
+	vector<pair<float32, songEvent> > lRequeue;
+	multimap<float32, songEvent>::iterator i = m_events.upper_bound(m_fLastPos);
+	while(i != m_events.end() && i->first <= fTo)
+	{
+		m_lDue.push_back(*i);
+		const songEvent& ev = i->second;
+		if(ev.fRepeat > 0.0f)
+		{
+			//Once a frame at most; if we've fallen behind, skip ahead rather than firing a burst
+			float32 fNext = i->first + ev.fRepeat;
+			if(fNext <= fTo)
+				fNext += (floor((fTo - fNext) / ev.fRepeat) + 1.0f) * ev.fRepeat;
+			if(ev.fUntil >= 0.0f && fNext > ev.fUntil)
+				fNext = ev.fFirst;	//Done until the song loops
+			lRequeue.push_back(make_pair(fNext, ev));
+			m_events.erase(i++);
+		}
+		else
+			i++;
+	}
+	for(vector<pair<float32, songEvent> >::iterator j = lRequeue.begin(); j != lRequeue.end(); j++)
+		m_events.insert(*j);
+	m_fLastPos = fTo;
+}
+
+void SongScheduler::update(float32 fPos)
+{
+	if(fPos < 0.0f || m_lua == NULL || m_bDispatching)
+		return;
+
+	//Pull out everything that's due
+	m_lDue.clear();
+	if(fPos < m_fLastPos)
+	{
+		bool bLooped;
+		if(m_fLoopEnd > m_fLoopStart)
+			bLooped = (m_fLastPos >= m_fLoopEnd - SCHEDULE_WRAP_WINDOW && fPos <= m_fLoopStart + SCHEDULE_WRAP_WINDOW);
+		else
+			bLooped = (fPos >= m_fLoopStart);	//Can't tell; assume it looped, so nothing just past the loop start gets skipped
+		
+		//Looping lands a frame or so past the loop start, with the rest of the song before the loop end still due.
+		//Fire that, then pick up from the loop start. The loop end itself is the same moment as the loop start, so not that
+		if(bLooped && m_fLastPos < m_fLoopEnd - SCHEDULE_REWIND_EPSILON)
+			_collect(m_fLoopEnd - SCHEDULE_REWIND_EPSILON);
+		_rewind(bLooped ? min(m_fLoopStart, fPos) : fPos);
+	}
+	_collect(fPos);
+
+	//Only now hand control to Lua
+	m_bDispatching = true;
+	for(vector<pair<float32, songEvent> >::iterator j = m_lDue.begin(); j != m_lDue.end(); j++)
+	{
+		if(m_lRemoved.size() && find(m_lRemoved.begin(), m_lRemoved.end(), j->second.id) != m_lRemoved.end())
+			continue;
+		m_lua->callRef(j->second.iLuaRef, j->first, fPos);
+	}
+	m_bDispatching = false;
+
+	m_lRemoved.clear();
+	for(vector<int>::iterator j = m_lDeadRefs.begin(); j != m_lDeadRefs.end(); j++)
+		m_lua->unref(*j);
+	m_lDeadRefs.clear();
+}
@@ -0,0 +1,61 @@
+/*
+	Pony48 header - songschedule.h
+	Song script callbacks queued up by song position, so only the ones that are due cost anything
+	Copyright (c) 2014 Mark Hutcheson
+*/
+#ifndef SONGSCHEDULE_H
+#define SONGSCHEDULE_H
+
+#include "globaldefs.h"
+#include <map>
+#include <vector>
+
+#define SCHEDULE_MIN_REPEAT	0.01f	//Shortest repeat we'll take, in seconds, so a bad script can't stall a frame
+#define SCHEDULE_WRAP_WINDOW	0.5f	//How close to the loop points a jump back has to go from and to, to count as the song looping rather than a seek
+
+class LuaInterface;
+
+typedef struct
+{
+	int32_t id;
+	int iLuaRef;		//Callback, in the Lua registry
+	float32 fFirst;		//Song position it first fires at
+	float32 fRepeat;	//Seconds between firings after that, or 0 for once
+	float32 fUntil;		//Stop repeating after this (song position), or < 0 for never
+} songEvent;
+
+class SongScheduler
+{
+	LuaInterface* m_lua;
+	multimap<float32, songEvent> m_events;		//By when they next fire. Ones that are done for now sit at fFirst
+	float32 m_fLastPos;			//Everything up to and including this has fired
+	float32 m_fLoopStart;
+	float32 m_fLoopEnd;			//< 0 if we don't know
+	int32_t m_iNextId;
+
+	//Callbacks can add and remove events, so we don't hold on to anything in m_events while they run
+	bool m_bDispatching;
+	vector<pair<float32, songEvent> > m_lDue;
+	vector<int32_t> m_lRemoved;		//Removed while dispatching; don't call these
+	vector<int> m_lDeadRefs;		//Freed once dispatching is done
+
+	void _collect(float32 fTo);	//Move everything due between m_fLastPos and fTo into m_lDue, and advance m_fLastPos to fTo
+	void _rewind(float32 fFrom);	//Song jumped back (looped or seeked); put everything back where it fires next, counting from fFrom
+	void _unref(int iLuaRef);
+
+public:
+	SongScheduler();
+
+	void setLua(LuaInterface* lua)	{m_lua = lua;};
+	void setLoop(float32 fStart, float32 fEnd)	{m_fLoopStart = fStart; m_fLoopEnd = fEnd;};	//Where the song loops, so events just either side of that still fire
+
+	int32_t add(float32 fTime, int iLuaRef, float32 fRepeat = 0.0f, float32 fUntil = -1.0f);	//Takes ownership of the ref. Returns an id for remove()
+	bool remove(int32_t id);
+	void clear();						//Drop everything (new song)
+	uint32_t size()						{return m_events.size();};
+
+	//Fire everything due between the last update and fPos, in order. Call once per frame with the music position
+	void update(float32 fPos);
+};
+
+#endif
@@ -0,0 +1,222 @@
+/*
+	Pony48 source - spectrum.cpp
+	Copyright (c) 2014 Mark Hutcheson
+*/
+
+#include "spectrum.h"
+#include "fft.h"
+#include <cmath>
+#include <cstring>
+
+#define ANALYZER_STALE		250		//Milliseconds without a new spectrum before we say we don't have one (music paused or stopped)
+
+SpectrumAnalyzer::SpectrumAnalyzer()
+{
+	m_sys = NULL;
+	m_dsp = NULL;
+	m_thread = NULL;
+	m_semWake = NULL;
+	SDL_AtomicSet(&m_bQuit, 0);
+	SDL_AtomicSet(&m_iRingWrite, 0);
+	SDL_AtomicSet(&m_iRingRead, 0);
+	SDL_AtomicSet(&m_iDropped, 0);
+	memset(m_fHistory, 0, sizeof(m_fHistory));
+	m_iSeq = 0;
+	m_iLastFresh = 0;
+
+	hannWindow(m_fWindow, ANALYZER_FFT_SIZE);
+	float fWindowSum = 0.0f;
+	for(uint32_t i = 0; i < ANALYZER_FFT_SIZE; i++)
+		fWindowSum += m_fWindow[i];
+	m_fScale = 2.0f / fWindowSum;
+}
+
+SpectrumAnalyzer::~SpectrumAnalyzer()
+{
+	shutdown();
+}
+
+bool SpectrumAnalyzer::init(FMOD_SYSTEM* sys)
+{
+	if(sys == NULL || m_dsp != NULL)
+		return false;
+	m_sys = sys;
+
+	FMOD_DSP_DESCRIPTION desc;
+	memset(&desc, 0, sizeof(desc));
+	strncpy(desc.name, "Pony48 spectrum", sizeof(desc.name) - 1);
+	desc.channels = 0;	//Whatever the channel has
+	desc.read = _dspRead;
+	desc.userdata = this;
+	if(FMOD_System_CreateDSP(sys, &desc, &m_dsp) != FMOD_OK)
+	{
+		errlog(LOG_WARN) << "Unable to create spectrum analyzer DSP; falling back to FMOD's spectrum" << endl;
+		m_dsp = NULL;
+		return false;
+	}
+
+	m_semWake = SDL_CreateSemaphore(0);
+	m_thread = SDL_CreateThread(_workerThread, "spectrum", this);
+	if(m_thread == NULL)
+	{
+		errlog(LOG_WARN) << "Unable to start spectrum analyzer thread: " << SDL_GetError() << endl;
+		shutdown();
+		return false;
+	}
+	return true;
+}
+
+void SpectrumAnalyzer::shutdown()
+{
+	if(m_thread != NULL)
+	{
+		SDL_AtomicSet(&m_bQuit, 1);
+		SDL_SemPost(m_semWake);
+		SDL_WaitThread(m_thread, NULL);
+		m_thread = NULL;
+	}
+	if(m_semWake != NULL)
+	{
+		SDL_DestroySemaphore(m_semWake);
+		m_semWake = NULL;
+	}
+	if(m_dsp != NULL)
+	{
+		FMOD_DSP_Remove(m_dsp);
+		FMOD_DSP_Release(m_dsp);
+		m_dsp = NULL;
+	}
+}
+
+void SpectrumAnalyzer::attach(FMOD_CHANNEL* channel)
+{
+	if(m_dsp == NULL)
+		return;
+	FMOD_DSP_Remove(m_dsp);
+	if(channel != NULL)
+		FMOD_Channel_AddDSP(channel, m_dsp, NULL);
+	m_iLastFresh = 0;	//Don't hand out the last song's spectrum
+}
+
+bool SpectrumAnalyzer::read(float* bars)
+{
+	if(m_snapshots.consume())
+		m_iLastFresh = SDL_GetTicks();
+	if(!m_iLastFresh || SDL_GetTicks() - m_iLastFresh > ANALYZER_STALE)
+		return false;
+	memcpy(bars, m_snapshots.front().bars, sizeof(m_snapshots.front().bars));
+	return true;
+}
+
+//-------------------------------------------------------------------------------------
+// Mixer thread
+//-------------------------------------------------------------------------------------
+FMOD_RESULT F_CALLBACK SpectrumAnalyzer::_dspRead(FMOD_DSP_STATE* dsp_state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int outchannels)
+{
+	//Pass the audio through untouched
+	memcpy(outbuffer, inbuffer, length * outchannels * sizeof(float));
+
+	void* data = NULL;
+	FMOD_DSP_GetUserData(dsp_state->instance, &data);
+	if(data != NULL && inchannels > 0)
+		((SpectrumAnalyzer*)data)->_push(inbuffer, length, inchannels);
+	return FMOD_OK;
+}
+
+void SpectrumAnalyzer::_push(const float* in, unsigned int length, int channels)
+{
+	uint32_t iWrite = SDL_AtomicGet(&m_iRingWrite);
+	uint32_t iFree = ANALYZER_RING_SIZE - (iWrite - (uint32_t)SDL_AtomicGet(&m_iRingRead));
+	if(length > iFree)
+	{
+		SDL_AtomicAdd(&m_iDropped, length - iFree);
+		length = iFree;
+	}
+
+	//Mix down to mono as we go
+	float fMul = 1.0f / channels;
+	for(unsigned int i = 0; i < length; i++)
+	{
+		float f = 0.0f;
+		for(int c = 0; c < channels; c++)
+			f += in[i * channels + c];
+		m_fRing[(iWrite + i) & (ANALYZER_RING_SIZE - 1)] = f * fMul;
+	}
+	SDL_MemoryBarrierRelease();
+	SDL_AtomicSet(&m_iRingWrite, iWrite + length);
+	SDL_SemPost(m_semWake);
+}
+
+//-------------------------------------------------------------------------------------
+// Worker thread
+//-------------------------------------------------------------------------------------
+int SpectrumAnalyzer::_workerThread(void* data)
+{
+	SpectrumAnalyzer* sa = (SpectrumAnalyzer*)data;
+	while(!SDL_AtomicGet(&sa->m_bQuit))
+	{
+		SDL_SemWaitTimeout(sa->m_semWake, ANALYZER_WAIT);
+		while(sa->_analyze());
+	}
+	return 0;
+}
+
+bool SpectrumAnalyzer::_analyze()
+{
+	uint32_t iRead = SDL_AtomicGet(&m_iRingRead);
+	uint32_t iWrite = SDL_AtomicGet(&m_iRingWrite);
+	uint32_t iAvail = iWrite - iRead;
+	if(iAvail < ANALYZER_HOP)
+		return false;
+	SDL_MemoryBarrierAcquire();
+
+	if(iAvail >= ANALYZER_FFT_SIZE)
+	{
+		//Fell behind (or just started); skip straight to the newest block rather than catching up
+		iRead = iWrite - ANALYZER_FFT_SIZE;
+		for(uint32_t i = 0; i < ANALYZER_FFT_SIZE; i++)
+			m_fHistory[i] = m_fRing[(iRead + i) & (ANALYZER_RING_SIZE - 1)];
+		iRead = iWrite;
+	}
+	else
+	{
+		memmove(m_fHistory, &m_fHistory[ANALYZER_HOP], (ANALYZER_FFT_SIZE - ANALYZER_HOP) * sizeof(float));
+		for(uint32_t i = 0; i < ANALYZER_HOP; i++)
+			m_fHistory[ANALYZER_FFT_SIZE - ANALYZER_HOP + i] = m_fRing[(iRead + i) & (ANALYZER_RING_SIZE - 1)];
+		iRead += ANALYZER_HOP;
+	}
+	SDL_AtomicSet(&m_iRingRead, iRead);	//Mixer can have that space back now
+
+	applyWindow(m_fHistory, m_fWindow, m_fRe, ANALYZER_FFT_SIZE);
+	realFFT(m_fRe, m_fRe, m_fIm, ANALYZER_FFT_SIZE);
+	magnitudes(m_fRe, m_fIm, m_fMag, ANALYZER_FFT_SIZE / 2, m_fScale);
+
+	//Fold bins into bars, keeping the total energy
+	spectrumSnapshot* snap = &m_snapshots.back();
+	const uint32_t iBinsPerBar = ANALYZER_FFT_SIZE / 2 / ANALYZER_BARS;
+	for(uint32_t b = 0; b < ANALYZER_BARS; b++)
+	{
+		float fPower = 0.0f;
+		for(uint32_t k = b * iBinsPerBar; k < (b + 1) * iBinsPerBar; k++)
+			fPower += m_fMag[k] * m_fMag[k];
+		snap->bars[b] = sqrt(fPower);
+	}
+	snap->iSeq = ++m_iSeq;
+
+	m_snapshots.publish();
+	return true;
+}
+
+void SpectrumDelay::push(const float* bars)
+{
+	m_iNewest = (m_iNewest + 1) % SPECTRUM_DELAY_MAX;
+	memcpy(m_fFrames[m_iNewest], bars, sizeof(m_fFrames[m_iNewest]));
+	if(m_iCount < SPECTRUM_DELAY_MAX)
+		m_iCount++;
+}
+
+const float* SpectrumDelay::get(uint32_t iFramesAgo)
+{
+	iFramesAgo = min(iFramesAgo, m_iCount - 1);
+	return m_fFrames[(m_iNewest + SPECTRUM_DELAY_MAX - iFramesAgo) % SPECTRUM_DELAY_MAX];
+}
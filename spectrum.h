@@ -0,0 +1,85 @@
+/*
+	Pony48 header - spectrum.h
+	Real-time spectrum of the music, tapped off FMOD's mixer and analyzed on its own thread
+	Copyright (c) 2014 Mark Hutcheson
+*/
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include "globaldefs.h"
+#include <fmod.h>
+#include "snapshot.h"
+
+#define ANALYZER_FFT_SIZE	1024	//Samples per FFT (power of 2)
+#define ANALYZER_HOP		512		//New samples between FFTs
+#define ANALYZER_RING_SIZE	16384	//Mono samples buffered between the mixer and the worker (power of 2)
+#define ANALYZER_BARS		64		//Linear bars up to Nyquist, same layout as FMOD_Channel_GetSpectrum() gives
+#define ANALYZER_WAIT		50		//Milliseconds the worker sleeps if the mixer doesn't wake it
+#define SPECTRUM_DELAY_MAX	64		//Frames of spectra SpectrumDelay can hold back
+
+typedef struct
+{
+	float bars[ANALYZER_BARS];		//Amplitude per bar; a full-scale sine is about 1
+	uint32_t iSeq;					//Increments with every FFT
+} spectrumSnapshot;
+
+class SpectrumAnalyzer
+{
+	FMOD_SYSTEM* m_sys;
+	FMOD_DSP* m_dsp;
+	SDL_Thread* m_thread;
+	SDL_sem* m_semWake;
+	SDL_atomic_t m_bQuit;
+
+	//Mixer thread -> worker: single-producer single-consumer ring of mono samples
+	float m_fRing[ANALYZER_RING_SIZE];
+	SDL_atomic_t m_iRingWrite;		//Only the mixer thread writes this...
+	SDL_atomic_t m_iRingRead;		//...and only the worker writes this
+	SDL_atomic_t m_iDropped;		//Samples lost to a full ring
+
+	//Worker's scratch space
+	float m_fWindow[ANALYZER_FFT_SIZE];
+	float m_fHistory[ANALYZER_FFT_SIZE];	//Latest FFT_SIZE samples, oldest first
+	float m_fRe[ANALYZER_FFT_SIZE];
+	float m_fIm[ANALYZER_FFT_SIZE / 2];
+	float m_fMag[ANALYZER_FFT_SIZE / 2];
+	float m_fScale;
+	uint32_t m_iSeq;
+
+	TripleBuffer<spectrumSnapshot> m_snapshots;	//Worker -> game thread
+	Uint32 m_iLastFresh;			//When the game thread last got a new spectrum
+
+	static FMOD_RESULT F_CALLBACK _dspRead(FMOD_DSP_STATE* dsp_state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int outchannels);
+	static int _workerThread(void* data);
+	void _push(const float* in, unsigned int length, int channels);	//Mixer thread
+	bool _analyze();				//Worker. Returns false if there wasn't a full hop waiting
+
+public:
+	SpectrumAnalyzer();
+	~SpectrumAnalyzer();
+
+	bool init(FMOD_SYSTEM* sys);	//Create the DSP and start the worker. Everything's allocated here; nothing after
+	void shutdown();
+	void attach(FMOD_CHANNEL* channel);	//Listen to this channel (and stop listening to the last one)
+
+	//Latest spectrum. Returns false if nothing's been analyzed since attach(). Game thread only
+	bool read(float* bars);
+	uint32_t getDropped()		{return SDL_AtomicGet(&m_iDropped);};
+};
+
+//Holds spectra back a few frames, so what we show lines up with what's coming out of the speakers rather than what's being mixed
+class SpectrumDelay
+{
+	float m_fFrames[SPECTRUM_DELAY_MAX][ANALYZER_BARS];
+	uint32_t m_iNewest;
+	uint32_t m_iCount;
+
+public:
+	SpectrumDelay()		{clear();};
+
+	void clear()		{m_iNewest = m_iCount = 0;};
+	void push(const float* bars);
+	const float* get(uint32_t iFramesAgo);	//Clamped to the oldest one we have. Only valid after a push()
+};
+
+#endif
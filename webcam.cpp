@@ -145,7 +145,7 @@ void Webcam::open(int device)
 		m_VideoCap->open(device);
 		if(!m_VideoCap->isOpened())	
 		{
-			errlog << "Unable to open webcam " << device << endl;
+			errlog(LOG_ERROR) << "Unable to open webcam " << device << endl;
 			m_VideoCap->release();
 			delete m_VideoCap;
 			m_VideoCap = NULL;